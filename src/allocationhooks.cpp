@@ -0,0 +1,92 @@
+/** \file allocationhooks.cpp
+ *  \brief Counting replacements of the global operator new and delete.
+ *         Not part of the core library; programs that want allocation
+ *         accounting, like sqm-bench and sqm-tests, link this file.
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "allocationtracker.hpp"
+
+/* Kept in front of every block, so that a block allocated while tracking
+ * was off is not taken off the live bytes when it is freed. The size keeps
+ * the blocks aligned for any type. */
+struct BlockHeader
+{
+    std::size_t size;
+    bool tracked;
+};
+
+static const std::size_t header_size = alignof(std::max_align_t);
+static_assert(sizeof(BlockHeader) <= header_size, "Block header does not fit.");
+
+static void* allocate(std::size_t size)
+{
+    void* p = std::malloc(header_size + size);
+    if(p == nullptr) throw std::bad_alloc{};
+
+    BlockHeader* header = static_cast<BlockHeader*>(p);
+    header->size = size;
+    header->tracked = record_allocation(size);
+    return static_cast<char*>(p) + header_size;
+}
+
+static void deallocate(void* p) noexcept
+{
+    if(p == nullptr) return;
+
+    void* block = static_cast<char*>(p) - header_size;
+    const BlockHeader* header = static_cast<const BlockHeader*>(block);
+    record_deallocation(header->size, header->tracked);
+    std::free(block);
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return allocate(size);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+
+static const bool registered = (register_allocation_counting(), true);
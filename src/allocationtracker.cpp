@@ -0,0 +1,187 @@
+/** \file allocationtracker.cpp
+ *  \brief Allocation tracker implementation file.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include "allocationtracker.hpp"
+#ifdef SQM_TESTS
+#include <memory>
+#include <thread>
+#include <vector>
+#include "squarematrix.hpp"
+#include "catch.hpp"
+#endif
+
+static std::atomic<bool> tracking{false};
+static std::atomic<std::uint64_t> heap_allocations{0};
+static std::atomic<std::uint64_t> heap_deallocations{0};
+static std::atomic<std::uint64_t> heap_bytes{0};
+static std::atomic<std::int64_t> live_bytes{0};
+static std::atomic<std::int64_t> peak_bytes{0};
+
+static void raise_peak(std::int64_t live)
+{
+    std::int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while(peak < live && !peak_bytes.compare_exchange_weak(peak, live,
+                                                           std::memory_order_relaxed)) {}
+}
+
+static std::atomic<bool> counting_linked{false};
+
+void register_allocation_counting()
+{
+    counting_linked.store(true);
+}
+
+bool allocation_counting_linked()
+{
+    return counting_linked.load();
+}
+
+bool record_allocation(std::size_t size)
+{
+    if(!tracking.load(std::memory_order_relaxed)) return false;
+
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    const std::int64_t bytes = static_cast<std::int64_t>(size);
+    raise_peak(live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    return true;
+}
+
+void record_deallocation(std::size_t size, bool counted)
+{
+    if(counted)
+    {
+        live_bytes.fetch_sub(static_cast<std::int64_t>(size),
+                             std::memory_order_relaxed);
+    }
+    if(tracking.load(std::memory_order_relaxed))
+    {
+        heap_deallocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void set_allocation_tracking(bool on)
+{
+    tracking.store(on);
+}
+
+bool allocation_tracking_enabled()
+{
+    return tracking.load();
+}
+
+AllocationStats allocation_totals()
+{
+    AllocationStats ret;
+    ret.allocations = heap_allocations.load();
+    ret.deallocations = heap_deallocations.load();
+    ret.bytes = heap_bytes.load();
+    ret.peak_live_bytes = static_cast<std::uint64_t>(std::max<std::int64_t>(0, peak_bytes.load()));
+    return ret;
+}
+
+AllocationScope::AllocationScope() :
+    start(allocation_totals()), start_live(live_bytes.load())
+{
+    /* The peak of this scope starts from the current live bytes,
+     * the enclosing scope gets its own peak back at the end. */
+    outer_peak = peak_bytes.exchange(start_live);
+}
+
+AllocationScope::~AllocationScope()
+{
+    raise_peak(outer_peak);
+}
+
+AllocationStats AllocationScope::getStats() const
+{
+    const AllocationStats now = allocation_totals();
+
+    AllocationStats ret;
+    ret.allocations = now.allocations - start.allocations;
+    ret.deallocations = now.deallocations - start.deallocations;
+    ret.bytes = now.bytes - start.bytes;
+    ret.peak_live_bytes = static_cast<std::uint64_t>(
+        std::max<std::int64_t>(0, peak_bytes.load() - start_live));
+    return ret;
+}
+
+AllocationTrackingScope::AllocationTrackingScope(bool on) :
+    previous(on ? tracking.exchange(true) : tracking.load()) {}
+
+AllocationTrackingScope::~AllocationTrackingScope()
+{
+    tracking.store(previous);
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Allocation tracking is opt-in.", "[allocation]")
+{
+    /* The test runner links allocationhooks.cpp. */
+    REQUIRE(allocation_counting_linked());
+
+    const bool was_tracking = allocation_tracking_enabled();
+    set_allocation_tracking(false);
+    {
+        AllocationScope scope;
+        std::unique_ptr<int> p{new int{1}};
+        CHECK(scope.getStats().allocations == 0);
+    }
+
+    {
+        AllocationTrackingScope tracking_scope;
+        CHECK(allocation_tracking_enabled());
+
+        AllocationScope outer;
+        std::unique_ptr<std::vector<char>> big{new std::vector<char>(100000)};
+        big.reset();
+        {
+            AllocationScope inner;
+            std::vector<char> small(1000);
+            const AllocationStats stats = inner.getStats();
+            CHECK(stats.allocations == 1);
+            CHECK(stats.bytes == 1000);
+            CHECK(stats.deallocations == 0);
+            CHECK(stats.peak_live_bytes == 1000);
+        }
+
+        /* Other threads are counted too. */
+        std::thread t{[]{ std::vector<int> v(10); }};
+        t.join();
+
+        const AllocationStats stats = outer.getStats();
+        CHECK(stats.allocations >= 4);
+        CHECK(stats.deallocations >= 4);
+        CHECK(stats.bytes >= 100000 + 1000 + 10 * sizeof(int));
+        CHECK(stats.peak_live_bytes >= 100000);
+    }
+    CHECK(!allocation_tracking_enabled());
+
+    /* Blocks allocated while tracking was off do not lower the live
+     * bytes when freed while it is on. */
+    std::unique_ptr<std::vector<char>> untracked{new std::vector<char>(50000)};
+    {
+        AllocationTrackingScope tracking_scope;
+        AllocationScope outer;
+        untracked.reset();
+        {
+            std::vector<char> small(1000);
+        }
+        const AllocationStats stats = outer.getStats();
+        CHECK(stats.peak_live_bytes == 1000);
+    }
+
+    /* Products allocate their result. */
+    ConcreteSquareMatrix a{"[[1,2,3,4,5][1,2,3,4,5][1,2,3,4,5][1,2,3,4,5][1,2,3,4,5]]"};
+    set_allocation_tracking(true);
+    AllocationScope scope;
+    const ConcreteSquareMatrix b = a * a;
+    CHECK(scope.getStats().allocations > 0);
+    set_allocation_tracking(was_tracking);
+}
+
+#endif // SQM_TESTS
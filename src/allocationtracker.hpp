@@ -0,0 +1,123 @@
+/** \file allocationtracker.hpp
+ *  \brief Opt-in accounting of heap allocations. Programs that link
+ *         allocationhooks.cpp get a global operator new and delete that
+ *         count while tracking is on, otherwise the cost is one relaxed
+ *         atomic load. In other programs nothing is counted.
+ */
+
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/** \struct AllocationStats
+ *  \brief Heap activity of a period.
+ */
+struct AllocationStats
+{
+    /** \brief Calls of operator new. */
+    std::uint64_t allocations = 0;
+    /** \brief Calls of operator delete. */
+    std::uint64_t deallocations = 0;
+    /** \brief Bytes requested from operator new. */
+    std::uint64_t bytes = 0;
+    /** \brief Highest number of live heap bytes above the start of the
+     *         period. Counts the requested bytes of blocks allocated
+     *         while tracking is on. */
+    std::uint64_t peak_live_bytes = 0;
+};
+
+/** \brief Tells if the counting operator new and delete of
+ *         allocationhooks.cpp are linked into the program.
+ *  \return true if allocations can be counted.
+ */
+bool allocation_counting_linked();
+
+/** \brief Called by allocationhooks.cpp at startup.
+ */
+void register_allocation_counting();
+
+/** \brief Counts an allocation while tracking is on. Called by the
+ *         operator new of allocationhooks.cpp.
+ *  \param size Requested size.
+ *  \return true if the allocation was counted.
+ */
+bool record_allocation(std::size_t size);
+
+/** \brief Counts a deallocation while tracking is on, and takes a counted
+ *         block off the live bytes whether tracking is on or not. Called
+ *         by the operator delete of allocationhooks.cpp.
+ *  \param size Requested size of the block.
+ *  \param counted What record_allocation() returned for the block.
+ */
+void record_deallocation(std::size_t size, bool counted);
+
+/** \brief Turns allocation tracking on or off for all threads.
+ *  \param on true to count allocations.
+ */
+void set_allocation_tracking(bool on);
+
+/** \brief Tells if allocations are counted.
+ *  \return true if tracking is on.
+ */
+bool allocation_tracking_enabled();
+
+/** \brief Counts of all tracked allocations since the start.
+ *  \return Totals, peak_live_bytes being the highest live bytes seen.
+ */
+AllocationStats allocation_totals();
+
+/** \class AllocationScope
+ *  \brief Measures the heap activity of all threads from its construction.
+ *         Scopes may nest. Only activity while tracking is on is counted.
+ */
+class AllocationScope
+{
+    public:
+        /** \brief Starts the period.
+         */
+        AllocationScope();
+
+        /** \brief Ends the period.
+         */
+        ~AllocationScope();
+
+        AllocationScope(const AllocationScope&) = delete;
+        AllocationScope& operator=(const AllocationScope&) = delete;
+
+        /** \brief Get the heap activity since construction.
+         *  \return Statistics of the period so far.
+         */
+        AllocationStats getStats() const;
+
+    private:
+        AllocationStats start;
+        std::int64_t start_live;
+        std::int64_t outer_peak;
+};
+
+/** \class AllocationTrackingScope
+ *  \brief Turns allocation tracking on until the end of the scope, then
+ *         restores the previous setting.
+ */
+class AllocationTrackingScope
+{
+    public:
+        /** \brief Turns tracking on.
+         *  \param on false to leave the setting as it is.
+         */
+        explicit AllocationTrackingScope(bool on = true);
+
+        /** \brief Restores the previous setting.
+         */
+        ~AllocationTrackingScope();
+
+        AllocationTrackingScope(const AllocationTrackingScope&) = delete;
+        AllocationTrackingScope& operator=(const AllocationTrackingScope&) = delete;
+
+    private:
+        bool previous;
+};
+
+#endif // ALLOCATIONTRACKER_H
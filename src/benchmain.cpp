@@ -0,0 +1,231 @@
+/** \file benchmain.cpp
+ *  \brief Benchmark runner main file.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "benchmark.hpp"
+#include "benchmarkbaseline.hpp"
+#include "threadconfig.hpp"
+
+static const char* const usage =
+    "Usage: sqm-bench [options]\n"
+    "  --json FILE          Write results as JSON to FILE, - for stdout.\n"
+    "  --sizes N,N,...      Row sizes, default 2,4,...,8192.\n"
+    "  --ops NAME,...       Operations, default all:\n"
+    "                       parse,toString,transpose,+,-,*,/,symbolic,composite\n"
+    "  --repetitions R      Timed repetitions per case, default 5.\n"
+    "  --min-time S         Minimum seconds per repetition, default 0.02.\n"
+    "  --max-elements E     Skip matrices of more elements, default 1048576.\n"
+    "  --max-work W         Skip cases of more element operations, default 2e9.\n"
+    "  --threads N,N,...    Thread counts to run every case with, default\n"
+    "                       SQM_THREADS or the CPUs available.\n"
+    "  --perf               Count hardware events (cycles, instructions, cache,\n"
+    "                       branch and TLB misses) per operation.\n"
+    "  --baseline DIR       Compare to the baseline of this machine profile in\n"
+    "                       DIR and fail on regressions. A missing baseline is\n"
+    "                       recorded.\n"
+    "  --update-baseline    Record the results in the baseline.\n"
+    "  --threshold T        Slowdown ratio that fails, default 1.5.\n"
+    "  --profile NAME       Machine profile, default from the system or\n"
+    "                       SQM_BENCH_PROFILE.\n";
+
+static std::vector<std::string> split(const std::string& str)
+{
+    std::vector<std::string> ret;
+    std::istringstream ss{str};
+    std::string item;
+    while(std::getline(ss, item, ',')) ret.push_back(item);
+    return ret;
+}
+
+static double to_number(const std::string& str)
+{
+    char* end = nullptr;
+    const double v = std::strtod(str.c_str(), &end);
+    if(str.empty() || *end != '\0' || v < 0)
+    {
+        throw std::invalid_argument("Invalid number " + str + ".");
+    }
+    return v;
+}
+
+/** \brief Runs the benchmark suite, see usage.
+ *  \return 0 if success, else non-zero.
+ */
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    const char* json = nullptr;
+    const char* baseline_dir = nullptr;
+    bool update_baseline = false;
+    double threshold = default_regression_threshold;
+    std::string profile;
+
+    try
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string arg{argv[i]};
+            if(arg == "--help" || arg == "-h")
+            {
+                std::cout << usage;
+                return 0;
+            }
+            if(arg == "--update-baseline")
+            {
+                update_baseline = true;
+                continue;
+            }
+            if(arg == "--perf")
+            {
+                options.perf_counters = true;
+                continue;
+            }
+            if(i + 1 == argc)
+            {
+                throw std::invalid_argument("Missing value for " + arg + ".");
+            }
+
+            const std::string value{argv[++i]};
+            if(arg == "--json")
+            {
+                json = argv[i];
+            }
+            else if(arg == "--sizes")
+            {
+                options.sizes.clear();
+                for(const auto& n : split(value))
+                {
+                    options.sizes.push_back(static_cast<unsigned int>(to_number(n)));
+                }
+            }
+            else if(arg == "--threads")
+            {
+                options.threads.clear();
+                for(const auto& t : split(value))
+                {
+                    const double count = to_number(t);
+                    if(count < 1 || count > max_thread_count)
+                    {
+                        throw std::invalid_argument("Invalid thread count " + t + ".");
+                    }
+                    options.threads.push_back(static_cast<unsigned int>(count));
+                }
+            }
+            else if(arg == "--ops")
+            {
+                options.ops = split(value);
+            }
+            else if(arg == "--repetitions")
+            {
+                options.repetitions = static_cast<unsigned int>(to_number(value));
+            }
+            else if(arg == "--min-time")
+            {
+                options.min_seconds = to_number(value);
+            }
+            else if(arg == "--max-elements")
+            {
+                options.max_elements = static_cast<std::uint64_t>(to_number(value));
+            }
+            else if(arg == "--max-work")
+            {
+                options.max_work = to_number(value);
+            }
+            else if(arg == "--baseline")
+            {
+                baseline_dir = argv[i];
+            }
+            else if(arg == "--threshold")
+            {
+                threshold = to_number(value);
+                if(threshold <= 1.0)
+                {
+                    throw std::invalid_argument("Threshold must be above 1.");
+                }
+            }
+            else if(arg == "--profile")
+            {
+                profile = value;
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown argument " + arg + ".");
+            }
+        }
+
+        if(baseline_dir != nullptr && !options.threads.empty())
+        {
+            throw std::invalid_argument("--threads cannot be used with --baseline.");
+        }
+
+        /* The table goes to stderr when stdout has the JSON. */
+        const bool json_stdout = json != nullptr && std::strcmp(json, "-") == 0;
+        const std::vector<BenchmarkResult> results =
+            run_benchmarks(options, json_stdout ? &std::cerr : &std::cout);
+
+        if(json_stdout)
+        {
+            write_benchmark_json(std::cout, results);
+        }
+        else if(json != nullptr)
+        {
+            std::ofstream os{json};
+            write_benchmark_json(os, results);
+            if(!os)
+            {
+                throw std::runtime_error("Could not write " + std::string{json} + ".");
+            }
+        }
+
+        if(baseline_dir != nullptr)
+        {
+            if(profile.empty()) profile = machine_profile();
+            const std::string path = std::string{baseline_dir} + "/" + profile + ".baseline";
+            const std::vector<BaselineEntry> current = to_baseline(results);
+
+            std::vector<BaselineEntry> baseline;
+            if(!load_baseline(path, baseline))
+            {
+                save_baseline(path, current);
+                std::cerr << "No baseline for profile " << profile
+                          << ", recorded " << path << "." << std::endl;
+                return 0;
+            }
+
+            const std::vector<BaselineComparison> cmp =
+                compare_to_baseline(baseline, current, threshold);
+            print_comparison(std::cerr, cmp);
+
+            if(update_baseline)
+            {
+                merge_baseline(baseline, current);
+                save_baseline(path, baseline);
+            }
+
+            const auto regressions = std::count_if(cmp.begin(), cmp.end(),
+                [](const BaselineComparison& c) { return c.regression; });
+            if(regressions > 0)
+            {
+                std::cerr << regressions << " case(s) slower than " << threshold
+                          << " times the baseline of " << profile << "." << std::endl;
+                return 2;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << e.what() << std::endl << usage;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+/** \file benchmark.cpp
+ *  \brief Benchmark suite implementation file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include "allocationtracker.hpp"
+#include "benchmark.hpp"
+#include "compositesquarematrix.hpp"
+#include "squarematrix.hpp"
+#include "threadconfig.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+double BenchmarkResult::nsPerElement() const
+{
+    return n == 0 ? 0.0 : ns_per_op / (static_cast<double>(n) * n);
+}
+
+double BenchmarkResult::gigaOpsPerSecond() const
+{
+    return ns_per_op <= 0.0 ? 0.0 : work / ns_per_op;
+}
+
+double median(std::vector<double> values)
+{
+    const std::size_t mid = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + mid, values.end());
+    if(values.size() % 2 == 1) return values[mid];
+
+    const double upper = values[mid];
+    return (*std::max_element(values.begin(), values.begin() + mid) + upper) / 2;
+}
+
+/* A case makes its inputs for row size n and returns the operation. */
+struct BenchmarkCase
+{
+    std::string name;
+    unsigned int work_exponent;
+    std::function<std::function<void()>(unsigned int n)> setup;
+};
+
+using MatrixOp = std::function<ConcreteSquareMatrix(
+    const ConcreteSquareMatrix&, const ConcreteSquareMatrix&)>;
+
+/* Case for a binary operation of two random matrices. */
+static BenchmarkCase binary_case(const std::string& name, unsigned int work_exponent,
+                                 const MatrixOp& op)
+{
+    return BenchmarkCase{name, work_exponent, [op](unsigned int n)
+    {
+        std::shared_ptr<ConcreteSquareMatrix> a{new ConcreteSquareMatrix{static_cast<int>(n)}};
+        std::shared_ptr<ConcreteSquareMatrix> b{new ConcreteSquareMatrix{static_cast<int>(n)}};
+        return std::function<void()>{[a, b, op]() { op(*a, *b); }};
+    }};
+}
+
+/* Matrix string with every third element a variable from a to e. */
+static std::string symbolic_string(unsigned int n)
+{
+    std::string str{"["};
+    for(unsigned int i = 0; i < n; i++)
+    {
+        str += '[';
+        for(unsigned int j = 0; j < n; j++)
+        {
+            if(j > 0) str += ',';
+            if((i + j) % 3 == 0) str += static_cast<char>('a' + (i + j) % 5);
+            else str += std::to_string(static_cast<int>(i * j % 199) - 99);
+        }
+        str += ']';
+    }
+    return str + "]";
+}
+
+static const std::vector<BenchmarkCase>& benchmark_cases()
+{
+    static const std::vector<BenchmarkCase> cases{
+        {"parse", 2, [](unsigned int n)
+        {
+            const std::string str = ConcreteSquareMatrix{static_cast<int>(n)}.toString();
+            return std::function<void()>{[str]() { ConcreteSquareMatrix m{str}; }};
+        }},
+        {"toString", 2, [](unsigned int n)
+        {
+            std::shared_ptr<ConcreteSquareMatrix> m{new ConcreteSquareMatrix{static_cast<int>(n)}};
+            return std::function<void()>{[m]() { m->toString(); }};
+        }},
+        {"transpose", 2, [](unsigned int n)
+        {
+            std::shared_ptr<ConcreteSquareMatrix> m{new ConcreteSquareMatrix{static_cast<int>(n)}};
+            return std::function<void()>{[m]() { m->transpose(); }};
+        }},
+        binary_case("+", 2, [](const ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+                    { return a + b; }),
+        binary_case("-", 2, [](const ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+                    { return a - b; }),
+        binary_case("*", 3, [](const ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+                    { return a * b; }),
+        binary_case("/", 3, [](const ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+                    { return a / b; }),
+        {"symbolic", 2, [](unsigned int n)
+        {
+            std::shared_ptr<SymbolicSquareMatrix> m{new SymbolicSquareMatrix{symbolic_string(n)}};
+            const Valuation val{{'a', 1}, {'b', 2}, {'c', 3}, {'d', 4}, {'e', 5}};
+            return std::function<void()>{[m, val]() { m->evaluate(val); }};
+        }},
+        {"composite", 2, [](unsigned int n)
+        {
+            std::shared_ptr<CompositeSquareMatrix> m{new CompositeSquareMatrix{
+                ConcreteSquareMatrix{static_cast<int>(n)},
+                ConcreteSquareMatrix{static_cast<int>(n)},
+                [](const ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+                {
+                    return a + b;
+                },
+                '+'}};
+            return std::function<void()>{[m]() { m->evaluate(Valuation{}); }};
+        }}};
+
+    return cases;
+}
+
+const std::vector<std::string>& benchmark_names()
+{
+    static const std::vector<std::string> names = []()
+    {
+        std::vector<std::string> ret;
+        for(const auto& c : benchmark_cases()) ret.push_back(c.name);
+        return ret;
+    }();
+
+    return names;
+}
+
+/* Element operations of one run, 2 * n^3 for products. */
+static double case_work(const BenchmarkCase& c, unsigned int n)
+{
+    const double n2 = static_cast<double>(n) * n;
+    return c.work_exponent == 3 ? 2.0 * n2 * n : n2;
+}
+
+static BenchmarkResult run_case(const BenchmarkCase& c, unsigned int n,
+                                const BenchmarkOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+
+    BenchmarkResult res;
+    res.name = c.name;
+    res.n = n;
+    res.threads = thread_count();
+    res.work = case_work(c, n);
+
+    const std::function<void()> op = c.setup(n);
+
+    /* Warm up, then time one run to count allocations and to pick
+     * the number of runs per repetition. */
+    op();
+    std::chrono::duration<double> first;
+    {
+        AllocationTrackingScope tracking;
+        AllocationScope allocations;
+        const auto start = clock::now();
+        op();
+        first = clock::now() - start;
+
+        const AllocationStats stats = allocations.getStats();
+        res.allocations = static_cast<double>(stats.allocations);
+        res.allocated_bytes = static_cast<double>(stats.bytes);
+        res.peak_live_bytes = static_cast<double>(stats.peak_live_bytes);
+    }
+
+    res.runs = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+        std::ceil(options.min_seconds / std::max(first.count(), 1e-9))));
+
+    for(unsigned int r = 0; r < std::max(options.repetitions, 1u); r++)
+    {
+        const auto rep_start = clock::now();
+        for(std::uint64_t i = 0; i < res.runs; i++) op();
+        const std::chrono::duration<double, std::nano> elapsed = clock::now() - rep_start;
+        res.samples.push_back(elapsed.count() / res.runs);
+    }
+
+    res.ns_per_op = median(res.samples);
+
+    /* Counted apart from the timed repetitions, so opening and reading
+     * the counters is not in the samples. */
+    if(options.perf_counters)
+    {
+        PerfCounters counters;
+        counters.start();
+        for(std::uint64_t i = 0; i < res.runs; i++) op();
+        res.counters = counters.stop();
+        res.counters /= static_cast<double>(res.runs);
+    }
+
+    return res;
+}
+
+static void log_result(std::ostream& log, const BenchmarkResult& r,
+                       const BenchmarkOptions& options)
+{
+    std::ostringstream ss;
+    ss << std::left << std::setw(10) << r.name << std::right
+       << std::setw(6) << r.n << std::setw(4) << r.threads << " thr"
+       << std::fixed << std::setprecision(1)
+       << std::setw(16) << r.ns_per_op << " ns/op"
+       << std::setprecision(2) << std::setw(10) << r.nsPerElement() << " ns/element"
+       << std::setprecision(3) << std::setw(9) << r.gigaOpsPerSecond() << " Gop/s"
+       << std::setprecision(1) << std::setw(12) << r.allocations << " allocs/op";
+    if(options.perf_counters)
+    {
+        ss << "  " << format_perf_counts(r.counters);
+    }
+    log << ss.str() << "\n" << std::flush;
+}
+
+std::vector<BenchmarkResult> run_benchmarks(const BenchmarkOptions& options,
+                                            std::ostream* log)
+{
+    for(const auto& name : options.ops)
+    {
+        const auto& names = benchmark_names();
+        if(std::find(names.begin(), names.end(), name) == names.end())
+        {
+            throw std::invalid_argument("Unknown benchmark " + name + ".");
+        }
+    }
+
+    const unsigned int previous_threads = thread_count();
+    std::vector<unsigned int> sweep = options.threads;
+    if(sweep.empty()) sweep.push_back(previous_threads);
+
+    std::vector<BenchmarkResult> results;
+    for(const auto& c : benchmark_cases())
+    {
+        if(!options.ops.empty() &&
+           std::find(options.ops.begin(), options.ops.end(), c.name) == options.ops.end())
+        {
+            continue;
+        }
+
+        for(unsigned int n : options.sizes)
+        {
+            if(static_cast<std::uint64_t>(n) * n > options.max_elements ||
+               case_work(c, n) > options.max_work)
+            {
+                continue;
+            }
+
+            for(unsigned int t : sweep)
+            {
+                if(t != thread_count()) set_thread_count(t);
+                results.push_back(run_case(c, n, options));
+                if(log != nullptr) log_result(*log, results.back(), options);
+            }
+        }
+    }
+
+    if(thread_count() != previous_threads) set_thread_count(previous_threads);
+
+    return results;
+}
+
+static std::string json_string(const std::string& str)
+{
+    std::string ret{"\""};
+    for(char c : str)
+    {
+        if(c == '"' || c == '\\')
+        {
+            ret += '\\';
+            ret += c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            ret += buf;
+        }
+        else
+        {
+            ret += c;
+        }
+    }
+    return ret + "\"";
+}
+
+void write_benchmark_json(std::ostream& os, const std::vector<BenchmarkResult>& results)
+{
+    char date[32] = "";
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+#ifdef __VERSION__
+    const std::string compiler{__VERSION__};
+#else
+    const std::string compiler{"unknown"};
+#endif
+#ifdef NDEBUG
+    const std::string build{"release"};
+#else
+    const std::string build{"debug"};
+#endif
+
+    std::ostringstream ss;
+    ss << std::setprecision(10);
+    ss << "{\n  \"context\": {\n"
+       << "    \"date\": " << json_string(date) << ",\n"
+       << "    \"compiler\": " << json_string(compiler) << ",\n"
+       << "    \"build\": " << json_string(build) << ",\n"
+       << "    \"hardware_threads\": " << hardware_threads() << ",\n"
+       << "    \"available_cpus\": " << available_cpus() << "\n"
+       << "  },\n  \"benchmarks\": [";
+
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& r = results[i];
+        ss << (i == 0 ? "\n" : ",\n")
+           << "    {\"name\": " << json_string(r.name)
+           << ", \"n\": " << r.n
+           << ", \"threads\": " << r.threads
+           << ", \"runs\": " << r.runs
+           << ", \"ns_per_op\": " << r.ns_per_op
+           << ", \"ns_per_element\": " << r.nsPerElement()
+           << ", \"gflops\": " << r.gigaOpsPerSecond()
+           << ", \"allocations_per_op\": " << r.allocations
+           << ", \"bytes_per_op\": " << r.allocated_bytes
+           << ", \"peak_live_bytes\": " << r.peak_live_bytes
+           << ", \"counters\": {";
+        bool first = true;
+        for(std::size_t e = 0; e < perf_event_count; e++)
+        {
+            if(!r.counters.valid[e]) continue;
+            ss << (first ? "" : ", ") << json_string(perf_event_name(static_cast<PerfEvent>(e)))
+               << ": " << r.counters.values[e];
+            first = false;
+        }
+        ss << "}"
+           << ", \"samples_ns\": [";
+        for(std::size_t s = 0; s < r.samples.size(); s++)
+        {
+            ss << (s == 0 ? "" : ", ") << r.samples[s];
+        }
+        ss << "]}";
+    }
+
+    ss << "\n  ]\n}\n";
+    os << ss.str();
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Benchmark suite.", "[benchmark]")
+{
+    CHECK(median({3.0}) == 3.0);
+    CHECK(median({5.0, 1.0, 3.0}) == 3.0);
+    CHECK(median({4.0, 1.0, 2.0, 3.0}) == 2.5);
+
+    BenchmarkOptions options;
+    options.sizes = {2, 16, 64};
+    options.ops = {"+", "*", "symbolic"};
+    options.repetitions = 2;
+    options.min_seconds = 0.0;
+    options.max_work = 2.0 * 16 * 16 * 16;
+
+    const std::vector<BenchmarkResult> results = run_benchmarks(options);
+    REQUIRE(results.size() == 8);
+    CHECK(results[0].name == "+");
+    CHECK(results[3].name == "*");
+    CHECK(results[3].n == 2);
+    CHECK(results[4].work == 2.0 * 16 * 16 * 16);
+    CHECK(results[7].name == "symbolic");
+    CHECK(results[7].n == 64);
+
+    for(const auto& r : results)
+    {
+        CHECK(r.samples.size() == 2);
+        CHECK(r.ns_per_op > 0.0);
+        CHECK(r.runs == 1);
+        CHECK(r.allocations > 0.0);
+    }
+
+    std::ostringstream os;
+    write_benchmark_json(os, results);
+    const std::string json = os.str();
+    CHECK(json.find("\"benchmarks\": [\n    {\"name\": \"+\", \"n\": 2,") != std::string::npos);
+    CHECK(json.find("\"name\": \"symbolic\", \"n\": 64") != std::string::npos);
+    CHECK(json.back() == '\n');
+
+    /* Counters may be unavailable, but the output stays valid. */
+    options.sizes = {16};
+    options.ops = {"+"};
+    options.perf_counters = true;
+    std::ostringstream log;
+    const std::vector<BenchmarkResult> counted = run_benchmarks(options, &log);
+    REQUIRE(counted.size() == 1);
+    CHECK(log.str().find(format_perf_counts(counted[0].counters)) != std::string::npos);
+    std::ostringstream counted_json;
+    write_benchmark_json(counted_json, counted);
+    CHECK(counted_json.str().find("\"counters\": {") != std::string::npos);
+
+    /* Thread sweep, the thread count is restored after it. */
+    const unsigned int threads = thread_count();
+    options.perf_counters = false;
+    options.threads = {1, 2};
+    const std::vector<BenchmarkResult> swept = run_benchmarks(options);
+    REQUIRE(swept.size() == 2);
+    CHECK(swept[0].threads == 1);
+    CHECK(swept[1].threads == 2);
+    CHECK(thread_count() == threads);
+
+    options.ops = {"nope"};
+    CHECK_THROWS_AS(run_benchmarks(options), std::invalid_argument&);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,131 @@
+/** \file benchmark.hpp
+ *  \brief Benchmark suite of the matrix operations.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "perfcounters.hpp"
+
+/** \struct BenchmarkOptions
+ *  \brief What run_benchmarks() measures and for how long.
+ */
+struct BenchmarkOptions
+{
+    /** \brief Row sizes to run, 2 to 8192 by default. */
+    std::vector<unsigned int> sizes{2, 4, 8, 16, 32, 64, 128, 256, 512,
+                                    1024, 2048, 4096, 8192};
+
+    /** \brief Names of the operations to run, all if empty. */
+    std::vector<std::string> ops;
+
+    /** \brief Timed repetitions of each case. */
+    unsigned int repetitions = 5;
+
+    /** \brief Minimum time of one repetition, in seconds. */
+    double min_seconds = 0.02;
+
+    /** \brief Cases with more elements per matrix are skipped. */
+    std::uint64_t max_elements = 1 << 20;
+
+    /** \brief Cases whose one run does more element operations are
+     *         skipped, which keeps multiplication of large n in check. */
+    double max_work = 2e9;
+
+    /** \brief Thread counts to run every case with, the current
+     *         thread_count() if empty. */
+    std::vector<unsigned int> threads;
+
+    /** \brief Count hardware events in an extra repetition of each
+     *         case, see PerfCounters. */
+    bool perf_counters = false;
+};
+
+/** \struct BenchmarkResult
+ *  \brief Timing of one operation at one row size.
+ */
+struct BenchmarkResult
+{
+    /** \brief Operation name. */
+    std::string name;
+
+    /** \brief Row size. */
+    unsigned int n = 0;
+
+    /** \brief Number of threads the operations may use. */
+    unsigned int threads = 0;
+
+    /** \brief Runs per repetition. */
+    std::uint64_t runs = 0;
+
+    /** \brief Nanoseconds per run of each repetition. */
+    std::vector<double> samples;
+
+    /** \brief Median of samples. */
+    double ns_per_op = 0.0;
+
+    /** \brief Element operations in one run: n * n, or 2 * n^3 for
+     *         products. */
+    double work = 0.0;
+
+    /** \brief Heap allocations per run. */
+    double allocations = 0.0;
+
+    /** \brief Bytes allocated from the heap per run. */
+    double allocated_bytes = 0.0;
+
+    /** \brief Highest live heap bytes during one run, see
+     *         AllocationStats::peak_live_bytes. */
+    double peak_live_bytes = 0.0;
+
+    /** \brief Hardware events per run, if BenchmarkOptions::perf_counters
+     *         was set and the counters are available. */
+    PerfCounts counters;
+
+    /** \brief Nanoseconds per element of the result.
+     *  \return ns_per_op / (n * n).
+     */
+    double nsPerElement() const;
+
+    /** \brief Throughput in billions of element operations per second,
+     *         GFLOP/s for the products.
+     *  \return work / ns_per_op.
+     */
+    double gigaOpsPerSecond() const;
+};
+
+/** \brief Names of the operations in the suite.
+ *  \return "parse", "toString", "transpose", "+", "-", "*", "/",
+ *          "symbolic" and "composite".
+ */
+const std::vector<std::string>& benchmark_names();
+
+/** \brief Runs the suite.
+ *  \param options What to run.
+ *  \param log If not null, a line is written here for every case
+ *         as it finishes.
+ *  \return Results of the cases that were run.
+ *  \throw std::invalid_argument if options name an unknown operation.
+ */
+std::vector<BenchmarkResult> run_benchmarks(const BenchmarkOptions& options,
+                                            std::ostream* log = nullptr);
+
+/** \brief Median of values.
+ *  \param values Values, not empty.
+ *  \return Median.
+ */
+double median(std::vector<double> values);
+
+/** \brief Writes results as a JSON document with a "context" object and
+ *         a "benchmarks" array.
+ *  \param os Stream to write to.
+ *  \param results Results to write.
+ */
+void write_benchmark_json(std::ostream& os, const std::vector<BenchmarkResult>& results);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,297 @@
+/** \file benchmarkbaseline.cpp
+ *  \brief Benchmark baseline implementation file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include "benchmarkbaseline.hpp"
+#include "threadconfig.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+static const char* const baseline_header = "# sqm-bench baseline";
+
+void median_confidence_interval(std::vector<double> samples, double& low, double& high)
+{
+    std::sort(samples.begin(), samples.end());
+
+    /* Ranks from 1 of the order statistics bounding the median. */
+    const double r = static_cast<double>(samples.size());
+    const double spread = 0.98 * std::sqrt(r);
+    const double lo_rank = std::max(1.0, std::floor(r / 2 - spread));
+    const double hi_rank = std::min(r, std::ceil(1 + r / 2 + spread));
+
+    low = samples[static_cast<std::size_t>(lo_rank) - 1];
+    high = samples[static_cast<std::size_t>(hi_rank) - 1];
+}
+
+/* Replaces characters that do not belong in file names with '-'. */
+static std::string sanitize(const std::string& str)
+{
+    std::string ret;
+    for(char c : str)
+    {
+        const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                        (c >= '0' && c <= '9') || c == '.' || c == '_';
+        if(ok) ret += c;
+        else if(!ret.empty() && ret.back() != '-') ret += '-';
+    }
+    while(!ret.empty() && ret.back() == '-') ret.pop_back();
+    return ret;
+}
+
+static std::string cpu_model()
+{
+#ifdef __linux__
+    std::ifstream is{"/proc/cpuinfo"};
+    std::string line;
+    while(std::getline(is, line))
+    {
+        if(line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+        {
+            return line.substr(line.find(':') + 1);
+        }
+    }
+#endif
+    return "unknown-cpu";
+}
+
+std::string machine_profile()
+{
+    const char* env = std::getenv("SQM_BENCH_PROFILE");
+    if(env != nullptr && *env != '\0') return sanitize(env);
+
+#ifdef __VERSION__
+    std::string compiler{__VERSION__};
+#else
+    std::string compiler{"unknown"};
+#endif
+    compiler = sanitize(compiler).substr(0, 32);
+
+#ifdef NDEBUG
+    const std::string build{"release"};
+#else
+    const std::string build{"debug"};
+#endif
+
+    return sanitize(cpu_model()) + "-t" + std::to_string(thread_count()) +
+           "-cc" + compiler + "-" + build;
+}
+
+std::vector<BaselineEntry> to_baseline(const std::vector<BenchmarkResult>& results)
+{
+    std::vector<BaselineEntry> ret;
+    for(const auto& r : results)
+    {
+        BaselineEntry e;
+        e.name = r.name;
+        e.n = r.n;
+        e.median_ns = r.ns_per_op;
+        median_confidence_interval(r.samples, e.low_ns, e.high_ns);
+        ret.push_back(e);
+    }
+    return ret;
+}
+
+bool load_baseline(const std::string& path, std::vector<BaselineEntry>& entries)
+{
+    std::ifstream is{path};
+    if(!is) return false;
+
+    std::string line;
+    if(!std::getline(is, line) ||
+       line.compare(0, std::strlen(baseline_header), baseline_header) != 0)
+    {
+        throw std::invalid_argument("Not a benchmark baseline file.");
+    }
+
+    entries.clear();
+    while(std::getline(is, line))
+    {
+        if(line.empty() || line[0] == '#') continue;
+
+        std::istringstream ss{line};
+        BaselineEntry e;
+        if(!(ss >> e.name >> e.n >> e.median_ns >> e.low_ns >> e.high_ns))
+        {
+            throw std::invalid_argument("Invalid baseline line \"" + line + "\".");
+        }
+        entries.push_back(e);
+    }
+
+    return true;
+}
+
+void save_baseline(const std::string& path, const std::vector<BaselineEntry>& entries)
+{
+    std::ostringstream ss;
+    ss << std::setprecision(10);
+    ss << baseline_header << "\n# name n median_ns low_ns high_ns\n";
+    for(const auto& e : entries)
+    {
+        ss << e.name << ' ' << e.n << ' ' << e.median_ns << ' '
+           << e.low_ns << ' ' << e.high_ns << '\n';
+    }
+
+    std::ofstream os{path, std::ios::trunc};
+    os << ss.str();
+    os.close();
+    if(!os)
+    {
+        throw std::runtime_error("Could not write baseline " + path + ".");
+    }
+}
+
+static bool same_case(const BaselineEntry& a, const BaselineEntry& b)
+{
+    return a.name == b.name && a.n == b.n;
+}
+
+void merge_baseline(std::vector<BaselineEntry>& entries,
+                    const std::vector<BaselineEntry>& update)
+{
+    for(const auto& u : update)
+    {
+        auto it = std::find_if(entries.begin(), entries.end(),
+            [&u](const BaselineEntry& e) { return same_case(e, u); });
+
+        if(it != entries.end()) *it = u;
+        else entries.push_back(u);
+    }
+}
+
+std::vector<BaselineComparison> compare_to_baseline(
+    const std::vector<BaselineEntry>& baseline,
+    const std::vector<BaselineEntry>& current, double threshold)
+{
+    std::vector<BaselineComparison> ret;
+    for(const auto& c : current)
+    {
+        auto it = std::find_if(baseline.begin(), baseline.end(),
+            [&c](const BaselineEntry& e) { return same_case(e, c); });
+        if(it == baseline.end()) continue;
+
+        BaselineComparison cmp;
+        cmp.baseline = *it;
+        cmp.current = c;
+        cmp.ratio = it->median_ns > 0.0 ? c.median_ns / it->median_ns
+                                        : std::numeric_limits<double>::infinity();
+        cmp.regression = c.median_ns > threshold * it->median_ns &&
+                         c.low_ns > threshold * it->high_ns;
+        ret.push_back(cmp);
+    }
+    return ret;
+}
+
+void print_comparison(std::ostream& os, const std::vector<BaselineComparison>& comparisons)
+{
+    std::ostringstream ss;
+    ss << std::left << std::setw(10) << "op" << std::right << std::setw(6) << "n"
+       << std::setw(16) << "baseline ns" << std::setw(16) << "current ns"
+       << std::setw(9) << "ratio" << "\n";
+
+    for(const auto& c : comparisons)
+    {
+        ss << std::left << std::setw(10) << c.current.name << std::right
+           << std::setw(6) << c.current.n << std::fixed << std::setprecision(1)
+           << std::setw(16) << c.baseline.median_ns
+           << std::setw(16) << c.current.median_ns
+           << std::setprecision(2) << std::setw(9) << c.ratio
+           << (c.regression ? "  REGRESSION" : "") << "\n";
+    }
+
+    os << ss.str();
+}
+
+#ifdef SQM_TESTS
+
+static BaselineEntry make_entry(const std::string& name, unsigned int n,
+                                double median_ns, double low_ns, double high_ns)
+{
+    BaselineEntry e;
+    e.name = name;
+    e.n = n;
+    e.median_ns = median_ns;
+    e.low_ns = low_ns;
+    e.high_ns = high_ns;
+    return e;
+}
+
+TEST_CASE("Benchmark baselines.", "[benchmark][baseline]")
+{
+    double low = 0.0;
+    double high = 0.0;
+    median_confidence_interval({5.0, 1.0, 3.0}, low, high);
+    CHECK(low == 1.0);
+    CHECK(high == 5.0);
+
+    std::vector<double> samples;
+    for(int i = 20; i > 0; i--) samples.push_back(i);
+    median_confidence_interval(samples, low, high);
+    CHECK(low == 5.0);
+    CHECK(high == 16.0);
+
+    const std::string profile = machine_profile();
+    CHECK(!profile.empty());
+    CHECK(profile.find_first_of(" /\\:") == std::string::npos);
+
+    BenchmarkResult r;
+    r.name = "*";
+    r.n = 64;
+    r.samples = {100.0, 90.0, 110.0};
+    r.ns_per_op = 100.0;
+
+    std::vector<BaselineEntry> baseline = to_baseline({r});
+    REQUIRE(baseline.size() == 1);
+    CHECK(baseline[0].low_ns == 90.0);
+    CHECK(baseline[0].high_ns == 110.0);
+
+    const BaselineEntry plus = make_entry("+", 16, 50.0, 40.0, 60.0);
+    merge_baseline(baseline, {plus});
+    CHECK(baseline.size() == 2);
+
+    const std::string path{"sqm_test_baseline.txt"};
+    save_baseline(path, baseline);
+    std::vector<BaselineEntry> loaded;
+    REQUIRE(load_baseline(path, loaded));
+    REQUIRE(loaded.size() == 2);
+    CHECK(loaded[1].name == "+");
+    CHECK(loaded[1].n == 16);
+    CHECK(loaded[1].high_ns == 60.0);
+    std::remove(path.c_str());
+    CHECK(!load_baseline(path, loaded));
+
+    /* Slower, but the intervals overlap. */
+    const BaselineEntry noisy = make_entry("*", 64, 200.0, 100.0, 300.0);
+    /* Clearly slower. */
+    const BaselineEntry slow = make_entry("+", 16, 500.0, 490.0, 510.0);
+    /* Not in the baseline. */
+    const BaselineEntry added = make_entry("-", 16, 1.0, 1.0, 1.0);
+
+    const std::vector<BaselineComparison> cmp =
+        compare_to_baseline(baseline, {noisy, slow, added}, 1.5);
+    REQUIRE(cmp.size() == 2);
+    CHECK(cmp[0].ratio == 2.0);
+    CHECK(!cmp[0].regression);
+    CHECK(cmp[1].ratio == 10.0);
+    CHECK(cmp[1].regression);
+
+    merge_baseline(baseline, {slow});
+    CHECK(baseline.size() == 2);
+    CHECK(baseline[1].median_ns == 500.0);
+
+    std::ostringstream os;
+    print_comparison(os, cmp);
+    CHECK(os.str().find("REGRESSION") != std::string::npos);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,112 @@
+/** \file benchmarkbaseline.hpp
+ *  \brief Stored benchmark baselines and regression checks against them.
+ */
+
+#ifndef BENCHMARKBASELINE_H
+#define BENCHMARKBASELINE_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "benchmark.hpp"
+
+/** \brief Default slowdown ratio past which a case is a regression.
+ */
+const double default_regression_threshold = 1.5;
+
+/** \struct BaselineEntry
+ *  \brief Stored timing of one case.
+ */
+struct BaselineEntry
+{
+    /** \brief Operation name. */
+    std::string name;
+    /** \brief Row size. */
+    unsigned int n = 0;
+    /** \brief Median nanoseconds per run. */
+    double median_ns = 0.0;
+    /** \brief Lower end of the confidence interval of the median. */
+    double low_ns = 0.0;
+    /** \brief Upper end of the confidence interval of the median. */
+    double high_ns = 0.0;
+};
+
+/** \struct BaselineComparison
+ *  \brief A case run now compared to its baseline.
+ */
+struct BaselineComparison
+{
+    /** \brief Stored timing. */
+    BaselineEntry baseline;
+    /** \brief Timing now. */
+    BaselineEntry current;
+    /** \brief current.median_ns / baseline.median_ns. */
+    double ratio = 1.0;
+    /** \brief true if the case got slower than allowed. */
+    bool regression = false;
+};
+
+/** \brief Distribution-free 95 % confidence interval of the median of
+ *         samples, from their order statistics. With ten samples or
+ *         fewer it spans all of them.
+ *  \param samples Samples, not empty.
+ *  \param low Set to the lower end.
+ *  \param high Set to the upper end.
+ */
+void median_confidence_interval(std::vector<double> samples, double& low, double& high);
+
+/** \brief Name of the machine profile baselines are stored under: the
+ *         CPU model, thread_count(), compiler and build type. The
+ *         SQM_BENCH_PROFILE environment variable overrides it.
+ *  \return Profile name of file name characters only.
+ */
+std::string machine_profile();
+
+/** \brief Turns results into baseline entries.
+ *  \param results Benchmark results.
+ *  \return An entry per result.
+ */
+std::vector<BaselineEntry> to_baseline(const std::vector<BenchmarkResult>& results);
+
+/** \brief Reads a baseline file.
+ *  \param path Path of the file.
+ *  \param entries Set to the entries of the file.
+ *  \return false if the file does not exist.
+ *  \throw std::invalid_argument if the file is not a valid baseline.
+ */
+bool load_baseline(const std::string& path, std::vector<BaselineEntry>& entries);
+
+/** \brief Writes a baseline file.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param entries Entries to write.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void save_baseline(const std::string& path, const std::vector<BaselineEntry>& entries);
+
+/** \brief Replaces or adds the entries of update in entries.
+ *  \param entries Entries to update.
+ *  \param update New entries.
+ */
+void merge_baseline(std::vector<BaselineEntry>& entries,
+                    const std::vector<BaselineEntry>& update);
+
+/** \brief Compares cases to their baselines. A case regressed if its
+ *         median is more than threshold times the baseline median and
+ *         the confidence intervals, scaled by threshold, do not overlap,
+ *         so noisy cases need clear evidence.
+ *  \param baseline Stored entries.
+ *  \param current Entries of this run.
+ *  \param threshold Allowed slowdown ratio, above 1.
+ *  \return A comparison for every current entry with a baseline.
+ */
+std::vector<BaselineComparison> compare_to_baseline(
+    const std::vector<BaselineEntry>& baseline,
+    const std::vector<BaselineEntry>& current, double threshold);
+
+/** \brief Writes comparisons as a table.
+ *  \param os Stream to write to.
+ *  \param comparisons Comparisons to write.
+ */
+void print_comparison(std::ostream& os, const std::vector<BaselineComparison>& comparisons);
+
+#endif // BENCHMARKBASELINE_H
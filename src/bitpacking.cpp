@@ -0,0 +1,216 @@
+/** \file bitpacking.cpp
+ *  \brief Bit-packing implementation file.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "bitpacking.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define SQM_HAVE_SSE2 1
+#endif
+
+/* Values per lane. */
+static const unsigned int lane_values = packed_block_size / 4;
+
+static inline std::uint32_t low_mask(unsigned int b)
+{
+    return b >= 32 ? 0xffffffffu : (1u << b) - 1;
+}
+
+std::size_t pack_block(const int* in, unsigned char* out)
+{
+    std::int32_t ref = in[0];
+    for(unsigned int i = 1; i < packed_block_size; i++)
+    {
+        if(in[i] < ref) ref = in[i];
+    }
+
+    /* Differences are taken modulo 2^32, so they never overflow. */
+    std::uint32_t any = 0;
+    for(unsigned int i = 0; i < packed_block_size; i++)
+    {
+        any |= static_cast<std::uint32_t>(in[i]) - static_cast<std::uint32_t>(ref);
+    }
+
+    std::uint32_t b = 0;
+    while(b < 32 && (any >> b) != 0) b++;
+
+    std::uint32_t words[4 * 32] = {0};
+    for(unsigned int i = 0; i < packed_block_size && b != 0; i++)
+    {
+        const std::uint32_t d =
+            static_cast<std::uint32_t>(in[i]) - static_cast<std::uint32_t>(ref);
+        const unsigned int lane = i % 4;
+        const unsigned int bit = (i / 4) * b;
+        const unsigned int k = bit / 32;
+        const unsigned int s = bit % 32;
+
+        words[k * 4 + lane] |= d << s;
+        if(s + b > 32) words[(k + 1) * 4 + lane] |= d >> (32 - s);
+    }
+
+    std::memcpy(out, &ref, 4);
+    std::memcpy(out + 4, &b, 4);
+    std::memcpy(out + 8, words, 16 * b);
+    return 8 + 16 * b;
+}
+
+std::size_t packed_block_bytes(const unsigned char* in)
+{
+    std::uint32_t b;
+    std::memcpy(&b, in + 4, 4);
+    return b > 32 ? 0 : 8 + 16 * b;
+}
+
+template <unsigned int B>
+static void unpack_scalar(const unsigned char* words, std::uint32_t ref, int* out)
+{
+    std::uint32_t w[4 * (B ? B : 1)];
+    std::memcpy(w, words, 16 * B);
+
+    for(unsigned int j = 0; j < lane_values; j++)
+    {
+        const unsigned int bit = j * B;
+        const unsigned int k = bit / 32;
+        const unsigned int s = bit % 32;
+
+        for(unsigned int lane = 0; lane < 4; lane++)
+        {
+            std::uint32_t x = 0;
+            if(B != 0)
+            {
+                x = w[k * 4 + lane] >> s;
+                if(s + B > 32) x |= w[(k + 1) * 4 + lane] << (32 - s);
+                x &= low_mask(B);
+            }
+            out[j * 4 + lane] = static_cast<std::int32_t>(x + ref);
+        }
+    }
+}
+
+#ifdef SQM_HAVE_SSE2
+/* B is a template parameter, so the loop unrolls to fixed shifts. */
+template <unsigned int B>
+static void unpack_sse2(const unsigned char* words, std::uint32_t ref, int* out)
+{
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(low_mask(B)));
+    const __m128i r = _mm_set1_epi32(static_cast<int>(ref));
+    const __m128i* w = reinterpret_cast<const __m128i*>(words);
+
+    for(unsigned int j = 0; j < lane_values; j++)
+    {
+        __m128i x = _mm_setzero_si128();
+        if(B != 0)
+        {
+            const unsigned int bit = j * B;
+            const unsigned int k = bit / 32;
+            const unsigned int s = bit % 32;
+
+            x = _mm_srl_epi32(_mm_loadu_si128(w + k), _mm_cvtsi32_si128(s));
+            if(s + B > 32)
+            {
+                x = _mm_or_si128(x, _mm_sll_epi32(_mm_loadu_si128(w + k + 1),
+                                                  _mm_cvtsi32_si128(32 - s)));
+            }
+            x = _mm_and_si128(x, mask);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * 4),
+                         _mm_add_epi32(x, r));
+    }
+}
+#endif
+
+/* Picks the unpacker for bit width b, Unpacker<B>::run(b, ...) handles
+ * widths from B up. */
+template <unsigned int B>
+struct Unpacker
+{
+    static void run(unsigned int b, const unsigned char* words,
+                    std::uint32_t ref, int* out, bool simd)
+    {
+        if(b != B)
+        {
+            Unpacker<B + 1>::run(b, words, ref, out, simd);
+            return;
+        }
+#ifdef SQM_HAVE_SSE2
+        if(simd)
+        {
+            unpack_sse2<B>(words, ref, out);
+            return;
+        }
+#endif
+        unpack_scalar<B>(words, ref, out);
+    }
+};
+
+template <>
+struct Unpacker<33>
+{
+    static void run(unsigned int, const unsigned char*, std::uint32_t, int*, bool) {}
+};
+
+static void unpack(const unsigned char* in, int* out, bool simd)
+{
+    std::uint32_t ref;
+    std::uint32_t b;
+    std::memcpy(&ref, in, 4);
+    std::memcpy(&b, in + 4, 4);
+    Unpacker<0>::run(b, in + 8, ref, out, simd);
+}
+
+void unpack_block(const unsigned char* in, int* out)
+{
+    unpack(in, out, true);
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Bit-packed blocks round-trip.", "[bitpacking][simd]")
+{
+    std::mt19937 gen{42};
+    unsigned char buf[max_packed_block_bytes];
+    std::vector<int> in(packed_block_size);
+    std::vector<int> out(packed_block_size);
+    std::vector<int> scalar(packed_block_size);
+
+    for(unsigned int b = 0; b <= 32; b++)
+    {
+        /* Values in a range of 2^b around a random base. */
+        const std::uint32_t span = low_mask(b);
+        const int base = static_cast<int>(gen());
+        for(auto& v : in)
+        {
+            const std::uint32_t d = span == 0 ? 0 : gen() & span;
+            v = static_cast<int>(static_cast<std::uint32_t>(base) + d);
+        }
+
+        const std::size_t bytes = pack_block(in.data(), buf);
+        INFO("bits " << b);
+        CHECK(bytes <= 8 + 16 * b);
+        CHECK(packed_block_bytes(buf) == bytes);
+
+        unpack_block(buf, out.data());
+        unpack(buf, scalar.data(), false);
+        CHECK(out == in);
+        CHECK(scalar == in);
+    }
+
+    /* Random small-range ints like ConcreteSquareMatrix(int). */
+    for(auto& v : in) v = static_cast<int>(gen() % 199) - 99;
+    CHECK(pack_block(in.data(), buf) == 8 + 16 * 8);
+    unpack_block(buf, out.data());
+    CHECK(out == in);
+
+    std::memset(buf + 4, 0xff, 4);
+    CHECK(packed_block_bytes(buf) == 0);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,50 @@
+/** \file bitpacking.hpp
+ *  \brief Frame-of-reference bit-packing of integer blocks.
+ */
+
+#ifndef BITPACKING_H
+#define BITPACKING_H
+
+#include <cstddef>
+
+/** \brief Number of integers in a packed block.
+ */
+const unsigned int packed_block_size = 128;
+
+/** \brief Size of the smallest packed block, with 0 bits per value.
+ */
+const std::size_t min_packed_block_bytes = 8;
+
+/** \brief Size of the largest packed block, with 32 bits per value.
+ */
+const std::size_t max_packed_block_bytes = 8 + 16 * 32;
+
+/** \brief Packs packed_block_size integers.
+ *
+ *  The block starts with the smallest value (the reference) and the bit
+ *  width b of the largest difference to it, both 32-bit. Then come the
+ *  differences in b 128-bit words: value i is in 32-bit lane i % 4, at
+ *  bit (i / 4) * b of that lane, so four values are unpacked with each
+ *  vector operation. A block of equal values takes 8 bytes, values in a
+ *  range of 256 take 136 bytes instead of 512.
+ *
+ *  \param in Integers to pack.
+ *  \param out Buffer of max_packed_block_bytes.
+ *  \return Number of bytes written.
+ */
+std::size_t pack_block(const int* in, unsigned char* out);
+
+/** \brief Get the size of a packed block from its first 8 bytes.
+ *  \param in Pointer to the block.
+ *  \return Size in bytes, 0 if the block is invalid.
+ */
+std::size_t packed_block_bytes(const unsigned char* in);
+
+/** \brief Unpacks a block written by pack_block(). Uses SSE2 where
+ *         available.
+ *  \param in Pointer to the block, packed_block_bytes(in) bytes.
+ *  \param out Buffer for packed_block_size integers.
+ */
+void unpack_block(const unsigned char* in, int* out);
+
+#endif // BITPACKING_H
@@ -0,0 +1,818 @@
+/** \file calculator.cpp
+ *  \brief Calculator implementation file.
+ */
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "calculator.hpp"
+#include "compositesquarematrix.hpp"
+#include "elementarena.hpp"
+#include "executiontrace.hpp"
+#include "kernelconfig.hpp"
+#include "matrixexchange.hpp"
+#include "matrixfile.hpp"
+#include "matrixparser.hpp"
+#include "threadconfig.hpp"
+#include "tiledsquarematrix.hpp"
+#include "utils.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+static const char* const command_kind_names[command_kind_count] =
+    {"input", "operation", "evaluation", "output", "other"};
+
+Calculator::Calculator(std::ostream& new_os, std::ostream& new_err,
+                       bool new_interactive) :
+    os(new_os), err(new_err), interactive(new_interactive),
+    timing(new_interactive) {}
+
+bool Calculator::execute(const std::string& command, std::istream& is)
+{
+    const bool counting = counters != nullptr;
+    if(counting) counters->start();
+    const auto start = std::chrono::steady_clock::now();
+
+    bool quit = false;
+    const CommandKind kind = run(command, is, quit);
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if(counting && counters != nullptr && kind != CommandKind::other)
+    {
+        const std::string counts = format_perf_counts(counters->stop());
+        if(interactive)
+        {
+            os << _BLU_ << "Counters : " << _END_ << counts << std::endl;
+        }
+        else
+        {
+            err << "Counters (" << command_kind_names[static_cast<std::size_t>(kind)]
+                << "): " << counts << '\n';
+        }
+    }
+
+    const std::uint64_t ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    const std::size_t k = static_cast<std::size_t>(kind);
+    stats.commands[k]++;
+    stats.nanoseconds[k] += ns;
+    stats.latency[k].record(ns);
+
+    return !quit;
+}
+
+void Calculator::runInteractive(std::istream& is)
+{
+    printHelp();
+
+    std::string buffer;
+    std::string prompt{_YEL_+ "Please input a selection and press ENTER." + _END_};
+    while(get_user_input(os, is, prompt, buffer))
+    {
+        if(!execute(buffer, is)) break;
+    }
+}
+
+std::uint64_t Calculator::runBatch(std::istream& is)
+{
+    std::string buffer;
+    while(read_command(is, buffer))
+    {
+        if(!buffer.empty() && buffer.back() == '\r') buffer.pop_back();
+        if(buffer.empty() || buffer[0] == '#') continue;
+
+        if(!execute(buffer, is)) break;
+    }
+
+    os.flush();
+    printStats(err);
+    return stats.errors;
+}
+
+void Calculator::printHelp() const
+{
+    os << _YEL_ << "*** SQUARE MATRIX CALCULATOR ***" << _END_ << std::endl;
+    os << "* Make a selection:" << std::endl;
+    os << "* Input operation: " << _GRN_ << "\"+\" \"-\" \"*\" \"/\"" << _END_ << "." << std::endl;
+    os << "* Input " << _GRN_ << "\"quit\"" << _END_ << " to quit." << std::endl;
+    os << "* Input " << _GRN_ << "\"clearval\"" << _END_ << " to clear valuation map." << std::endl;
+    os << "* Input " << _GRN_ << "\"printval\"" << _END_ << " to print valuation map." << std::endl;
+    os << "* Input " << _GRN_ << "\"stacksize\"" << _END_ << " to print stack size." << std::endl;
+    os << "* Input " << _GRN_ << "\"=\"" << _END_ << " to evaluate matrix at the stack top." << std::endl;
+    os << "* Input " << _GRN_ << "\"timing on\"" << _END_ << " or " << _GRN_ << "\"timing off\"" << _END_ << " to toggle evaluation timings." << std::endl;
+    os << "* Input " << _GRN_ << "\"stats\"" << _END_ << " to print latencies of the session." << std::endl;
+    os << "* Input " << _GRN_ << "\"threads\"" << _END_ << " to print the thread count, " << _GRN_ << "\"threads N\"" << _END_ << " to set it." << std::endl;
+    os << "* Input " << _GRN_ << "\"kernels\"" << _END_ << " to print the kernel configuration, " << _GRN_ << "\"tune\"" << _END_ << " to tune it on this host and save it." << std::endl;
+    os << "* Input " << _GRN_ << "\"perf on\"" << _END_ << " or " << _GRN_ << "\"perf off\"" << _END_ << " to toggle hardware counters of each command." << std::endl;
+    os << "* Input " << _GRN_ << "\"trace on\"" << _END_ << " or " << _GRN_ << "\"trace off\"" << _END_ << " to toggle tracing of parallel work, "
+       << _GRN_ << "\"trace save FILE\"" << _END_ << " to save the trace as Chrome trace JSON." << std::endl;
+    os << "* Input matrix in string format to add it to stack." << std::endl;
+    os << "* \tExample: " << _GRN_ << "\"[[1,2][a,b]]\"." << _END_ << std::endl;
+    os << "* \tExample: " << _GRN_ << "\"[[4,2][5,6]]\"." << _END_ << std::endl;
+    os << "* Input " << _GRN_ << "\"save FILE\"" << _END_ << " to save matrix at the stack top to a binary file." << std::endl;
+    os << "* Input " << _GRN_ << "\"savez FILE\"" << _END_ << " to save matrix at the stack top to a compressed binary file." << std::endl;
+    os << "* Input " << _GRN_ << "\"savetiled FILE\"" << _END_ << " to evaluate matrix at the stack top out-of-core and save it to a binary file." << std::endl;
+    os << "* Input " << _GRN_ << "\"load FILE\"" << _END_ << " to add matrix from a binary file to stack." << std::endl;
+    os << "* Input " << _GRN_ << "\"export FILE\"" << _END_ << " to evaluate matrix at the stack top to a Matrix Market or .csv file." << std::endl;
+    os << "* Input " << _GRN_ << "\"import FILE\"" << _END_ << " to add matrix from a Matrix Market or .csv file to stack." << std::endl;
+    os << "* Input valuation in format " << _GRN_ << "\"x=2\"" << _END_ << " to add it to valuation map." << std::endl;
+}
+
+void Calculator::printStats(std::ostream& out) const
+{
+    std::uint64_t commands = 0;
+    std::uint64_t nanoseconds = 0;
+    for(std::size_t k = 0; k < command_kind_count; k++)
+    {
+        commands += stats.commands[k];
+        nanoseconds += stats.nanoseconds[k];
+    }
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(6);
+    ss << "Commands: " << commands << " (" << stats.errors << " failed) in "
+       << nanoseconds / 1e9 << " s\n";
+
+    ss << std::setprecision(3);
+    for(std::size_t k = 0; k < command_kind_count; k++)
+    {
+        if(stats.commands[k] == 0) continue;
+
+        ss << "  " << std::left << std::setw(12) << command_kind_names[k]
+           << std::right << std::setw(12) << stats.commands[k]
+           << std::setw(14) << stats.nanoseconds[k] / 1e6 << " ms"
+           << std::setw(12) << stats.nanoseconds[k] / 1e3 / stats.commands[k]
+           << " us/command\n";
+    }
+
+    out << ss.str();
+    out.flush();
+}
+
+void Calculator::printLatencies(std::ostream& out) const
+{
+    std::ostringstream ss;
+    ss << std::left << std::setw(14) << "Latency" << std::right << std::setw(10) << "count"
+       << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "max" << "\n";
+
+    auto row = [&ss](const std::string& name, const LatencyHistogram& h)
+    {
+        if(h.getCount() == 0) return;
+        ss << "  " << std::left << std::setw(12) << name << std::right
+           << std::setw(10) << h.getCount()
+           << std::setw(12) << format_duration(h.percentile(0.5))
+           << std::setw(12) << format_duration(h.percentile(0.99))
+           << std::setw(12) << format_duration(h.getMax()) << "\n";
+    };
+
+    for(std::size_t k = 0; k < command_kind_count; k++)
+    {
+        row(command_kind_names[k], stats.latency[k]);
+    }
+    for(const auto& op : stats.operator_latency)
+    {
+        row(std::string{"operator "} + op.first, op.second);
+    }
+
+    out << ss.str();
+    out.flush();
+}
+
+void Calculator::setTiming(bool on)
+{
+    timing = on;
+}
+
+void Calculator::setPerfCounters(bool on)
+{
+    counters.reset();
+    if(!on) return;
+
+    std::unique_ptr<PerfCounters> opened{new PerfCounters};
+    if(!opened->isAvailable())
+    {
+        throw std::runtime_error(opened->getError());
+    }
+    counters = std::move(opened);
+}
+
+const CalculatorStats& Calculator::getStats() const
+{
+    return stats;
+}
+
+std::size_t Calculator::getStackSize() const
+{
+    return mstack.size();
+}
+
+CommandKind Calculator::run(const std::string& command, std::istream& is, bool& quit)
+{
+    if(command == "clearval")
+    {
+        valuation.clear();
+        success("Valuation map cleared.");
+    }
+    else if(command == "stacksize")
+    {
+        if(interactive)
+        {
+            os << _GRN_ << "Stack size: " << mstack.size() << _END_ << std::endl;
+        }
+        else
+        {
+            os << mstack.size() << '\n';
+        }
+    }
+    else if(command == "printval")
+    {
+        if(valuation.size() == 0)
+        {
+            success("Valuation map is empty.");
+        }
+        for(auto it = valuation.begin(); it != valuation.end(); it++)
+        {
+            if(interactive)
+            {
+                os << _GRN_ << it->first << " = " << it->second << _END_ << std::endl;
+            }
+            else
+            {
+                os << it->first << " = " << it->second << '\n';
+            }
+        }
+    }
+    else if(command == "stats")
+    {
+        printLatencies(os);
+    }
+    else if(command == "timing on" || command == "timing off")
+    {
+        timing = command == "timing on";
+        success(timing ? "Timing on." : "Timing off.");
+    }
+    else if(command == "threads")
+    {
+        if(interactive)
+        {
+            os << _GRN_ << "Threads: " << thread_count() << _END_ << std::endl;
+        }
+        else
+        {
+            os << thread_count() << '\n';
+        }
+    }
+    else if(command.compare(0, 8, "threads ") == 0)
+    {
+        const std::string count = command.substr(8);
+        if(count.empty() || count.size() > 4 ||
+           count.find_first_not_of("0123456789") != std::string::npos ||
+           std::stoul(count) == 0 || std::stoul(count) > max_thread_count)
+        {
+            failure("Invalid thread count.");
+        }
+        else
+        {
+            try
+            {
+                set_thread_count(static_cast<unsigned int>(std::stoul(count)));
+                success("Thread count set.");
+            }
+            catch(std::runtime_error& e)
+            {
+                failure(e.what());
+            }
+        }
+    }
+    else if(command == "kernels")
+    {
+        os << format_kernel_config(kernel_config());
+    }
+    else if(command == "tune")
+    {
+        const std::string path = default_kernel_config_path();
+        try
+        {
+            init_kernel_config(path, true);
+            os << format_kernel_config(kernel_config());
+            success(path.empty() ? "Kernels tuned." : "Kernels tuned, saved to " + path + ".");
+        }
+        catch(std::runtime_error& e)
+        {
+            failure(e.what());
+        }
+    }
+    else if(command == "perf on" || command == "perf off")
+    {
+        try
+        {
+            setPerfCounters(command == "perf on");
+            success(counters ? "Hardware counters on." : "Hardware counters off.");
+        }
+        catch(std::runtime_error& e)
+        {
+            failure(std::string{"Hardware counters are not available: "} + e.what());
+        }
+    }
+    else if(command == "trace on" || command == "trace off")
+    {
+        set_tracing(command == "trace on");
+        success(tracing_enabled() ? "Tracing on." : "Tracing off.");
+    }
+    else if(command.compare(0, 11, "trace save ") == 0)
+    {
+        const std::string path = command.substr(11);
+        std::ofstream trace{path};
+        const std::size_t events = write_chrome_trace(trace);
+        trace.close();
+        if(!trace)
+        {
+            failure("Could not write trace " + path + ".");
+        }
+        else
+        {
+            success("Saved " + std::to_string(events) + " trace events.");
+            clear_trace();
+        }
+        return CommandKind::output;
+    }
+    else if(command == "quit")
+    {
+        quit = true;
+    }
+    else if(command == "+" || command == "-" ||
+            command == "*" || command == "/")
+    {
+        applyOperation(command[0]);
+        return CommandKind::operation;
+    }
+    else if(command == "=")
+    {
+        evaluateTop();
+        return CommandKind::evaluation;
+    }
+    else if(command.compare(0, 5, "save ") == 0 ||
+            command.compare(0, 6, "savez ") == 0)
+    {
+        const bool compressed = command[4] == 'z';
+        const std::string path = command.substr(compressed ? 6 : 5);
+
+        if(checkStack(1))
+        {
+            try
+            {
+                if(compressed)
+                {
+                    saveCompressedMatrixFile(path, *mstack.top(), valuation);
+                }
+                else
+                {
+                    saveMatrixFile(path, *mstack.top(), valuation);
+                }
+                success("Saved matrix.");
+            }
+            catch(std::exception& e)
+            {
+                failure(std::string{"Error while saving matrix: "} + e.what());
+            }
+        }
+        return CommandKind::output;
+    }
+    else if(command.compare(0, 10, "savetiled ") == 0)
+    {
+        const std::string path = command.substr(10);
+
+        if(checkStack(1))
+        {
+            const std::string tiles = path + ".tiles";
+            try
+            {
+                saveMatrixFile(path, TiledSquareMatrix::evaluateTiled(
+                    *mstack.top(), tiles, valuation));
+                std::remove(tiles.c_str());
+                success("Saved matrix.");
+            }
+            catch(std::exception& e)
+            {
+                std::remove(tiles.c_str());
+                failure(std::string{"Error while saving matrix: "} + e.what());
+            }
+        }
+        return CommandKind::output;
+    }
+    else if(command.compare(0, 5, "load ") == 0)
+    {
+        try
+        {
+            mstack.push(openMatrixFile(command.substr(5)));
+            success("Added matrix to stack.");
+        }
+        catch(std::exception& e)
+        {
+            failure(std::string{"Error while loading matrix: "} + e.what());
+        }
+        return CommandKind::input;
+    }
+    else if(command.compare(0, 7, "export ") == 0)
+    {
+        if(checkStack(1))
+        {
+            try
+            {
+                exportMatrix(command.substr(7), mstack.top()->evaluate(valuation));
+                success("Exported matrix.");
+            }
+            catch(std::exception& e)
+            {
+                failure(std::string{"Error while exporting matrix: "} + e.what());
+            }
+        }
+        return CommandKind::output;
+    }
+    else if(command.compare(0, 7, "import ") == 0)
+    {
+        try
+        {
+            mstack.push(std::unique_ptr<SquareMatrix>{
+                new ConcreteSquareMatrix{importMatrix(command.substr(7))}});
+            success("Added matrix to stack.");
+        }
+        catch(std::exception& e)
+        {
+            failure(std::string{"Error while importing matrix: "} + e.what());
+        }
+        return CommandKind::input;
+    }
+    else if(std::isalpha(static_cast<unsigned char>(command[0])))
+    {
+        addValuation(command);
+    }
+    else if(command == "[")
+    {
+        if(readMatrix(is))
+        {
+            success("Added matrix to stack.");
+        }
+        else
+        {
+            failure("Input was not recognized.");
+        }
+        return CommandKind::input;
+    }
+    else
+    {
+        failure("Input was not recognized.");
+    }
+
+    return CommandKind::other;
+}
+
+bool Calculator::readMatrix(std::istream& is)
+{
+    /* The matrix is parsed straight from the input,
+     * a big one is never copied to a line buffer. */
+    std::unique_ptr<SquareMatrix> m;
+    try
+    {
+        m = readSquareMatrix(is);
+    }
+    catch(std::invalid_argument&)
+    {
+        is.clear();
+    }
+
+    /* Rest of the line must be empty. */
+    std::string rest;
+    std::getline(is, rest);
+
+    if(!m || rest.find_first_not_of(" \t\r") != std::string::npos)
+    {
+        return false;
+    }
+
+    mstack.push(std::move(m));
+    return true;
+}
+
+void Calculator::applyOperation(char opchar)
+{
+    if(!checkStack(2)) return;
+
+    auto m1 = std::move(mstack.top());
+    mstack.pop();
+    auto m2 = std::move(mstack.top());
+    mstack.pop();
+
+    std::function<ConcreteSquareMatrix(
+        const ConcreteSquareMatrix&,
+        const ConcreteSquareMatrix&)> func;
+
+    switch(opchar)
+    {
+        case '+':
+            func = [](const ConcreteSquareMatrix& m1,
+                      const ConcreteSquareMatrix& m2)
+                      {return m1 + m2;};
+            break;
+
+        case '-':
+            func = [](const ConcreteSquareMatrix& m1,
+                      const ConcreteSquareMatrix& m2)
+                      {return m1 - m2;};
+            break;
+
+        case '*':
+            func = [](const ConcreteSquareMatrix& m1,
+                      const ConcreteSquareMatrix& m2)
+                      {return m1 * m2;};
+            break;
+
+        default:
+            func = [](const ConcreteSquareMatrix& m1,
+                      const ConcreteSquareMatrix& m2)
+                      {return m1 / m2;};
+    }
+
+    std::unique_ptr<SquareMatrix> csm{new CompositeSquareMatrix{*m1, *m2, func, opchar}};
+
+    if(interactive)
+    {
+        csm->print(os);
+        os << std::endl;
+    }
+
+    mstack.push(std::move(csm));
+}
+
+void Calculator::evaluateTop()
+{
+    if(!checkStack(1)) return;
+
+    /* Temporaries of the evaluation are
+     * freed at once with the arena. */
+    ElementArena arena;
+    ElementArenaScope scope{arena};
+    EvaluationProfile profile;
+    EvaluationProfileScope profile_scope{profile};
+    AllocationTrackingScope tracking{timing};
+    AllocationScope allocations;
+
+    try
+    {
+        const SquareMatrix& m = *mstack.top();
+        if(interactive)
+        {
+            os << _BLU_ << "Calculating : " << _END_ << _GRN_ << m.toString() << _END_ << std::endl;
+        }
+
+        const auto wall_start = std::chrono::steady_clock::now();
+        const std::clock_t cpu_start = std::clock();
+        const ConcreteSquareMatrix result = m.evaluate(valuation);
+        const std::clock_t cpu_end = std::clock();
+        const auto wall = std::chrono::steady_clock::now() - wall_start;
+
+        if(interactive)
+        {
+            os << _BLU_ << "Result : " << _END_ << _GRN_;
+            result.print(os);
+            os << _END_ << std::endl;
+        }
+        else
+        {
+            result.print(os);
+            os << '\n';
+        }
+
+        for(const auto& node : profile.getNodes())
+        {
+            stats.operator_latency[node.op].record(node.self_ns);
+        }
+
+        if(timing)
+        {
+            printEvaluation(profile,
+                static_cast<std::uint64_t>(std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(wall).count()),
+                static_cast<std::uint64_t>(
+                    (cpu_end - cpu_start) * (1e9 / CLOCKS_PER_SEC)),
+                arena.getBytesUsed(), allocations.getStats());
+        }
+    }
+    catch(std::exception& e)
+    {
+        failure(std::string{"Error while calculating matrices: "} + e.what());
+    }
+}
+
+void Calculator::printEvaluation(const EvaluationProfile& profile, std::uint64_t wall_ns,
+                                 std::uint64_t cpu_ns, std::size_t arena_bytes,
+                                 const AllocationStats& heap)
+{
+    std::ostringstream ss;
+    ss << "Wall time " << format_duration(wall_ns) << ", CPU time "
+       << format_duration(cpu_ns) << ", " << arena_bytes << " arena bytes, ";
+    if(allocation_counting_linked())
+    {
+        ss << heap.allocations << " heap allocations (" << heap.bytes << " bytes, peak "
+           << heap.peak_live_bytes << " live), ";
+    }
+    ss << profile.getThreads() << " thread(s)";
+
+    /* Operands are indented under their operator. */
+    for(const auto& node : profile.getNodes())
+    {
+        ss << "\n  " << std::string(2 * node.depth, ' ') << node.op << ' '
+           << node.n << 'x' << node.n << ' ' << format_duration(node.total_ns)
+           << " (operator " << format_duration(node.self_ns) << ')';
+    }
+
+    if(interactive)
+    {
+        os << _BLU_ << "Timing : " << _END_ << ss.str() << std::endl;
+    }
+    else
+    {
+        err << "Timing: " << ss.str() << '\n';
+    }
+}
+
+void Calculator::addValuation(const std::string& command)
+{
+    if(command.size() < 3 || command[1] != '=')
+    {
+        failure("Invalid valuation input.");
+        return;
+    }
+
+    for(unsigned int i = 2; i < command.size(); i++)
+    {
+        if(!std::isdigit(static_cast<unsigned char>(command[i])))
+        {
+            failure("Invalid valuation input.");
+            return;
+        }
+    }
+
+    try
+    {
+        valuation.insert({command[0], std::stoi(command.substr(2))});
+        success("Added valuation.");
+    }
+    catch(std::out_of_range&)
+    {
+        failure("Invalid valuation input.");
+    }
+}
+
+bool Calculator::checkStack(std::size_t size)
+{
+    if(mstack.size() >= size) return true;
+
+    failure(size == 1 ? "Stack is empty." : "Too few matrices in stack.");
+    return false;
+}
+
+void Calculator::success(const std::string& msg)
+{
+    if(interactive)
+    {
+        os << _GRN_ << msg << _END_ << std::endl;
+    }
+}
+
+void Calculator::failure(const std::string& msg)
+{
+    stats.errors++;
+
+    if(interactive)
+    {
+        os << _RED_ << msg << _END_ << std::endl;
+        return;
+    }
+
+    std::uint64_t command = 1;
+    for(std::uint64_t c : stats.commands) command += c;
+    err << "Command " << command << ": " << msg << '\n';
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Calculator batch mode.", "[Calculator][batch]")
+{
+    std::istringstream script{
+        "# Comment\n"
+        "[[1,2][3,4]]\n"
+        "\n"
+        "  [[a,0]\n"
+        "   [0,1]]\r\n"
+        "a=2\n"
+        "*\n"
+        "=\n"
+        "stacksize\n"
+        "+\n"
+        "[[1,2][3,4]] x\n"
+        "b=1x\n"
+        "printval\n"
+        "quit\n"
+        "[[9]]\n"};
+    std::ostringstream os;
+    std::ostringstream err;
+
+    Calculator calc{os, err, false};
+    CHECK(calc.runBatch(script) == 3);
+    CHECK(os.str() == "[[2,4][3,4]]\n1\na = 2\n");
+    CHECK(calc.getStackSize() == 1);
+
+    const CalculatorStats& stats = calc.getStats();
+    CHECK(stats.commands[static_cast<std::size_t>(CommandKind::input)] == 3);
+    CHECK(stats.commands[static_cast<std::size_t>(CommandKind::operation)] == 2);
+    CHECK(stats.commands[static_cast<std::size_t>(CommandKind::evaluation)] == 1);
+
+    const std::string errors = err.str();
+    CHECK(errors.find("Command 7: Too few matrices in stack.\n") != std::string::npos);
+    CHECK(errors.find("Command 8: Input was not recognized.\n") != std::string::npos);
+    CHECK(errors.find("Command 9: Invalid valuation input.\n") != std::string::npos);
+    CHECK(errors.find("Commands: 11 (3 failed)") != std::string::npos);
+}
+
+TEST_CASE("Calculator interactive mode.", "[Calculator]")
+{
+    std::istringstream input{"[[1,2][3,4]]\n[[1,1][1,1]]\n-\n=\n"};
+    std::ostringstream os;
+    std::ostringstream err;
+
+    Calculator calc{os, err, true};
+    calc.runInteractive(input);
+
+    const std::string out = os.str();
+    CHECK(out.find("*** SQUARE MATRIX CALCULATOR ***") != std::string::npos);
+    CHECK(out.find("Added matrix to stack.") != std::string::npos);
+    CHECK(out.find("( [[1,1][1,1]] ) - ( [[1,2][3,4]] )") != std::string::npos);
+    CHECK(out.find("[[0,-1][-2,-3]]") != std::string::npos);
+    CHECK(err.str().empty());
+    CHECK(calc.getStats().errors == 0);
+}
+
+TEST_CASE("Calculator evaluation timing and latencies.", "[Calculator][stats]")
+{
+    std::istringstream script{
+        "[[1,2][3,4]]\n"
+        "[[1,1][1,1]]\n"
+        "*\n"
+        "[[2,0][0,2]]\n"
+        "+\n"
+        "=\n"
+        "timing on\n"
+        "=\n"
+        "stats\n"
+        "threads 0\n"
+        "threads 4097\n"
+        "threads 2\n"
+        "threads\n"
+        "threads 1\n"
+        "kernels\n"};
+    std::ostringstream os;
+    std::ostringstream err;
+
+    Calculator calc{os, err, false};
+    const unsigned int threads = thread_count();
+    CHECK(calc.runBatch(script) == 2);
+    set_thread_count(threads);
+
+    /* Timing goes to err, and only for the second evaluation. */
+    const std::string out = os.str();
+    CHECK(out.find("[[6,6][4,8]]\n[[6,6][4,8]]\n") == 0);
+    CHECK(out.find("Timing") == std::string::npos);
+
+    const std::string errors = err.str();
+    const std::size_t timing = errors.find("Timing: Wall time ");
+    REQUIRE(timing != std::string::npos);
+    CHECK(errors.find(" heap allocations (", timing) != std::string::npos);
+    CHECK(errors.find("Timing", timing + 1) == std::string::npos);
+    CHECK(errors.find("thread(s)\n  + 2x2 ", timing) != std::string::npos);
+    CHECK(errors.find("\n    * 2x2 ", timing) != std::string::npos);
+
+    CHECK(out.find("p99") != std::string::npos);
+    CHECK(out.find("evaluation") != std::string::npos);
+    CHECK(out.find("operator *") != std::string::npos);
+    CHECK(out.find("\n2\n") != std::string::npos);
+    CHECK(out.find("\nmultiply_variant ") != std::string::npos);
+    CHECK(err.str().find("Invalid thread count.") != std::string::npos);
+
+    const CalculatorStats& stats = calc.getStats();
+    CHECK(stats.latency[static_cast<std::size_t>(CommandKind::evaluation)].getCount() == 2);
+    CHECK(stats.latency[static_cast<std::size_t>(CommandKind::input)].getCount() == 3);
+    REQUIRE(stats.operator_latency.count('+') == 1);
+    CHECK(stats.operator_latency.at('+').getCount() == 2);
+    CHECK(stats.operator_latency.at('*').getCount() == 2);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,171 @@
+/** \file calculator.hpp
+ *  \brief Calculator header file. Stack commands of the command-line
+ *         interface.
+ */
+
+#ifndef CALCULATOR_H
+#define CALCULATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stack>
+#include <string>
+#include "allocationtracker.hpp"
+#include "evaluationstats.hpp"
+#include "perfcounters.hpp"
+#include "squarematrix.hpp"
+#include "valuation.hpp"
+
+/** \brief Kinds of commands timed separately in CalculatorStats.
+ */
+enum class CommandKind : unsigned int
+{
+    /** \brief Matrix literal, "load" or "import". */
+    input,
+    /** \brief "+", "-", "*" or "/". */
+    operation,
+    /** \brief "=". */
+    evaluation,
+    /** \brief "save", "savez", "export" or "trace save". */
+    output,
+    /** \brief Valuations and everything else. */
+    other
+};
+
+/** \brief Number of values in CommandKind.
+ */
+const std::size_t command_kind_count = 5;
+
+/** \struct CalculatorStats
+ *  \brief Command counts and time spent per CommandKind.
+ */
+struct CalculatorStats
+{
+    /** \brief Commands run, per kind. */
+    std::array<std::uint64_t, command_kind_count> commands{};
+    /** \brief Nanoseconds spent, per kind. */
+    std::array<std::uint64_t, command_kind_count> nanoseconds{};
+    /** \brief Command latencies, per kind. */
+    std::array<LatencyHistogram, command_kind_count> latency{};
+    /** \brief Time in the operators of evaluated expressions,
+     *         per operator character. */
+    std::map<char, LatencyHistogram> operator_latency;
+    /** \brief Commands that failed. */
+    std::uint64_t errors = 0;
+};
+
+/** \class Calculator
+ *  \brief Matrix stack and valuation map driven by text commands.
+ *
+ *  Interactive calculators print colored prompts and a confirmation for
+ *  every command. Batch calculators print only results, uncolored and
+ *  without flushing, and send errors to a separate stream, which keeps
+ *  long scripts from being bound by terminal output.
+ *
+ *  With timing on, every "=" is followed by its wall and CPU time, its
+ *  arena bytes, its heap allocations where allocation_counting_linked(),
+ *  the threads it used and the time of every operator in the expression.
+ *  Timing is on by default only for interactive calculators; batch
+ *  calculators write it and hardware event counts to the error stream so
+ *  results stay parseable.
+ */
+class Calculator
+{
+    public:
+        /** \brief Parametrized constructor.
+         *  \param new_os Stream for results and messages.
+         *  \param new_err Stream for errors.
+         *  \param new_interactive true for prompts and colors.
+         */
+        Calculator(std::ostream& new_os, std::ostream& new_err,
+                   bool new_interactive);
+
+        /** \brief Runs one command.
+         *  \param command Command line. "[" if a matrix literal is waiting
+         *         in is, see get_user_input().
+         *  \param is Stream the matrix literal is read from.
+         *  \return false if the command was "quit".
+         */
+        bool execute(const std::string& command, std::istream& is);
+
+        /** \brief Prompts for and runs commands until "quit" or the end of is.
+         *  \param is Stream to read from.
+         */
+        void runInteractive(std::istream& is);
+
+        /** \brief Runs every command in is without prompts. Blank lines
+         *         and lines starting with '#' are skipped. The counts and
+         *         times of the commands are written to err at the end.
+         *  \param is Stream to read from.
+         *  \return Number of commands that failed.
+         */
+        std::uint64_t runBatch(std::istream& is);
+
+        /** \brief Writes the list of commands to os.
+         */
+        void printHelp() const;
+
+        /** \brief Writes a summary of getStats() to a stream.
+         *  \param out Stream to write to.
+         */
+        void printStats(std::ostream& out) const;
+
+        /** \brief Writes the p50, p99 and maximum latency of every
+         *         command kind and operator of the session to a stream.
+         *  \param out Stream to write to.
+         */
+        void printLatencies(std::ostream& out) const;
+
+        /** \brief Turns the timing of evaluations on or off.
+         *  \param on true to print timings.
+         */
+        void setTiming(bool on);
+
+        /** \brief Turns counting of hardware events on or off. While on,
+         *         the counts of every input, operation, evaluation and
+         *         output command are printed after it.
+         *  \param on true to count events.
+         *  \throw std::runtime_error if the counters are not available.
+         */
+        void setPerfCounters(bool on);
+
+        /** \brief Get the command statistics.
+         *  \return Reference to member stats.
+         */
+        const CalculatorStats& getStats() const;
+
+        /** \brief Get the number of matrices in the stack.
+         *  \return Stack size.
+         */
+        std::size_t getStackSize() const;
+
+    private:
+        CommandKind run(const std::string& command, std::istream& is, bool& quit);
+        bool readMatrix(std::istream& is);
+        void applyOperation(char opchar);
+        void evaluateTop();
+        void printEvaluation(const EvaluationProfile& profile,
+                             std::uint64_t wall_ns, std::uint64_t cpu_ns,
+                             std::size_t arena_bytes,
+                             const AllocationStats& heap);
+        void addValuation(const std::string& command);
+        bool checkStack(std::size_t size);
+        void success(const std::string& msg);
+        void failure(const std::string& msg);
+
+        std::stack<std::unique_ptr<SquareMatrix>> mstack;
+        Valuation valuation;
+        CalculatorStats stats;
+        std::ostream& os;
+        std::ostream& err;
+        bool interactive;
+        bool timing;
+        std::unique_ptr<PerfCounters> counters;
+};
+
+#endif // CALCULATOR_H
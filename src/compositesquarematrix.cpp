@@ -2,9 +2,14 @@
  *  \brief CompositeSquareMatrix implementation file.
  */
 
+#include <chrono>
 #include <sstream>
 #include "compositesquarematrix.hpp"
+#include "evaluationstats.hpp"
+#include "executiontrace.hpp"
+#ifdef SQM_TESTS
 #include "catch.hpp"
+#endif
 
 CompositeSquareMatrix::CompositeSquareMatrix() :
     oprnd1(std::move(std::unique_ptr<SquareMatrix>{new ConcreteSquareMatrix{}})),
@@ -46,6 +51,21 @@ unsigned int CompositeSquareMatrix::getRowSize() const
     return this->oprnd1->getRowSize();
 }
 
+const SquareMatrix& CompositeSquareMatrix::getLeftOperand() const
+{
+    return *oprnd1;
+}
+
+const SquareMatrix& CompositeSquareMatrix::getRightOperand() const
+{
+    return *oprnd2;
+}
+
+char CompositeSquareMatrix::getOperator() const
+{
+    return op_char;
+}
+
 CompositeSquareMatrix&
     CompositeSquareMatrix::operator=(const CompositeSquareMatrix& m)
 {
@@ -73,7 +93,11 @@ SquareMatrix* CompositeSquareMatrix::clone() const
 
 void CompositeSquareMatrix::print(std::ostream& os) const
 {
-    os << this->toString();
+    os << "( ";
+    oprnd1->print(os);
+    os << " ) " << op_char << " ( ";
+    oprnd2->print(os);
+    os << " )";
 }
 
 std::string CompositeSquareMatrix::toString() const
@@ -91,11 +115,44 @@ std::string CompositeSquareMatrix::toString() const
     return str;
 }
 
+/* Span names must outlive the trace, so they are literals. */
+static const char* evaluate_span_name(char op)
+{
+    switch(op)
+    {
+        case '+': return "evaluate +";
+        case '-': return "evaluate -";
+        case '*': return "evaluate *";
+        case '/': return "evaluate /";
+        default: return "evaluate";
+    }
+}
+
 ConcreteSquareMatrix CompositeSquareMatrix::evaluate(const Valuation& val) const
 {
-    return oprtor(oprnd1->evaluate(val), oprnd2->evaluate(val));
+    TraceSpan span{evaluate_span_name(op_char), oprnd1->getRowSize()};
+
+    EvaluationProfile* profile = EvaluationProfile::current();
+    if(profile == nullptr)
+    {
+        return oprtor(oprnd1->evaluate(val), oprnd2->evaluate(val));
+    }
+
+    const std::size_t node = profile->enterNode(op_char, oprnd1->getRowSize());
+    const ConcreteSquareMatrix lhs = oprnd1->evaluate(val);
+    const ConcreteSquareMatrix rhs = oprnd2->evaluate(val);
+
+    const auto start = std::chrono::steady_clock::now();
+    ConcreteSquareMatrix ret = oprtor(lhs, rhs);
+    const auto self = std::chrono::steady_clock::now() - start;
+
+    profile->leaveNode(node, static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(self).count()));
+    return ret;
 }
 
+#ifdef SQM_TESTS
+
 TEST_CASE("CompositeSquareMatrix construction.",
           "[CompositeSquareMatrix][constructor]")
 {
@@ -146,3 +203,5 @@ TEST_CASE("CompositeSquareMatrix construction.",
     CompositeSquareMatrix clone3{std::move(csm3)};
     CHECK(clone2.toString() == clone3.toString());
 }
+
+#endif // SQM_TESTS
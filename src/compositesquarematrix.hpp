@@ -53,6 +53,21 @@ class CompositeSquareMatrix : public SquareMatrix
          */
         unsigned int getRowSize() const override;
 
+        /** \brief Get the left operand.
+         *  \return Reference to oprnd1.
+         */
+        const SquareMatrix& getLeftOperand() const;
+
+        /** \brief Get the right operand.
+         *  \return Reference to oprnd2.
+         */
+        const SquareMatrix& getRightOperand() const;
+
+        /** \brief Get the operator character.
+         *  \return Value of op_char.
+         */
+        char getOperator() const;
+
         /** \brief Copy assignment operator overload.
          *  \param m Reference to CompositeSquareMatrix.
          */
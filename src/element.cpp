@@ -5,7 +5,10 @@
 #include <sstream>
 #include <stdexcept>
 #include "element.hpp"
+#include "matrixformat.hpp"
+#ifdef SQM_TESTS
 #include "catch.hpp"
+#endif
 
 std::ostream& operator<<(std::ostream& os, const Element& e)
 {
@@ -29,7 +32,8 @@ int VariableElement::evaluate(const Valuation& valuation) const
 template<>
 std::string IntElement::toString() const
 {
-    return std::to_string(t);
+    char buf[max_int_length];
+    return std::string(buf, format_int(buf, t));
 }
 
 template<>
@@ -91,6 +95,8 @@ IntElement operator/(const IntElement& i1, const IntElement& i2)
     return IntElement{i1.t / i2.t};
 }
 
+#ifdef SQM_TESTS
+
 TEST_CASE("IntElement construction, mutators and accessors.",
           "[IntElement][constructor][get][set][mutator][accessor]")
 {
@@ -198,3 +204,5 @@ TEST_CASE("VariableElement operators.", "[VariableElement][operator][math]")
     ss << elA;
     CHECK(ss.str() == "A");
 }
+
+#endif // SQM_TESTS
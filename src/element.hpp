@@ -10,12 +10,28 @@
 #include <string>
 #include "valuation.hpp"
 
+template <typename T>
+class ElementPtr;
+
 /** \class Element
  *  \brief Abstract base class for matrix elements.
  */
 class Element
 {
     public:
+        /** \brief Constructor with no parameters.
+         */
+        Element() : refs(0) {};
+
+        /** \brief Copy constructor. The reference count is not copied.
+         */
+        Element(const Element&) : refs(0) {};
+
+        /** \brief Copy assignment. The reference count is not copied.
+         *  \return Reference to Element.
+         */
+        Element& operator=(const Element&) {return *this;};
+
         /** \brief Default destructor.
          */
         virtual ~Element() = default;
@@ -43,6 +59,19 @@ class Element
          *  \return std::ostream reference.
          */
         friend std::ostream& operator<<(std::ostream& os, const Element& e);
+
+    private:
+        /* Intrusive reference count used by ElementPtr, shifted left by
+         * two bits. The low bits tell where the element was allocated. */
+        mutable unsigned int refs;
+
+        template <typename T>
+        friend class ElementPtr;
+
+        template <typename T, typename... Args>
+        friend ElementPtr<T> make_element(Args&&... args);
+
+        friend void release_element(const Element* e);
 };
 
 /* Forward declaration, so that we can
@@ -0,0 +1,498 @@
+/** \file elementarena.cpp
+ *  \brief ElementArena implementation file.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include "elementarena.hpp"
+#include "squarematrix.hpp"
+#include "compositesquarematrix.hpp"
+#ifdef SQM_TESTS
+#include <thread>
+#include "catch.hpp"
+#endif
+
+static thread_local ElementArena* current_arena = nullptr;
+
+ElementArena::ElementArena(std::size_t new_chunk_size) :
+    chunk_size(std::max(new_chunk_size, sizeof(std::max_align_t))),
+    offset(0), used(0) {}
+
+ElementArena::~ElementArena()
+{
+    for(auto& c : chunks)
+    {
+        ::operator delete(c.data);
+    }
+}
+
+void* ElementArena::allocate(std::size_t size, std::size_t align)
+{
+    if(!chunks.empty())
+    {
+        Chunk& c = chunks.back();
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(c.data);
+        const std::uintptr_t aligned = (base + offset + align - 1) & ~(align - 1);
+        const std::size_t start = aligned - base;
+
+        if(start + size <= c.size)
+        {
+            offset = start + size;
+            used += size;
+            return c.data + start;
+        }
+    }
+
+    /* Start a new chunk. Memory from ::operator new is aligned
+     * for any fundamental type. */
+    const std::size_t sz = std::max(chunk_size, size + align);
+    chunks.push_back(Chunk{static_cast<char*>(::operator new(sz)), sz});
+
+    Chunk& c = chunks.back();
+    const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(c.data);
+    const std::size_t start = ((base + align - 1) & ~(align - 1)) - base;
+    offset = start + size;
+    used += size;
+    return c.data + start;
+}
+
+void ElementArena::reset()
+{
+    while(chunks.size() > 1)
+    {
+        ::operator delete(chunks.back().data);
+        chunks.pop_back();
+    }
+
+    offset = 0;
+    used = 0;
+}
+
+std::size_t ElementArena::getBytesUsed() const
+{
+    return used;
+}
+
+std::size_t ElementArena::getBytesReserved() const
+{
+    std::size_t sz = 0;
+    for(const auto& c : chunks) sz += c.size;
+    return sz;
+}
+
+ElementArena* ElementArena::current()
+{
+    return current_arena;
+}
+
+ElementArenaScope::ElementArenaScope(ElementArena& arena) :
+    previous(current_arena)
+{
+    current_arena = &arena;
+}
+
+ElementArenaScope::~ElementArenaScope()
+{
+    current_arena = previous;
+}
+
+/* Blocks of free slab memory form a singly linked list. */
+struct SlabBlock
+{
+    SlabBlock* next;
+};
+
+struct SlabFreeList
+{
+    SlabBlock* head;
+    std::size_t count;
+    /* Count at which the slabs that are wholly in the list are freed. */
+    std::size_t trim_at;
+};
+
+static const std::size_t slab_bytes = element_slab_block_size * element_slab_block_count;
+static const std::size_t min_slab_trim = 2 * element_slab_block_count;
+
+/* Slabs, sorted by address, and the free blocks of exited threads.
+ * Never destroyed, so that elements released during static destruction
+ * still find it. */
+struct SlabPool
+{
+    std::mutex mtx;
+    std::vector<char*> slabs;
+    SlabFreeList blocks;
+};
+
+static SlabPool& slab_pool()
+{
+    static SlabPool* pool = []
+    {
+        SlabPool* p = new SlabPool;
+        p->blocks = SlabFreeList{nullptr, 0, min_slab_trim};
+        return p;
+    }();
+    return *pool;
+}
+
+/* Free blocks of the thread. Once the thread has exited its blocks are
+ * in the pool and local_slabs_drained is set. */
+static thread_local SlabFreeList local_blocks = {nullptr, 0, min_slab_trim};
+static thread_local bool local_slabs_drained = false;
+
+/* Frees the slabs all of whose blocks are in list. The blocks of a slab
+ * may be spread over several lists, then it is kept until they meet in
+ * one. Needs the pool mutex. */
+static void trim_slabs(SlabFreeList& list, std::vector<char*>& slabs)
+{
+    std::vector<char*> blocks;
+    blocks.reserve(list.count);
+    for(SlabBlock* b = list.head; b != nullptr; b = b->next)
+    {
+        blocks.push_back(reinterpret_cast<char*>(b));
+    }
+    std::sort(blocks.begin(), blocks.end());
+
+    std::vector<char*> kept;
+    list.head = nullptr;
+    list.count = 0;
+    std::size_t k = 0;
+    for(char* slab : slabs)
+    {
+        const std::size_t first = k;
+        while(k < blocks.size() && blocks[k] < slab + slab_bytes) k++;
+
+        if(k - first == element_slab_block_count)
+        {
+            ::operator delete(slab);
+            continue;
+        }
+
+        kept.push_back(slab);
+        for(std::size_t i = first; i < k; i++)
+        {
+            SlabBlock* b = reinterpret_cast<SlabBlock*>(blocks[i]);
+            b->next = list.head;
+            list.head = b;
+            list.count++;
+        }
+    }
+
+    slabs.swap(kept);
+    list.trim_at = std::max(min_slab_trim, 2 * list.count);
+}
+
+static void push_block(SlabFreeList& list, SlabBlock* b)
+{
+    b->next = list.head;
+    list.head = b;
+    list.count++;
+}
+
+static SlabBlock* pop_block(SlabFreeList& list)
+{
+    SlabBlock* b = list.head;
+    list.head = b->next;
+    list.count--;
+    return b;
+}
+
+/* Hands the blocks of the thread to the pool when the thread exits. */
+struct SlabDrain
+{
+    void arm() {}
+
+    ~SlabDrain()
+    {
+        SlabPool& pool = slab_pool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+        while(local_blocks.head != nullptr)
+        {
+            push_block(pool.blocks, pop_block(local_blocks));
+        }
+        local_slabs_drained = true;
+        if(pool.blocks.count >= pool.blocks.trim_at) trim_slabs(pool.blocks, pool.slabs);
+    }
+};
+
+static thread_local SlabDrain slab_drain;
+
+/* Fills the empty list of the thread from the pool, or from a new slab. */
+static void refill_blocks()
+{
+    slab_drain.arm();
+
+    SlabPool& pool = slab_pool();
+    std::lock_guard<std::mutex> lock(pool.mtx);
+    while(pool.blocks.head != nullptr && local_blocks.count < element_slab_block_count)
+    {
+        push_block(local_blocks, pop_block(pool.blocks));
+    }
+    if(local_blocks.head != nullptr) return;
+
+    char* slab = static_cast<char*>(::operator new(slab_bytes));
+    pool.slabs.insert(std::upper_bound(pool.slabs.begin(), pool.slabs.end(), slab), slab);
+
+    for(std::size_t i = element_slab_block_count; i-- > 0;)
+    {
+        push_block(local_blocks, reinterpret_cast<SlabBlock*>(slab + i * element_slab_block_size));
+    }
+}
+
+static void* allocate_slab_block()
+{
+    if(local_blocks.head == nullptr) refill_blocks();
+    return pop_block(local_blocks);
+}
+
+static void deallocate_slab_block(void* mem)
+{
+    SlabBlock* b = static_cast<SlabBlock*>(mem);
+    if(local_slabs_drained)
+    {
+        SlabPool& pool = slab_pool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+        push_block(pool.blocks, b);
+        if(pool.blocks.count >= pool.blocks.trim_at) trim_slabs(pool.blocks, pool.slabs);
+        return;
+    }
+
+    push_block(local_blocks, b);
+    if(local_blocks.count >= local_blocks.trim_at)
+    {
+        SlabPool& pool = slab_pool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+        trim_slabs(local_blocks, pool.slabs);
+    }
+}
+
+std::size_t element_slab_bytes()
+{
+    SlabPool& pool = slab_pool();
+    std::lock_guard<std::mutex> lock(pool.mtx);
+    return pool.slabs.size() * slab_bytes;
+}
+
+void* allocate_element(std::size_t size, std::size_t align, unsigned int& origin)
+{
+    ElementArena* arena = ElementArena::current();
+    if(arena != nullptr)
+    {
+        origin = element_origin_arena;
+        return arena->allocate(size, align);
+    }
+
+    /* Elements released after the thread has exited go to the heap. */
+    if(size <= element_slab_block_size && align <= alignof(SlabBlock) &&
+       !local_slabs_drained)
+    {
+        origin = element_origin_slab;
+        return allocate_slab_block();
+    }
+
+    origin = element_origin_heap;
+    return ::operator new(size);
+}
+
+void deallocate_element(void* mem, unsigned int origin)
+{
+    switch(origin)
+    {
+        case element_origin_arena:
+            break;
+        case element_origin_slab:
+            deallocate_slab_block(mem);
+            break;
+        default:
+            ::operator delete(mem);
+    }
+}
+
+void release_element(const Element* e)
+{
+    const unsigned int origin = e->refs & element_origin_mask;
+
+    if(origin == element_origin_heap)
+    {
+        delete e;
+        return;
+    }
+
+    /* Single inheritance, the element starts at e. */
+    void* mem = const_cast<Element*>(e);
+    e->~Element();
+    deallocate_element(mem, origin);
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("ElementArena allocation.", "[ElementArena][memory]")
+{
+    ElementArena arena{256};
+
+    CHECK(arena.getBytesUsed() == 0);
+    CHECK(arena.getBytesReserved() == 0);
+
+    void* p1 = arena.allocate(3, 1);
+    void* p2 = arena.allocate(8, 8);
+    CHECK(reinterpret_cast<std::uintptr_t>(p2) % 8 == 0);
+    CHECK(static_cast<char*>(p2) - static_cast<char*>(p1) == 8);
+    CHECK(arena.getBytesUsed() == 11);
+    CHECK(arena.getBytesReserved() == 256);
+
+    /* Bigger than a chunk. */
+    arena.allocate(1000);
+    CHECK(arena.getBytesReserved() >= 1256);
+
+    arena.reset();
+    CHECK(arena.getBytesUsed() == 0);
+    CHECK(arena.getBytesReserved() == 256);
+    CHECK(arena.allocate(3, 1) == p1);
+}
+
+TEST_CASE("ElementArenaScope and make_element.", "[ElementArena][memory][scope]")
+{
+    ElementArena outer;
+    ElementArena inner;
+
+    CHECK(ElementArena::current() == nullptr);
+    {
+        ElementArenaScope scope1{outer};
+        CHECK(ElementArena::current() == &outer);
+        {
+            ElementArenaScope scope2{inner};
+            CHECK(ElementArena::current() == &inner);
+
+            auto e = make_element<IntElement>(5);
+            CHECK(e->getVal() == 5);
+            CHECK(inner.getBytesUsed() >= sizeof(IntElement));
+
+            auto c = clone_element(*e);
+            CHECK(c->getVal() == 5);
+        }
+        CHECK(ElementArena::current() == &outer);
+        CHECK(outer.getBytesUsed() == 0);
+    }
+    CHECK(ElementArena::current() == nullptr);
+
+    auto heap = make_element<VariableElement>('x');
+    CHECK(heap->toString() == "x");
+}
+
+TEST_CASE("Matrices in an ElementArena.", "[ElementArena][SquareMatrix][memory]")
+{
+    SymbolicSquareMatrix symb{"[[a,1,2][b,3,4][c,5,6]]"};
+    ConcreteSquareMatrix conc{"[[1,1,1][2,2,2][3,3,3]]"};
+    Valuation val{{'a', 1}, {'b', 2}, {'c', 3}};
+    ElementArena arena;
+
+    for(int round = 0; round < 3; round++)
+    {
+        ElementArenaScope scope{arena};
+        {
+            CompositeSquareMatrix csm{symb, conc,
+                [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+                {
+                    return m1 * m2;
+                },
+                '*'};
+
+            ConcreteSquareMatrix res = csm.evaluate(val);
+            CHECK(res.toString() == "[[9,9,9][20,20,20][31,31,31]]");
+
+            ConcreteSquareMatrix big{20};
+            ConcreteSquareMatrix copy{big};
+            CHECK((big + copy) == (copy + big));
+            CHECK(copy.cloneElements().size() == 20);
+        }
+        CHECK(arena.getBytesUsed() > 0);
+        arena.reset();
+    }
+}
+
+TEST_CASE("ElementPtr reference counting.", "[ElementPtr][memory]")
+{
+    ElementPtr<IntElement> null;
+    CHECK(!null);
+    CHECK(null.useCount() == 0);
+
+    ElementPtr<IntElement> p1{new IntElement{3}};
+    CHECK(p1.useCount() == 1);
+    {
+        ElementPtr<IntElement> p2{p1};
+        ElementPtr<Element> base{p2};
+        CHECK(p1.useCount() == 3);
+        CHECK(base->toString() == "3");
+        CHECK(base == p1);
+    }
+    CHECK(p1.useCount() == 1);
+
+    ElementPtr<IntElement> p3{std::move(p1)};
+    CHECK(!p1);
+    CHECK(p3.useCount() == 1);
+
+    p1 = p3;
+    CHECK(p3.useCount() == 2);
+    p3.reset();
+    CHECK(p1.useCount() == 1);
+    CHECK(p1->getVal() == 3);
+
+    /* Copies of elements start with their own count. */
+    IntElement copy{*p1};
+    ElementPtr<IntElement> p4{new IntElement{copy}};
+    CHECK(p4.useCount() == 1);
+    CHECK(p1.useCount() == 1);
+
+    ElementPtr<Element> sym{make_element<VariableElement>('x')};
+    CHECK(sym.useCount() == 1);
+    CHECK(clone_element(*sym)->toString() == "x");
+}
+
+TEST_CASE("Elements from slabs are reused.", "[ElementPtr][memory][slab]")
+{
+    const IntElement* first = nullptr;
+    {
+        auto e = make_element<IntElement>(1);
+        first = e.get();
+    }
+
+    auto e = make_element<IntElement>(2);
+    CHECK(e.get() == first);
+
+    std::vector<ElementPtr<IntElement>> many;
+    for(std::size_t i = 0; i < 3 * element_slab_block_count; i++)
+    {
+        many.push_back(make_element<IntElement>(static_cast<int>(i)));
+    }
+    CHECK(many.back()->getVal() == static_cast<int>(3 * element_slab_block_count - 1));
+    CHECK(e->getVal() == 2);
+}
+
+TEST_CASE("Empty element slabs are freed.", "[ElementPtr][memory][slab]")
+{
+    const std::size_t slab = element_slab_block_size * element_slab_block_count;
+    const std::size_t before = element_slab_bytes();
+    {
+        std::vector<ElementPtr<IntElement>> many;
+        for(std::size_t i = 0; i < 16 * element_slab_block_count; i++)
+        {
+            many.push_back(make_element<IntElement>(static_cast<int>(i)));
+        }
+        CHECK(element_slab_bytes() >= before + 12 * slab);
+    }
+    CHECK(element_slab_bytes() <= before + 4 * slab);
+
+    /* Blocks freed on a thread that exits are not lost either. */
+    std::thread t{[]
+        {
+            std::vector<ElementPtr<IntElement>> many;
+            for(std::size_t i = 0; i < 16 * element_slab_block_count; i++)
+            {
+                many.push_back(make_element<IntElement>(static_cast<int>(i)));
+            }
+        }};
+    t.join();
+    CHECK(element_slab_bytes() <= before + 4 * slab);
+}
+
+#endif // SQM_TESTS
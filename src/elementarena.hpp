@@ -0,0 +1,203 @@
+/** \file elementarena.hpp
+ *  \brief ElementArena header file. Monotonic allocator for matrix
+ *         elements and evaluation temporaries.
+ */
+
+#ifndef ELEMENTARENA_H
+#define ELEMENTARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include "element.hpp"
+#include "elementptr.hpp"
+
+/** \brief Default size of the memory chunks of an ElementArena.
+ */
+const std::size_t default_arena_chunk_size = 64 * 1024;
+
+/** \class ElementArena
+ *  \brief Monotonic allocator. Memory is handed out from big chunks and
+ *         released all at once by reset() or the destructor.
+ *
+ *  An arena is not thread-safe; each thread should use its own. Everything
+ *  allocated from an arena must be destroyed before the arena is reset.
+ */
+class ElementArena
+{
+    public:
+        /** \brief Parametrized constructor.
+         *  \param new_chunk_size Size of the chunks requested from the heap.
+         */
+        explicit ElementArena(std::size_t new_chunk_size = default_arena_chunk_size);
+
+        /** \brief Releases all chunks.
+         */
+        ~ElementArena();
+
+        ElementArena(const ElementArena&) = delete;
+        ElementArena& operator=(const ElementArena&) = delete;
+
+        /** \brief Allocates memory from the arena.
+         *  \param size Bytes to allocate.
+         *  \param align Alignment of the memory, a power of two.
+         *  \return Pointer to the memory.
+         */
+        void* allocate(std::size_t size,
+                       std::size_t align = alignof(std::max_align_t));
+
+        /** \brief Frees all memory at once. The first chunk is kept
+         *         for reuse.
+         */
+        void reset();
+
+        /** \brief Get bytes allocated since construction or the last reset.
+         *  \return Byte count.
+         */
+        std::size_t getBytesUsed() const;
+
+        /** \brief Get bytes held in chunks.
+         *  \return Byte count.
+         */
+        std::size_t getBytesReserved() const;
+
+        /** \brief Returns the arena of the innermost ElementArenaScope
+         *         of the calling thread.
+         *  \return Pointer to ElementArena, nullptr if there is none.
+         */
+        static ElementArena* current();
+
+    private:
+        struct Chunk
+        {
+            char* data;
+            std::size_t size;
+        };
+
+        std::vector<Chunk> chunks;
+        std::size_t chunk_size;
+        std::size_t offset;
+        std::size_t used;
+
+        friend class ElementArenaScope;
+};
+
+/** \class ElementArenaScope
+ *  \brief Makes an ElementArena current for the calling thread
+ *         for the lifetime of the scope object.
+ *
+ *  make_element() allocates from the current arena, so matrices built and
+ *  evaluated inside the scope get their elements from it.
+ */
+class ElementArenaScope
+{
+    public:
+        /** \brief Parametrized constructor.
+         *  \param arena Arena to make current.
+         */
+        explicit ElementArenaScope(ElementArena& arena);
+
+        /** \brief Restores the previously current arena.
+         */
+        ~ElementArenaScope();
+
+        ElementArenaScope(const ElementArenaScope&) = delete;
+        ElementArenaScope& operator=(const ElementArenaScope&) = delete;
+
+    private:
+        ElementArena* previous;
+};
+
+/** \brief Size of the blocks in element slabs. Elements up to this size
+ *         are allocated from slabs when no arena is current.
+ */
+const std::size_t element_slab_block_size =
+    sizeof(IntElement) > sizeof(VariableElement) ?
+    sizeof(IntElement) : sizeof(VariableElement);
+
+/** \brief Number of blocks in one element slab.
+ */
+const std::size_t element_slab_block_count = 4096;
+
+/** \brief Get the bytes held in element slabs. Slabs whose blocks are
+ *         all free are returned to the heap, and the free blocks of a
+ *         thread go to a shared pool when it exits.
+ *  \return Byte count.
+ */
+std::size_t element_slab_bytes();
+
+/** \brief Allocates memory for an element. Uses the current arena of the
+ *         calling thread if there is one, else a thread-local free list
+ *         of blocks carved from bulk-allocated slabs, else the heap.
+ *  \param size Size of the element.
+ *  \param align Alignment of the element.
+ *  \param origin Set to the element_origin_* constant of the memory.
+ *  \return Pointer to the memory.
+ */
+void* allocate_element(std::size_t size, std::size_t align, unsigned int& origin);
+
+/** \brief Returns memory from allocate_element() when the element
+ *         could not be constructed.
+ *  \param mem Pointer to the memory.
+ *  \param origin Origin returned by allocate_element().
+ */
+void deallocate_element(void* mem, unsigned int origin);
+
+/** \brief Creates a new element, see allocate_element().
+ *  \tparam T Element type.
+ *  \param args Constructor parameters of T.
+ *  \return Handle to the new element.
+ */
+template <typename T, typename... Args>
+ElementPtr<T> make_element(Args&&... args)
+{
+    unsigned int origin = element_origin_heap;
+    void* mem = allocate_element(sizeof(T), alignof(T), origin);
+    T* e = nullptr;
+
+    try
+    {
+        e = new (mem) T(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+        deallocate_element(mem, origin);
+        throw;
+    }
+
+    static_cast<const Element*>(e)->refs = origin;
+    return ElementPtr<T>{e};
+}
+
+/** \brief Returns a copy of e, allocated like make_element().
+ *  \param e Element to copy.
+ *  \return Handle to the copy.
+ */
+inline ElementPtr<IntElement> clone_element(const IntElement& e)
+{
+    return make_element<IntElement>(e);
+}
+
+/** \brief Returns a copy of e, allocated like make_element().
+ *  \param e Element to copy.
+ *  \return Handle to the copy.
+ */
+inline ElementPtr<VariableElement> clone_element(const VariableElement& e)
+{
+    return make_element<VariableElement>(e);
+}
+
+/** \brief Returns a copy of e, allocated like make_element() for the
+ *         known element types and with Element::clone() for others.
+ *  \param e Element to copy.
+ *  \return Handle to the copy.
+ */
+inline ElementPtr<Element> clone_element(const Element& e)
+{
+    if(auto i = dynamic_cast<const IntElement*>(&e)) return clone_element(*i);
+    if(auto v = dynamic_cast<const VariableElement*>(&e)) return clone_element(*v);
+    return ElementPtr<Element>{e.clone()};
+}
+
+#endif // ELEMENTARENA_H
@@ -0,0 +1,189 @@
+/** \file elementptr.hpp
+ *  \brief ElementPtr header file. Reference counted handle for matrix
+ *         elements.
+ */
+
+#ifndef ELEMENTPTR_H
+#define ELEMENTPTR_H
+
+#include <cstddef>
+#include <utility>
+#include "element.hpp"
+
+/** \name Element origins
+ *  \brief Where an element was allocated, stored in the low bits of
+ *         its reference count.
+ */
+//@{
+const unsigned int element_origin_heap  = 0;
+const unsigned int element_origin_arena = 1;
+const unsigned int element_origin_slab  = 2;
+const unsigned int element_origin_mask  = 3;
+const unsigned int element_ref_one      = 4;
+//@}
+
+/** \brief Destroys an element whose last ElementPtr went away and
+ *         returns its memory to where it came from.
+ *  \param e Pointer to Element.
+ */
+void release_element(const Element* e);
+
+/** \class ElementPtr<T>
+ *  \brief Intrusive reference counted pointer to an Element.
+ *
+ *  The count lives in the element itself, so a handle is a single
+ *  pointer and there is no separate control block. The count is not
+ *  atomic: handles to the same element must not be copied or destroyed
+ *  concurrently. Matrices never share elements between threads, worker
+ *  threads only see raw pointers from ElementarySquareMatrix::block().
+ *
+ *  \tparam T Element type.
+ */
+template <typename T>
+class ElementPtr
+{
+    public:
+        /** \brief Constructor with no parameters. Creates a null handle.
+         */
+        ElementPtr() : p(nullptr) {};
+
+        /** \brief Creates a null handle.
+         */
+        ElementPtr(std::nullptr_t) : p(nullptr) {};
+
+        /** \brief Takes ownership of e.
+         *  \param e Pointer to an element allocated with new,
+         *         or by make_element().
+         */
+        explicit ElementPtr(T* e) : p(e)
+        {
+            if(p) p->refs += element_ref_one;
+        };
+
+        /** \brief Copy constructor.
+         *  \param e Reference to ElementPtr<T>.
+         */
+        ElementPtr(const ElementPtr<T>& e) : p(e.p)
+        {
+            if(p) p->refs += element_ref_one;
+        };
+
+        /** \brief Converting copy constructor, e.g. from
+         *         ElementPtr<IntElement> to ElementPtr<Element>.
+         *  \param e Reference to ElementPtr<U>.
+         */
+        template <typename U>
+        ElementPtr(const ElementPtr<U>& e) : p(e.get())
+        {
+            if(p) p->refs += element_ref_one;
+        };
+
+        /** \brief Move constructor.
+         *  \param e Rvalue reference to ElementPtr<T>.
+         */
+        ElementPtr(ElementPtr<T>&& e) : p(e.p)
+        {
+            e.p = nullptr;
+        };
+
+        /** \brief Converting move constructor.
+         *  \param e Rvalue reference to ElementPtr<U>.
+         */
+        template <typename U>
+        ElementPtr(ElementPtr<U>&& e) : p(e.release())
+        {};
+
+        /** \brief Drops the reference.
+         */
+        ~ElementPtr()
+        {
+            reset();
+        };
+
+        /** \brief operator= overload (copy assignment).
+         *  \param e Reference to ElementPtr<T>.
+         *  \return Reference to ElementPtr<T>.
+         */
+        ElementPtr<T>& operator=(const ElementPtr<T>& e)
+        {
+            ElementPtr<T>{e}.swap(*this);
+            return *this;
+        };
+
+        /** \brief operator= overload (move assignment).
+         *  \param e Rvalue reference to ElementPtr<T>.
+         *  \return Reference to ElementPtr<T>.
+         */
+        ElementPtr<T>& operator=(ElementPtr<T>&& e)
+        {
+            ElementPtr<T>{std::move(e)}.swap(*this);
+            return *this;
+        };
+
+        /** \brief Drops the reference and makes this a null handle.
+         */
+        void reset()
+        {
+            if(p)
+            {
+                p->refs -= element_ref_one;
+                if(p->refs < element_ref_one) release_element(p);
+                p = nullptr;
+            }
+        };
+
+        /** \brief Swaps the pointers of two handles.
+         *  \param e Reference to ElementPtr<T>.
+         */
+        void swap(ElementPtr<T>& e)
+        {
+            std::swap(p, e.p);
+        };
+
+        /** \brief Gives up the reference without dropping it.
+         *  \return The pointer, ownership moves to the caller.
+         */
+        T* release()
+        {
+            T* ret = p;
+            p = nullptr;
+            return ret;
+        };
+
+        /** \brief Returns the pointer.
+         *  \return T pointer.
+         */
+        T* get() const {return p;};
+
+        T& operator*() const {return *p;};
+        T* operator->() const {return p;};
+        explicit operator bool() const {return p != nullptr;};
+
+        /** \brief Get the number of handles to the element.
+         *  \return Reference count, 0 for a null handle.
+         */
+        unsigned int useCount() const
+        {
+            return p ? p->refs / element_ref_one : 0;
+        };
+
+    private:
+        T* p;
+
+        template <typename U>
+        friend class ElementPtr;
+};
+
+template <typename T, typename U>
+bool operator==(const ElementPtr<T>& e1, const ElementPtr<U>& e2)
+{
+    return e1.get() == e2.get();
+}
+
+template <typename T, typename U>
+bool operator!=(const ElementPtr<T>& e1, const ElementPtr<U>& e2)
+{
+    return e1.get() != e2.get();
+}
+
+#endif // ELEMENTPTR_H
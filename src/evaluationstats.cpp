@@ -0,0 +1,212 @@
+/** \file evaluationstats.cpp
+ *  \brief Evaluation statistics implementation file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "evaluationstats.hpp"
+#ifdef SQM_TESTS
+#include "compositesquarematrix.hpp"
+#include "catch.hpp"
+#endif
+
+static thread_local EvaluationProfile* current_profile = nullptr;
+
+EvaluationProfile::EvaluationProfile() : depth(0), threads(1) {}
+
+std::size_t EvaluationProfile::enterNode(char op, unsigned int n)
+{
+    nodes.push_back(NodeTiming{op, n, depth++, 0, 0});
+    starts.push_back(std::chrono::steady_clock::now());
+    return nodes.size() - 1;
+}
+
+void EvaluationProfile::leaveNode(std::size_t node, std::uint64_t self_ns)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - starts[node];
+    nodes[node].total_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    nodes[node].self_ns = self_ns;
+    depth--;
+}
+
+const std::vector<NodeTiming>& EvaluationProfile::getNodes() const
+{
+    return nodes;
+}
+
+unsigned int EvaluationProfile::getThreads() const
+{
+    return threads;
+}
+
+void EvaluationProfile::noteThreads(unsigned int threads)
+{
+    if(current_profile != nullptr)
+    {
+        current_profile->threads = std::max(current_profile->threads, threads);
+    }
+}
+
+EvaluationProfile* EvaluationProfile::current()
+{
+    return current_profile;
+}
+
+EvaluationProfileScope::EvaluationProfileScope(EvaluationProfile& profile) :
+    previous(current_profile)
+{
+    current_profile = &profile;
+}
+
+EvaluationProfileScope::~EvaluationProfileScope()
+{
+    current_profile = previous;
+}
+
+/* Values below 16 have a bucket each, larger ones eight buckets per
+ * power of two from 16 up. */
+static const unsigned int exact_buckets = 16;
+static const unsigned int sub_buckets = 8;
+static const unsigned int bucket_count = exact_buckets + (64 - 4) * sub_buckets;
+
+static unsigned int bucket_index(std::uint64_t v)
+{
+    if(v < exact_buckets) return static_cast<unsigned int>(v);
+
+    unsigned int e = 63;
+    while((v >> e) == 0) e--;
+    const unsigned int sub = static_cast<unsigned int>(v >> (e - 3)) & (sub_buckets - 1);
+    return exact_buckets + (e - 4) * sub_buckets + sub;
+}
+
+/* Largest value that falls in bucket i. */
+static std::uint64_t bucket_upper(unsigned int i)
+{
+    if(i < exact_buckets) return i;
+
+    const unsigned int e = (i - exact_buckets) / sub_buckets + 4;
+    const std::uint64_t sub = (i - exact_buckets) % sub_buckets;
+    const std::uint64_t width = std::uint64_t{1} << (e - 3);
+    return (sub_buckets + sub) * width + width - 1;
+}
+
+LatencyHistogram::LatencyHistogram() : buckets(bucket_count, 0), count(0), max(0) {}
+
+void LatencyHistogram::record(std::uint64_t ns)
+{
+    buckets[bucket_index(ns)]++;
+    count++;
+    max = std::max(max, ns);
+}
+
+std::uint64_t LatencyHistogram::getCount() const
+{
+    return count;
+}
+
+std::uint64_t LatencyHistogram::getMax() const
+{
+    return max;
+}
+
+std::uint64_t LatencyHistogram::percentile(double p) const
+{
+    if(count == 0) return 0;
+
+    const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+        std::ceil(std::min(std::max(p, 0.0), 1.0) * count)));
+
+    std::uint64_t seen = 0;
+    for(unsigned int i = 0; i < bucket_count; i++)
+    {
+        seen += buckets[i];
+        if(seen >= rank) return std::min(bucket_upper(i), max);
+    }
+    return max;
+}
+
+std::string format_duration(double ns)
+{
+    char buf[32];
+    if(ns < 1e3) std::snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    else if(ns < 1e6) std::snprintf(buf, sizeof(buf), "%.3g us", ns / 1e3);
+    else if(ns < 1e9) std::snprintf(buf, sizeof(buf), "%.3g ms", ns / 1e6);
+    else std::snprintf(buf, sizeof(buf), "%.3g s", ns / 1e9);
+    return buf;
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("LatencyHistogram percentiles.", "[LatencyHistogram][stats]")
+{
+    LatencyHistogram h;
+    CHECK(h.percentile(0.5) == 0);
+
+    for(std::uint64_t v = 1; v <= 1000; v++) h.record(v * 1000);
+    CHECK(h.getCount() == 1000);
+    CHECK(h.getMax() == 1000000);
+
+    /* Within one bucket of the exact value. */
+    const std::uint64_t p50 = h.percentile(0.5);
+    CHECK(p50 >= 500000);
+    CHECK(p50 <= 500000 * 9 / 8);
+    const std::uint64_t p99 = h.percentile(0.99);
+    CHECK(p99 >= 990000);
+    CHECK(p99 <= 1000000);
+    CHECK(h.percentile(1.0) == 1000000);
+
+    LatencyHistogram small;
+    small.record(3);
+    small.record(7);
+    CHECK(small.percentile(0.5) == 3);
+    CHECK(small.percentile(0.99) == 7);
+
+    LatencyHistogram huge;
+    huge.record(UINT64_MAX);
+    CHECK(huge.percentile(0.5) == UINT64_MAX);
+
+    CHECK(format_duration(850) == "850 ns");
+    CHECK(format_duration(12345) == "12.3 us");
+    CHECK(format_duration(4.56e6) == "4.56 ms");
+    CHECK(format_duration(1.234e9) == "1.23 s");
+}
+
+TEST_CASE("EvaluationProfile times composite nodes.", "[EvaluationProfile][stats]")
+{
+    ConcreteSquareMatrix a{"[[1,2][3,4]]"};
+    auto add = [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+               { return m1 + m2; };
+    CompositeSquareMatrix inner{a, a, add, '+'};
+    CompositeSquareMatrix outer{inner, a,
+        [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+        {
+            return m1 * m2;
+        },
+        '*'};
+
+    CHECK(EvaluationProfile::current() == nullptr);
+    EvaluationProfile profile;
+    {
+        EvaluationProfileScope scope{profile};
+        CHECK(EvaluationProfile::current() == &profile);
+        CHECK(outer.evaluate(Valuation{}).toString() == "[[14,20][30,44]]");
+        EvaluationProfile::noteThreads(3);
+    }
+    CHECK(EvaluationProfile::current() == nullptr);
+    EvaluationProfile::noteThreads(5);
+
+    const std::vector<NodeTiming>& nodes = profile.getNodes();
+    REQUIRE(nodes.size() == 2);
+    CHECK(nodes[0].op == '*');
+    CHECK(nodes[0].depth == 0);
+    CHECK(nodes[0].n == 2);
+    CHECK(nodes[1].op == '+');
+    CHECK(nodes[1].depth == 1);
+    CHECK(nodes[0].total_ns >= nodes[1].total_ns);
+    CHECK(nodes[0].total_ns >= nodes[0].self_ns);
+    CHECK(profile.getThreads() == 3);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,157 @@
+/** \file evaluationstats.hpp
+ *  \brief Timing of matrix evaluations: EvaluationProfile and
+ *         LatencyHistogram.
+ */
+
+#ifndef EVALUATIONSTATS_H
+#define EVALUATIONSTATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** \struct NodeTiming
+ *  \brief Time spent in one CompositeSquareMatrix of an evaluation.
+ */
+struct NodeTiming
+{
+    /** \brief Operator character of the node. */
+    char op;
+    /** \brief Row size of the node. */
+    unsigned int n;
+    /** \brief Depth in the expression, 0 for the root. */
+    unsigned int depth;
+    /** \brief Nanoseconds from entering the node to its result. */
+    std::uint64_t total_ns;
+    /** \brief Nanoseconds in the operator itself, without the operands. */
+    std::uint64_t self_ns;
+};
+
+/** \class EvaluationProfile
+ *  \brief Collects the NodeTiming of every CompositeSquareMatrix evaluated
+ *         while it is current, and the most threads an operation used.
+ *
+ *  Nodes are stored in the order they are entered, so a node is followed
+ *  by the nodes of its operands.
+ */
+class EvaluationProfile
+{
+    public:
+        /** \brief Default constructor.
+         */
+        EvaluationProfile();
+
+        /** \brief Starts timing a node.
+         *  \param op Operator character.
+         *  \param n Row size.
+         *  \return Index of the node for leaveNode().
+         */
+        std::size_t enterNode(char op, unsigned int n);
+
+        /** \brief Finishes timing a node.
+         *  \param node Index from enterNode().
+         *  \param self_ns Nanoseconds spent in the operator.
+         */
+        void leaveNode(std::size_t node, std::uint64_t self_ns);
+
+        /** \brief Get the timed nodes.
+         *  \return Reference to member nodes.
+         */
+        const std::vector<NodeTiming>& getNodes() const;
+
+        /** \brief Get the most threads an operation used.
+         *  \return Thread count, at least 1.
+         */
+        unsigned int getThreads() const;
+
+        /** \brief Records that an operation ran on threads threads, if
+         *         the calling thread has a current profile.
+         *  \param threads Number of threads.
+         */
+        static void noteThreads(unsigned int threads);
+
+        /** \brief Returns the profile of the innermost
+         *         EvaluationProfileScope of the calling thread.
+         *  \return Pointer to the profile, nullptr if there is none.
+         */
+        static EvaluationProfile* current();
+
+    private:
+        std::vector<NodeTiming> nodes;
+        std::vector<std::chrono::steady_clock::time_point> starts;
+        unsigned int depth;
+        unsigned int threads;
+};
+
+/** \class EvaluationProfileScope
+ *  \brief Makes an EvaluationProfile current for the calling thread
+ *         until the end of the scope.
+ */
+class EvaluationProfileScope
+{
+    public:
+        /** \brief Makes profile current.
+         *  \param profile Profile to make current.
+         */
+        explicit EvaluationProfileScope(EvaluationProfile& profile);
+
+        /** \brief Restores the previously current profile.
+         */
+        ~EvaluationProfileScope();
+
+        EvaluationProfileScope(const EvaluationProfileScope&) = delete;
+        EvaluationProfileScope& operator=(const EvaluationProfileScope&) = delete;
+
+    private:
+        EvaluationProfile* previous;
+};
+
+/** \class LatencyHistogram
+ *  \brief Histogram of durations in logarithmic buckets, eight per
+ *         power of two, so percentiles are within 12.5 % in fixed memory.
+ */
+class LatencyHistogram
+{
+    public:
+        /** \brief Default constructor.
+         */
+        LatencyHistogram();
+
+        /** \brief Adds a duration.
+         *  \param ns Duration in nanoseconds.
+         */
+        void record(std::uint64_t ns);
+
+        /** \brief Get the number of durations added.
+         *  \return Count.
+         */
+        std::uint64_t getCount() const;
+
+        /** \brief Get the longest duration added.
+         *  \return Nanoseconds, 0 if empty.
+         */
+        std::uint64_t getMax() const;
+
+        /** \brief Duration that a share p of the durations do not exceed,
+         *         rounded up to its bucket.
+         *  \param p Share in [0, 1], 0.99 for p99.
+         *  \return Nanoseconds, at most getMax(), 0 if empty.
+         */
+        std::uint64_t percentile(double p) const;
+
+    private:
+        std::vector<std::uint64_t> buckets;
+        std::uint64_t count;
+        std::uint64_t max;
+};
+
+/** \brief Formats a duration with a unit that keeps it short,
+ *         "850 ns", "12.3 us", "4.56 ms" or "1.23 s".
+ *  \param ns Duration in nanoseconds.
+ *  \return Formatted duration.
+ */
+std::string format_duration(double ns);
+
+#endif // EVALUATIONSTATS_H
@@ -0,0 +1,283 @@
+/** \file executiontrace.cpp
+ *  \brief Execution tracing implementation file.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include "executiontrace.hpp"
+#ifdef SQM_TESTS
+#include <thread>
+#include "compositesquarematrix.hpp"
+#include "kernelconfig.hpp"
+#include "threadconfig.hpp"
+#include "catch.hpp"
+#endif
+
+/* A slot is a seqlock: seq is odd while the event is written
+ * and 2 * (index + 1) once event holds the event of that index. */
+struct TraceSlot
+{
+    std::atomic<std::uint64_t> seq;
+    TraceEvent event;
+};
+
+static const std::uint64_t not_traced = std::numeric_limits<std::uint64_t>::max();
+
+static const std::chrono::steady_clock::time_point trace_epoch =
+    std::chrono::steady_clock::now();
+
+static std::atomic<bool> trace_on{false};
+static std::atomic<std::uint64_t> trace_head{0};
+static std::atomic<std::uint32_t> trace_threads{0};
+static std::mutex trace_mtx;
+/* Allocated when tracing is first turned on, never freed. */
+static TraceSlot* trace_slots = nullptr;
+
+static thread_local std::uint32_t trace_thread =
+    std::numeric_limits<std::uint32_t>::max();
+
+static std::uint64_t trace_now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<
+        std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count());
+}
+
+static void record_event(const char* name, std::uint64_t start_ns,
+                         std::uint64_t end_ns, std::uint64_t arg)
+{
+    if(trace_thread == std::numeric_limits<std::uint32_t>::max())
+    {
+        trace_thread = trace_threads++;
+    }
+
+    const std::uint64_t i = trace_head.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot& slot = trace_slots[i & (trace_capacity - 1)];
+
+    slot.seq.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event.name = name;
+    slot.event.thread = trace_thread;
+    slot.event.start_ns = start_ns;
+    slot.event.duration_ns = end_ns - start_ns;
+    slot.event.arg = arg;
+    slot.seq.store(2 * i + 2, std::memory_order_release);
+}
+
+void set_tracing(bool on)
+{
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    if(on && trace_slots == nullptr)
+    {
+        trace_slots = new TraceSlot[trace_capacity];
+        for(std::size_t i = 0; i < trace_capacity; i++) trace_slots[i].seq = 0;
+    }
+    trace_on.store(on, std::memory_order_release);
+}
+
+bool tracing_enabled()
+{
+    return trace_on.load(std::memory_order_acquire);
+}
+
+void clear_trace()
+{
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    if(trace_slots != nullptr)
+    {
+        for(std::size_t i = 0; i < trace_capacity; i++) trace_slots[i].seq = 0;
+    }
+    trace_head = 0;
+}
+
+std::vector<TraceEvent> trace_events()
+{
+    std::vector<TraceEvent> ret;
+    std::lock_guard<std::mutex> lock(trace_mtx);
+    if(trace_slots == nullptr) return ret;
+
+    const std::uint64_t head = trace_head.load(std::memory_order_acquire);
+    const std::uint64_t first = head > trace_capacity ? head - trace_capacity : 0;
+    ret.reserve(static_cast<std::size_t>(head - first));
+
+    for(std::uint64_t i = first; i < head; i++)
+    {
+        const TraceSlot& slot = trace_slots[i & (trace_capacity - 1)];
+        const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if(seq != 2 * i + 2) continue;
+
+        const TraceEvent e = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.seq.load(std::memory_order_relaxed) == seq) ret.push_back(e);
+    }
+
+    std::stable_sort(ret.begin(), ret.end(), [](const TraceEvent& a, const TraceEvent& b)
+        { return a.start_ns < b.start_ns; });
+    return ret;
+}
+
+std::uint64_t trace_dropped()
+{
+    const std::uint64_t head = trace_head.load();
+    return head > trace_capacity ? head - trace_capacity : 0;
+}
+
+std::size_t write_chrome_trace(std::ostream& os)
+{
+    const std::vector<TraceEvent> events = trace_events();
+
+    std::set<std::uint32_t> threads;
+    for(const auto& e : events) threads.insert(e.thread);
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    for(std::uint32_t t : threads)
+    {
+        ss << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+           << "\"tid\":" << t << ",\"args\":{\"name\":\"thread " << t << "\"}}";
+        first = false;
+    }
+
+    /* Chrome trace times are in microseconds. */
+    for(const auto& e : events)
+    {
+        ss << (first ? "" : ",") << "\n{\"name\":\"" << e.name
+           << "\",\"cat\":\"sqm\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+           << ",\"ts\":" << e.start_ns / 1e3 << ",\"dur\":" << e.duration_ns / 1e3
+           << ",\"args\":{\"arg\":" << e.arg << "}}";
+        first = false;
+    }
+    ss << "\n]}\n";
+
+    os << ss.str();
+    return events.size();
+}
+
+TraceSpan::TraceSpan(const char* new_name, std::uint64_t new_arg) :
+    name(new_name), arg(new_arg),
+    start_ns(tracing_enabled() ? trace_now() : not_traced) {}
+
+TraceSpan::~TraceSpan()
+{
+    if(start_ns != not_traced) record_event(name, start_ns, trace_now(), arg);
+}
+
+#ifdef SQM_TESTS
+
+static std::size_t count_events(const std::vector<TraceEvent>& events,
+                                const std::string& name)
+{
+    return std::count_if(events.begin(), events.end(),
+        [&name](const TraceEvent& e) { return name == e.name; });
+}
+
+TEST_CASE("Tracing records spans per thread.", "[trace]")
+{
+    clear_trace();
+    {
+        TraceSpan span{"off"};
+    }
+
+    set_tracing(true);
+    CHECK(tracing_enabled());
+    {
+        TraceSpan outer{"outer", 7};
+        TraceSpan inner{"inner"};
+    }
+    std::thread t{[]{ TraceSpan span{"other"}; }};
+    t.join();
+    set_tracing(false);
+    {
+        TraceSpan span{"off"};
+    }
+
+    const std::vector<TraceEvent> events = trace_events();
+    REQUIRE(events.size() == 3);
+    CHECK(count_events(events, "off") == 0);
+    CHECK(std::string{events[0].name} == "outer");
+    CHECK(events[0].arg == 7);
+    CHECK(std::string{events[1].name} == "inner");
+    CHECK(events[0].start_ns <= events[1].start_ns);
+    CHECK(events[0].duration_ns >= events[1].duration_ns);
+    CHECK(events[0].thread == events[1].thread);
+    CHECK(events[2].thread != events[0].thread);
+
+    std::ostringstream os;
+    CHECK(write_chrome_trace(os) == 3);
+    const std::string json = os.str();
+    CHECK(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+    CHECK(json.find("\"name\":\"outer\",\"cat\":\"sqm\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"ph\":\"M\"") != std::string::npos);
+
+    /* Oldest events are overwritten when the buffer is full. */
+    clear_trace();
+    set_tracing(true);
+    for(std::size_t i = 0; i < trace_capacity + 5; i++) TraceSpan span{"fill", i};
+    set_tracing(false);
+    const std::vector<TraceEvent> filled = trace_events();
+    CHECK(filled.size() == trace_capacity);
+    CHECK(trace_dropped() == 5);
+    CHECK(filled.front().arg == 5);
+    clear_trace();
+    CHECK(trace_events().empty());
+}
+
+TEST_CASE("Tracing of matrix operations.", "[trace]")
+{
+    ConcreteSquareMatrix a{64};
+    ConcreteSquareMatrix b{64};
+    CompositeSquareMatrix sum{a, b,
+        [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+        {
+            return m1 + m2;
+        },
+        '+'};
+
+    /* Tasks are only traced in parallel mode. */
+    const KernelConfig previous = kernel_config();
+    const unsigned int threads = thread_count();
+    KernelConfig parallel;
+    parallel.elementwise_parallel_min = 0;
+    set_kernel_config(parallel);
+    set_thread_count(2);
+
+    clear_trace();
+    set_tracing(true);
+    const ConcreteSquareMatrix result = sum.evaluate(Valuation{});
+    set_tracing(false);
+    set_thread_count(threads);
+    set_kernel_config(previous);
+    CHECK(result == a + b);
+
+    const std::vector<TraceEvent> events = trace_events();
+    CHECK(count_events(events, "evaluate +") == 1);
+    CHECK(count_events(events, "task") >= 1);
+    CHECK(count_events(events, "block compute") >= 1);
+    CHECK(count_events(events, "barrier wait") >= 1);
+
+    /* Products write the elements back after the parallel bands. */
+    parallel.multiply_parallel_min = 0;
+    set_kernel_config(parallel);
+    set_thread_count(2);
+    clear_trace();
+    set_tracing(true);
+    const ConcreteSquareMatrix product = a * b;
+    set_tracing(false);
+    set_thread_count(threads);
+    set_kernel_config(previous);
+
+    const std::vector<TraceEvent> product_events = trace_events();
+    CHECK(count_events(product_events, "block compute") >= 1);
+    CHECK(count_events(product_events, "writeback") == 1);
+    clear_trace();
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,95 @@
+/** \file executiontrace.hpp
+ *  \brief Execution tracing. Spans of parallel work are recorded per
+ *         thread into a lock-free ring buffer and written as Chrome trace
+ *         JSON, which chrome://tracing and Perfetto open.
+ */
+
+#ifndef EXECUTIONTRACE_H
+#define EXECUTIONTRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/** \brief Number of events the ring buffer holds. When it is full the
+ *         oldest events are overwritten.
+ */
+const std::size_t trace_capacity = std::size_t{1} << 16;
+
+/** \struct TraceEvent
+ *  \brief One finished span.
+ */
+struct TraceEvent
+{
+    /** \brief Name of the span, a string literal. */
+    const char* name;
+    /** \brief Small id of the recording thread, from 0. */
+    std::uint32_t thread;
+    /** \brief Start in nanoseconds since the first trace clock read. */
+    std::uint64_t start_ns;
+    /** \brief Duration in nanoseconds. */
+    std::uint64_t duration_ns;
+    /** \brief Argument of the span, such as a block index or row size. */
+    std::uint64_t arg;
+};
+
+/** \brief Turns tracing on or off. Spans started while tracing is off
+ *         are not recorded.
+ *  \param on true to record spans.
+ */
+void set_tracing(bool on);
+
+/** \brief Tells if spans are recorded.
+ *  \return true if tracing is on.
+ */
+bool tracing_enabled();
+
+/** \brief Discards all recorded events. Must not run while spans finish.
+ */
+void clear_trace();
+
+/** \brief Returns the recorded events, oldest first. Events that are
+ *         still being written are skipped.
+ *  \return Recorded events.
+ */
+std::vector<TraceEvent> trace_events();
+
+/** \brief Get the number of events overwritten since the last clear.
+ *  \return Number of lost events.
+ */
+std::uint64_t trace_dropped();
+
+/** \brief Writes the recorded events as Chrome trace JSON.
+ *  \param os Stream to write to.
+ *  \return Number of events written.
+ */
+std::size_t write_chrome_trace(std::ostream& os);
+
+/** \class TraceSpan
+ *  \brief Records the lifetime of the object as a span of the calling
+ *         thread, if tracing was on when it was constructed.
+ */
+class TraceSpan
+{
+    public:
+        /** \brief Starts the span.
+         *  \param new_name Name of the span, a string literal.
+         *  \param new_arg Argument of the span.
+         */
+        explicit TraceSpan(const char* new_name, std::uint64_t new_arg = 0);
+
+        /** \brief Ends and records the span.
+         */
+        ~TraceSpan();
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        const char* name;
+        std::uint64_t arg;
+        std::uint64_t start_ns;
+};
+
+#endif // EXECUTIONTRACE_H
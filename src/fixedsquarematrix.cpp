@@ -0,0 +1,154 @@
+/** \file fixedsquarematrix.cpp
+ *  \brief FixedSquareMatrix implementation file.
+ */
+
+#include <sstream>
+#include "fixedsquarematrix.hpp"
+#include "compositesquarematrix.hpp"
+#include "matrixparser.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+template <unsigned int N>
+static std::unique_ptr<SquareMatrix> make_fixed(const std::vector<int>& values)
+{
+    FixedSquareMatrix<int, N> m;
+    for(unsigned int i = 0; i < N; i++)
+    {
+        for(unsigned int j = 0; j < N; j++)
+        {
+            m.set(i, j, values[i * N + j]);
+        }
+    }
+
+    return std::unique_ptr<SquareMatrix>{new FixedConcreteSquareMatrix<N>{m}};
+}
+
+struct MakeFixed
+{
+    const std::vector<int>& values;
+    std::unique_ptr<SquareMatrix> ret;
+
+    template <unsigned int N>
+    void apply() {ret = make_fixed<N>(values);}
+};
+
+std::unique_ptr<SquareMatrix> makeConcreteSquareMatrix(const std::string& str_m)
+{
+    unsigned int n = 0;
+    std::vector<int> values;
+    const char* err = parse_concrete(
+        str_m.data(), str_m.data() + str_m.size(), n, values);
+
+    if(err != nullptr)
+    {
+        throw std::invalid_argument(err);
+    }
+
+    return makeConcreteSquareMatrix(n, values);
+}
+
+std::unique_ptr<SquareMatrix> makeConcreteSquareMatrix(
+    unsigned int n, const std::vector<int>& values)
+{
+    if(values.size() != static_cast<std::size_t>(n) * n)
+    {
+        throw std::invalid_argument("Not a squarematrix (invalid n).");
+    }
+
+    MakeFixed make{values, nullptr};
+    if(fixed_dispatch(n, make)) return std::move(make.ret);
+
+    return std::unique_ptr<SquareMatrix>{new ConcreteSquareMatrix{n, values}};
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("FixedSquareMatrix compile-time operations.",
+          "[FixedSquareMatrix][constexpr][math]")
+{
+    constexpr FixedSquareMatrix<int, 2> m1{1, 2, 3, 4};
+    constexpr FixedSquareMatrix<int, 2> m2{2, 2, 2, 2};
+
+    static_assert((m1 + m2) == FixedSquareMatrix<int, 2>{3, 4, 5, 6}, "+");
+    static_assert((m1 - m2) == FixedSquareMatrix<int, 2>{-1, 0, 1, 2}, "-");
+    static_assert((m1 * m1) == FixedSquareMatrix<int, 2>{7, 10, 15, 22}, "*");
+    static_assert(m1.transpose() == FixedSquareMatrix<int, 2>{1, 3, 2, 4}, "T");
+    static_assert((m1 / m1) == m1 * m1.transpose(), "/");
+    static_assert(m1 != m2, "!=");
+    static_assert(m1.at(1, 0) == 3, "at");
+
+    constexpr FixedSquareMatrix<int, 3> m3{1, 2, 3, 4, 5, 6, 7, 8, 9};
+    CHECK((m3 * m3).toString() == "[[30,36,42][66,81,96][102,126,150]]");
+    CHECK((m3 / m3).toString() == "[[14,32,50][32,77,122][50,122,194]]");
+    CHECK(m3.transpose().toString() == "[[1,4,7][2,5,8][3,6,9]]");
+
+    FixedSquareMatrix<int, 3> m4{};
+    CHECK(m4.toString() == "[[0,0,0][0,0,0][0,0,0]]");
+    m4.set(2, 1, -5);
+    CHECK(m4.at(2, 1) == -5);
+}
+
+TEST_CASE("FixedSquareMatrix conversions.",
+          "[FixedSquareMatrix][ConcreteSquareMatrix][conversion][exception]")
+{
+    ConcreteSquareMatrix conc{"[[1,2,3,4][5,6,7,8][9,10,11,12][13,14,15,16]]"};
+    auto fixed = FixedSquareMatrix<int, 4>::fromConcrete(conc);
+
+    CHECK(fixed.toString() == conc.toString());
+    CHECK(fixed.toConcrete() == conc);
+    CHECK((fixed * fixed).toConcrete() == conc * conc);
+    CHECK((fixed / fixed).toConcrete() == conc / conc);
+
+    ConcreteSquareMatrix zero{"[[0,0,0,0][0,0,0,0][0,0,0,0][0,0,0,0]]"};
+    fixed.assignTo(zero);
+    CHECK(zero == conc);
+
+    using Fixed3 = FixedSquareMatrix<int, 3>;
+    CHECK_THROWS(Fixed3::fromConcrete(conc));
+    CHECK_THROWS(Fixed3{}.assignTo(conc));
+}
+
+TEST_CASE("Small matrices are parsed to FixedConcreteSquareMatrix.",
+          "[FixedSquareMatrix][SquareMatrix][constructor][exception]")
+{
+    std::stringstream ss;
+    auto small = makeConcreteSquareMatrix("[[1,2][3,4]]");
+    auto large = makeConcreteSquareMatrix(
+        "[[1,2,3,4,5][1,2,3,4,5][1,2,3,4,5][1,2,3,4,5][1,2,3,4,5]]");
+
+    CHECK(dynamic_cast<FixedConcreteSquareMatrix<2>*>(small.get()) != nullptr);
+    CHECK(dynamic_cast<ConcreteSquareMatrix*>(large.get()) != nullptr);
+
+    const std::vector<int> largest(max_fixed_n * max_fixed_n, 1);
+    const std::vector<int> next((max_fixed_n + 1) * (max_fixed_n + 1), 1);
+    CHECK(dynamic_cast<FixedConcreteSquareMatrix<max_fixed_n>*>(
+        makeConcreteSquareMatrix(max_fixed_n, largest).get()) != nullptr);
+    CHECK(dynamic_cast<ConcreteSquareMatrix*>(
+        makeConcreteSquareMatrix(max_fixed_n + 1, next).get()) != nullptr);
+
+    CHECK(small->getRowSize() == 2);
+    CHECK(small->toString() == "[[1,2][3,4]]");
+    small->print(ss);
+    CHECK(ss.str() == "[[1,2][3,4]]");
+    CHECK(small->evaluate(Valuation{}) == ConcreteSquareMatrix{"[[1,2][3,4]]"});
+
+    std::unique_ptr<SquareMatrix> clone{small->clone()};
+    CHECK(clone->toString() == small->toString());
+
+    CompositeSquareMatrix csm{
+        *small,
+        SymbolicSquareMatrix{"[[a,0][0,a]]"},
+        [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+        {
+            return m1 * m2;
+        },
+        '*'};
+    CHECK(csm.evaluate(Valuation{{'a', 2}}).toString() == "[[2,4][6,8]]");
+
+    CHECK_THROWS(makeConcreteSquareMatrix("[[1,2][3,4]"));
+    CHECK_THROWS(makeConcreteSquareMatrix("[[a,2][3,4]]"));
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,443 @@
+/** \file fixedsquarematrix.hpp
+ *  \brief FixedSquareMatrix header file.
+ */
+
+#ifndef FIXEDSQUAREMATRIX_H
+#define FIXEDSQUAREMATRIX_H
+
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "squarematrix.hpp"
+
+/** \brief Largest row size that is stored in a FixedSquareMatrix
+ *         when parsing matrices with makeConcreteSquareMatrix().
+ */
+const unsigned int max_fixed_n = 4;
+
+/** \brief End of fixed_dispatch(), n is bigger than max_fixed_n.
+ *  \return false.
+ */
+template <unsigned int N = 1, typename Func>
+typename std::enable_if<(N > max_fixed_n), bool>::type
+    fixed_dispatch(unsigned int, Func&)
+{
+    return false;
+}
+
+/** \brief Calls func.template apply<n>() if n is a row size stored in a
+ *         FixedSquareMatrix, 1 to max_fixed_n.
+ *  \param n Row size.
+ *  \param func Object with a member template apply<N>().
+ *  \return true if func was called, else false.
+ */
+template <unsigned int N = 1, typename Func>
+typename std::enable_if<(N <= max_fixed_n), bool>::type
+    fixed_dispatch(unsigned int n, Func& func)
+{
+    if(n == N)
+    {
+        func.template apply<N>();
+        return true;
+    }
+    return fixed_dispatch<N + 1>(n, func);
+}
+
+/** \struct IndexList
+ *  \brief Compile-time list of indices, used to unroll loops.
+ */
+template <unsigned int... Is>
+struct IndexList {};
+
+/** \struct MakeIndexList
+ *  \brief Builds IndexList<0, 1, ..., K-1>.
+ */
+template <unsigned int K, unsigned int... Is>
+struct MakeIndexList : MakeIndexList<K - 1, K - 1, Is...> {};
+
+template <unsigned int... Is>
+struct MakeIndexList<0, Is...>
+{
+    using type = IndexList<Is...>;
+};
+
+/** \brief Sum of a single value.
+ */
+template <typename T>
+constexpr T fixed_sum(T t)
+{
+    return t;
+}
+
+/** \brief Sum of all parameters, unrolled at compile time.
+ */
+template <typename T, typename... Ts>
+constexpr T fixed_sum(T t, Ts... ts)
+{
+    return t + fixed_sum(ts...);
+}
+
+/** \class FixedSquareMatrix<T, N>
+ *  \brief N*N square matrix with stack storage.
+ *
+ *  A literal type, so every operation can be evaluated at compile time.
+ *  All element-wise loops are unrolled with IndexList.
+ *
+ *  \tparam T Contained type.
+ *  \tparam N Row/column count.
+ */
+template <typename T, unsigned int N>
+class FixedSquareMatrix
+{
+    static_assert(N > 0, "FixedSquareMatrix must have at least one element.");
+
+    using Indices = typename MakeIndexList<N * N>::type;
+    using RowIndices = typename MakeIndexList<N>::type;
+
+    public:
+        /** \brief Constructor with no parameters.
+         *         All elements are initialized to T{}.
+         */
+        constexpr FixedSquareMatrix() : e{} {};
+
+        /** \brief Parametrized constructor.
+         *  \param t First element.
+         *  \param ts Rest of the elements in row-major order.
+         */
+        template <typename... Ts>
+        constexpr FixedSquareMatrix(T t, Ts... ts) :
+            e{t, static_cast<T>(ts)...}
+        {
+            static_assert(sizeof...(Ts) + 1 == N * N,
+                          "Element count does not match N*N.");
+        };
+
+        /** \brief Get row size of the matrix.
+         *  \return N.
+         */
+        constexpr unsigned int getRowSize() const
+        {
+            return N;
+        };
+
+        /** \brief Element accessor.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \return Element at (i),(j).
+         */
+        constexpr T at(unsigned int i, unsigned int j) const
+        {
+            return e[i * N + j];
+        };
+
+        /** \brief Element mutator.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \param t New value for the element.
+         */
+        void set(unsigned int i, unsigned int j, T t)
+        {
+            e[i * N + j] = t;
+        };
+
+        /** \brief Returns transpose of the matrix.
+         *  \return Transposed FixedSquareMatrix<T, N>.
+         */
+        constexpr FixedSquareMatrix<T, N> transpose() const
+        {
+            return transpose(Indices{});
+        };
+
+        /** \brief operator== overload.
+         *  \return true if equal, else false.
+         */
+        constexpr bool operator==(const FixedSquareMatrix<T, N>& m) const
+        {
+            return equals(m, 0);
+        };
+
+        /** \brief operator!= overload.
+         *  \return true if not equal, else false.
+         */
+        constexpr bool operator!=(const FixedSquareMatrix<T, N>& m) const
+        {
+            return !(*this == m);
+        };
+
+        /** \brief operator+ overload.
+         *  \param m Reference to FixedSquareMatrix<T, N>.
+         *  \return Element-wise sum.
+         */
+        constexpr FixedSquareMatrix<T, N>
+            operator+(const FixedSquareMatrix<T, N>& m) const
+        {
+            return add(m, Indices{});
+        };
+
+        /** \brief operator- overload.
+         *  \param m Reference to FixedSquareMatrix<T, N>.
+         *  \return Element-wise difference.
+         */
+        constexpr FixedSquareMatrix<T, N>
+            operator-(const FixedSquareMatrix<T, N>& m) const
+        {
+            return subtract(m, Indices{});
+        };
+
+        /** \brief operator* overload.
+         *  \param m Reference to FixedSquareMatrix<T, N>.
+         *  \return Matrix product.
+         */
+        constexpr FixedSquareMatrix<T, N>
+            operator*(const FixedSquareMatrix<T, N>& m) const
+        {
+            return multiply(m, Indices{});
+        };
+
+        /** \brief operator/ overload. Same as ElementarySquareMatrix,
+         *         this * m.transpose().
+         *  \param m Reference to FixedSquareMatrix<T, N>.
+         *  \return Matrix product with the transpose of m.
+         */
+        constexpr FixedSquareMatrix<T, N>
+            operator/(const FixedSquareMatrix<T, N>& m) const
+        {
+            return *this * m.transpose();
+        };
+
+        /** \brief Returns string representation of the matrix.
+         *  \return std::string.
+         */
+        std::string toString() const;
+
+        /** \brief Converts to a ConcreteSquareMatrix.
+         *  \return New instance of ConcreteSquareMatrix.
+         */
+        ConcreteSquareMatrix toConcrete() const;
+
+        /** \brief Writes the elements of this to an existing
+         *         ConcreteSquareMatrix of the same size.
+         *  \param m Target matrix.
+         *  \throw std::invalid_argument if sizes do not match.
+         */
+        void assignTo(ConcreteSquareMatrix& m) const;
+
+        /** \brief Constructs FixedSquareMatrix from a ConcreteSquareMatrix.
+         *  \param m Reference to ConcreteSquareMatrix.
+         *  \return New instance of FixedSquareMatrix<T, N>.
+         *  \throw std::invalid_argument if sizes do not match.
+         */
+        static FixedSquareMatrix<T, N> fromConcrete(const ConcreteSquareMatrix& m);
+
+    private:
+        T e[N * N];
+
+        template <unsigned int... Is>
+        constexpr FixedSquareMatrix<T, N> transpose(IndexList<Is...>) const
+        {
+            return FixedSquareMatrix<T, N>{e[(Is % N) * N + Is / N]...};
+        };
+
+        template <unsigned int... Is>
+        constexpr FixedSquareMatrix<T, N>
+            add(const FixedSquareMatrix<T, N>& m, IndexList<Is...>) const
+        {
+            return FixedSquareMatrix<T, N>{(e[Is] + m.e[Is])...};
+        };
+
+        template <unsigned int... Is>
+        constexpr FixedSquareMatrix<T, N>
+            subtract(const FixedSquareMatrix<T, N>& m, IndexList<Is...>) const
+        {
+            return FixedSquareMatrix<T, N>{(e[Is] - m.e[Is])...};
+        };
+
+        template <unsigned int... Is>
+        constexpr FixedSquareMatrix<T, N>
+            multiply(const FixedSquareMatrix<T, N>& m, IndexList<Is...>) const
+        {
+            return FixedSquareMatrix<T, N>{dot(m, Is, RowIndices{})...};
+        };
+
+        /* Row (k / N) of this times column (k % N) of m. */
+        template <unsigned int... Ls>
+        constexpr T dot(const FixedSquareMatrix<T, N>& m, unsigned int k,
+                        IndexList<Ls...>) const
+        {
+            return fixed_sum((e[(k / N) * N + Ls] * m.e[Ls * N + k % N])...);
+        };
+
+        constexpr bool equals(const FixedSquareMatrix<T, N>& m,
+                              unsigned int k) const
+        {
+            return k == N * N || (e[k] == m.e[k] && equals(m, k + 1));
+        };
+};
+
+template <typename T, unsigned int N>
+std::string FixedSquareMatrix<T, N>::toString() const
+{
+    std::string str("[");
+
+    for(unsigned int i = 0; i < N; i++)
+    {
+        str += "[";
+        for(unsigned int j = 0; j < N; j++)
+        {
+            if(j != 0) str += ",";
+            str += std::to_string(e[i * N + j]);
+        }
+        str += "]";
+    }
+
+    str += "]";
+
+    return str;
+}
+
+template <typename T, unsigned int N>
+ConcreteSquareMatrix FixedSquareMatrix<T, N>::toConcrete() const
+{
+    std::vector<std::vector<ElementPtr<IntElement>>> temp;
+
+    for(unsigned int i = 0; i < N; i++)
+    {
+        std::vector<ElementPtr<IntElement>> row;
+        for(unsigned int j = 0; j < N; j++)
+        {
+            row.push_back(make_element<IntElement>(
+                static_cast<int>(e[i * N + j])));
+        }
+        temp.push_back(std::move(row));
+    }
+
+    return ConcreteSquareMatrix{N, std::move(temp)};
+}
+
+template <typename T, unsigned int N>
+void FixedSquareMatrix<T, N>::assignTo(ConcreteSquareMatrix& m) const
+{
+    if(m.n != N) throw std::invalid_argument("Dimension mismatch.");
+
+    for(unsigned int i = 0; i < N; i++)
+    {
+        for(unsigned int j = 0; j < N; j++)
+        {
+            m.elements[i][j]->setVal(static_cast<int>(e[i * N + j]));
+        }
+    }
+}
+
+template <typename T, unsigned int N>
+FixedSquareMatrix<T, N>
+    FixedSquareMatrix<T, N>::fromConcrete(const ConcreteSquareMatrix& m)
+{
+    if(m.n != N) throw std::invalid_argument("Dimension mismatch.");
+
+    FixedSquareMatrix<T, N> ret;
+    for(unsigned int i = 0; i < N; i++)
+    {
+        for(unsigned int j = 0; j < N; j++)
+        {
+            ret.e[i * N + j] = static_cast<T>(m.elements[i][j]->getVal());
+        }
+    }
+
+    return ret;
+}
+
+/** \class FixedConcreteSquareMatrix<N>
+ *  \brief SquareMatrix backed by a FixedSquareMatrix<int, N>.
+ *         Lets small matrices take part in CompositeSquareMatrix
+ *         formulas without heap allocated elements.
+ *  \tparam N Row/column count.
+ */
+template <unsigned int N>
+class FixedConcreteSquareMatrix : public SquareMatrix
+{
+    public:
+        /** \brief Parametrized constructor.
+         *  \param m New value for matrix.
+         */
+        FixedConcreteSquareMatrix(const FixedSquareMatrix<int, N>& m) :
+            matrix(m) {};
+
+        /** \brief Default destructor.
+         */
+        virtual ~FixedConcreteSquareMatrix() = default;
+
+        /** \brief Get row size of the matrix.
+         *  \return N.
+         */
+        unsigned int getRowSize() const override
+        {
+            return N;
+        };
+
+        /** \brief Returns pointer to a clone of this.
+         *  \return SquareMatrix pointer.
+         */
+        SquareMatrix* clone() const override
+        {
+            return new FixedConcreteSquareMatrix<N>{*this};
+        };
+
+        /** \brief Prints string representation to output stream.
+         *  \param os std::ostream reference.
+         */
+        void print(std::ostream& os) const override
+        {
+            os << matrix.toString();
+        };
+
+        /** \brief Returns string representation of the matrix.
+         *  \return std::string.
+         */
+        std::string toString() const override
+        {
+            return matrix.toString();
+        };
+
+        /** \brief Evaluates SquareMatrix to a ConcreteSquareMatrix.
+         *  \param val Valuation map (unused).
+         *  \return New instance of ConcreteSquareMatrix.
+         */
+        ConcreteSquareMatrix evaluate(const Valuation&) const override
+        {
+            return matrix.toConcrete();
+        };
+
+        /** \brief matrix getter.
+         *  \return Reference to the contained FixedSquareMatrix.
+         */
+        const FixedSquareMatrix<int, N>& getMatrix() const
+        {
+            return matrix;
+        };
+
+    private:
+        FixedSquareMatrix<int, N> matrix;
+};
+
+/** \brief Constructs a concrete matrix from string of format "[[1,2][3,4]]".
+ *         Matrices with row size up to max_fixed_n are stored in a
+ *         FixedConcreteSquareMatrix, bigger ones in a ConcreteSquareMatrix.
+ *  \param str_m String to construct matrix from.
+ *  \return Pointer to the new SquareMatrix.
+ *  \throw std::invalid_argument if the string is invalid.
+ */
+std::unique_ptr<SquareMatrix> makeConcreteSquareMatrix(const std::string& str_m);
+
+/** \brief Constructs a concrete matrix from integers, stored like
+ *         makeConcreteSquareMatrix(const std::string&) does.
+ *  \param n Row size.
+ *  \param values n * n integers in row-major order.
+ *  \return Pointer to the new SquareMatrix.
+ *  \throw std::invalid_argument if values has wrong size.
+ */
+std::unique_ptr<SquareMatrix> makeConcreteSquareMatrix(
+    unsigned int n, const std::vector<int>& values);
+
+#endif // FIXEDSQUAREMATRIX_H
@@ -0,0 +1,625 @@
+/** \file kernelconfig.cpp
+ *  \brief Kernel configuration implementation file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include "kernelconfig.hpp"
+#include "squarematrix.hpp"
+#include "threadconfig.hpp"
+#ifdef __linux__
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+static const char* const config_header = "# sqm kernel config 1";
+static const std::uint64_t never = std::numeric_limits<std::uint64_t>::max();
+
+/* Fraction of the time of the current choice a tuned choice must take,
+ * so that timing noise does not flip between near-equal choices. */
+static const double tuning_margin = 0.95;
+
+static KernelConfig current_config;
+static std::once_flag config_loaded;
+
+ExecutionMode select_mode(std::uint64_t size, std::uint64_t vectorized_min,
+                          std::uint64_t parallel_min)
+{
+    if(size >= parallel_min && thread_count() > 1) return ExecutionMode::parallel;
+    if(size >= vectorized_min) return ExecutionMode::vectorized;
+    return ExecutionMode::serial;
+}
+
+static void load_default_config()
+{
+    const std::string path = default_kernel_config_path();
+    if(path.empty()) return;
+
+    /* A missing or broken file leaves the defaults. */
+    try
+    {
+        current_config = load_kernel_config(path);
+    }
+    catch(const std::exception&) {}
+}
+
+const KernelConfig& kernel_config()
+{
+    std::call_once(config_loaded, load_default_config);
+    return current_config;
+}
+
+void set_kernel_config(const KernelConfig& config)
+{
+    std::call_once(config_loaded, load_default_config);
+    current_config = config;
+}
+
+std::string default_kernel_config_path()
+{
+    const char* env = std::getenv("SQM_KERNEL_CONFIG");
+    if(env != nullptr) return env;
+
+    const char* xdg = std::getenv("XDG_CONFIG_HOME");
+    if(xdg != nullptr && *xdg != '\0') return std::string{xdg} + "/sqm-calc/kernels.conf";
+
+    const char* home = std::getenv("HOME");
+    if(home != nullptr && *home != '\0') return std::string{home} + "/.config/sqm-calc/kernels.conf";
+
+    return std::string{};
+}
+
+static const char* variant_name(MultiplyVariant variant)
+{
+    return variant == MultiplyVariant::axpy ? "axpy" : "dot";
+}
+
+KernelConfig load_kernel_config(const std::string& path)
+{
+    std::ifstream is{path};
+    if(!is) throw std::runtime_error("Could not read kernel config " + path + ".");
+
+    std::string line;
+    if(!std::getline(is, line) ||
+       line.compare(0, std::strlen(config_header), config_header) != 0)
+    {
+        throw std::invalid_argument("Not a kernel config file.");
+    }
+
+    KernelConfig ret;
+    const std::pair<const char*, std::uint64_t*> fields[] = {
+        {"elementwise_vectorized_min", &ret.elementwise_vectorized_min},
+        {"elementwise_parallel_min", &ret.elementwise_parallel_min},
+        {"multiply_vectorized_min", &ret.multiply_vectorized_min},
+        {"multiply_parallel_min", &ret.multiply_parallel_min}};
+
+    while(std::getline(is, line))
+    {
+        if(line.empty() || line[0] == '#') continue;
+
+        std::istringstream ss{line};
+        std::string name;
+        std::string value;
+        std::string rest;
+        if(!(ss >> name >> value) || ss >> rest)
+        {
+            throw std::invalid_argument("Invalid kernel config line \"" + line + "\".");
+        }
+
+        if(name == "multiply_variant")
+        {
+            if(value == variant_name(MultiplyVariant::dot)) ret.multiply_variant = MultiplyVariant::dot;
+            else if(value == variant_name(MultiplyVariant::axpy)) ret.multiply_variant = MultiplyVariant::axpy;
+            else throw std::invalid_argument("Invalid kernel config line \"" + line + "\".");
+            continue;
+        }
+
+        char* end = nullptr;
+        const unsigned long long v = std::strtoull(value.c_str(), &end, 10);
+        if(value[0] == '-' || *end != '\0')
+        {
+            throw std::invalid_argument("Invalid kernel config line \"" + line + "\".");
+        }
+
+        for(const auto& f : fields)
+        {
+            if(name == f.first) *f.second = v;
+        }
+        if(name == "multiply_tile" || name == "transpose_block")
+        {
+            if(v > 65536) throw std::invalid_argument("Invalid kernel config line \"" + line + "\".");
+            (name == "multiply_tile" ? ret.multiply_tile : ret.transpose_block) = static_cast<unsigned int>(v);
+        }
+    }
+
+    return ret;
+}
+
+std::string format_kernel_config(const KernelConfig& config)
+{
+    std::ostringstream ss;
+    ss << "elementwise_vectorized_min " << config.elementwise_vectorized_min << '\n'
+       << "elementwise_parallel_min " << config.elementwise_parallel_min << '\n'
+       << "multiply_vectorized_min " << config.multiply_vectorized_min << '\n'
+       << "multiply_parallel_min " << config.multiply_parallel_min << '\n'
+       << "multiply_variant " << variant_name(config.multiply_variant) << '\n'
+       << "multiply_tile " << config.multiply_tile << '\n'
+       << "transpose_block " << config.transpose_block << '\n';
+    return ss.str();
+}
+
+/* Creates the directories of path. Failures show when the file is written. */
+static void make_parent_dirs(const std::string& path)
+{
+#ifdef __linux__
+    for(std::size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+    {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+#else
+    (void)path;
+#endif
+}
+
+/* The file is written next to path and renamed over it, so processes
+ * that tune at the same time never read a partial file. */
+void save_kernel_config(const std::string& path, const KernelConfig& config)
+{
+    make_parent_dirs(path);
+
+#ifdef __linux__
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+#else
+    const std::string tmp = path + ".tmp";
+#endif
+    std::ofstream os{tmp, std::ios::trunc};
+    os << config_header << "\n# name value\n" << format_kernel_config(config);
+    os.close();
+    if(!os || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Could not write kernel config " + path + ".");
+    }
+}
+
+/* Fastest of a few batches of at least 1 ms, in ns per call. */
+template <typename Func>
+static double time_call(Func func)
+{
+    using clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::max();
+
+    for(int batch = 0; batch < 5; batch++)
+    {
+        unsigned int calls = 0;
+        const auto start = clock::now();
+        auto elapsed = clock::duration::zero();
+        do
+        {
+            func();
+            calls++;
+            elapsed = clock::now() - start;
+        } while(elapsed < std::chrono::milliseconds(1));
+
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / calls);
+    }
+    return best;
+}
+
+/* Times of the modes forced by config at one size. */
+struct ModeTimes
+{
+    std::uint64_t size;
+    double serial;
+    double vectorized;
+    double parallel;
+};
+
+static ConcreteSquareMatrix tuning_matrix(unsigned int n)
+{
+    std::vector<int> values(n * n);
+    for(unsigned int i = 0; i < values.size(); i++) values[i] = static_cast<int>(i % 7) - 3;
+    return ConcreteSquareMatrix{n, values};
+}
+
+/* Smallest measured size from which times.*faster beats the best of
+ * times.*slower by the tuning margin at every larger size. If it does not
+ * win at the largest size, the crossover is beyond the measured range and
+ * fallback is kept. */
+static std::uint64_t crossover(const std::vector<ModeTimes>& times,
+                               double ModeTimes::*faster,
+                               std::initializer_list<double ModeTimes::*> slower,
+                               std::uint64_t fallback)
+{
+    std::uint64_t ret = fallback;
+    for(auto it = times.rbegin(); it != times.rend(); ++it)
+    {
+        double best = std::numeric_limits<double>::max();
+        for(auto s : slower) best = std::min(best, (*it).*s);
+        if((*it).*faster >= best * tuning_margin) break;
+        ret = it->size;
+    }
+    return ret;
+}
+
+static void add_to(ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+{
+    a += b;
+}
+
+static void multiply(ConcreteSquareMatrix& a, const ConcreteSquareMatrix& b)
+{
+    const ConcreteSquareMatrix c = a * b;
+    (void)c;
+}
+
+/* Times of op in each mode, the rest of the configuration from base. */
+template <typename Op>
+static std::vector<ModeTimes> time_modes(const KernelConfig& base,
+                                         const std::vector<unsigned int>& sizes, bool by_rows,
+                                         bool parallel, Op op)
+{
+    KernelConfig forced = base;
+    std::vector<ModeTimes> ret;
+
+    for(unsigned int n : sizes)
+    {
+        ConcreteSquareMatrix a = tuning_matrix(n);
+        const ConcreteSquareMatrix b = tuning_matrix(n);
+        auto call = [&a, &b, &op]() { op(a, b); };
+
+        ModeTimes t;
+        t.size = by_rows ? n : static_cast<std::uint64_t>(n) * n;
+
+        forced.elementwise_vectorized_min = forced.multiply_vectorized_min = never;
+        forced.elementwise_parallel_min = forced.multiply_parallel_min = never;
+        set_kernel_config(forced);
+        t.serial = time_call(call);
+
+        forced.elementwise_vectorized_min = forced.multiply_vectorized_min = 0;
+        set_kernel_config(forced);
+        t.vectorized = time_call(call);
+
+        t.parallel = std::numeric_limits<double>::max();
+        if(parallel)
+        {
+            forced.elementwise_parallel_min = forced.multiply_parallel_min = 0;
+            set_kernel_config(forced);
+            t.parallel = time_call(call);
+        }
+
+        ret.push_back(t);
+    }
+    return ret;
+}
+
+/* Fastest variant, tile and transpose block of serial vectorized
+ * products of a size where they matter. Those of base are kept unless
+ * another choice beats them by the tuning margin. */
+static KernelConfig tune_multiply(const KernelConfig& base)
+{
+    const unsigned int n = 128;
+    const unsigned int tiles[] = {0, 16, 32, 64};
+    const unsigned int blocks[] = {0, 16, 32, 64};
+
+    ConcreteSquareMatrix a = tuning_matrix(n);
+    const ConcreteSquareMatrix b = tuning_matrix(n);
+    KernelConfig candidate = base;
+    candidate.multiply_vectorized_min = 0;
+    candidate.multiply_parallel_min = never;
+
+    auto time_shape = [&a, &b, &candidate](const KernelConfig& shape)
+    {
+        candidate.multiply_variant = shape.multiply_variant;
+        candidate.multiply_tile = shape.multiply_tile;
+        candidate.transpose_block = shape.transpose_block;
+        set_kernel_config(candidate);
+        return time_call([&a, &b]() { multiply(a, b); });
+    };
+
+    KernelConfig ret = base;
+    double best = time_shape(base) * tuning_margin;
+    for(MultiplyVariant variant : {MultiplyVariant::dot, MultiplyVariant::axpy})
+    {
+        for(unsigned int tile : tiles)
+        {
+            for(unsigned int block : blocks)
+            {
+                /* Only dot products transpose. */
+                if(variant == MultiplyVariant::axpy && block != base.transpose_block) continue;
+
+                KernelConfig shape = base;
+                shape.multiply_variant = variant;
+                shape.multiply_tile = tile;
+                shape.transpose_block = block;
+
+                const double t = time_shape(shape);
+                if(t < best)
+                {
+                    best = t;
+                    ret = shape;
+                }
+            }
+        }
+    }
+
+    /* A winner timed long after base may only have had a quieter moment,
+     * so the two are timed again in turn. */
+    if(ret.multiply_variant != base.multiply_variant ||
+       ret.multiply_tile != base.multiply_tile ||
+       ret.transpose_block != base.transpose_block)
+    {
+        double base_time = std::numeric_limits<double>::max();
+        double ret_time = std::numeric_limits<double>::max();
+        for(int round = 0; round < 3; round++)
+        {
+            base_time = std::min(base_time, time_shape(base));
+            ret_time = std::min(ret_time, time_shape(ret));
+        }
+        if(ret_time >= base_time * tuning_margin) ret = base;
+    }
+    return ret;
+}
+
+KernelConfig tune_kernel_config()
+{
+    const KernelConfig previous = kernel_config();
+    const bool parallel = thread_count() > 1;
+    KernelConfig ret;
+
+    try
+    {
+        ret = tune_multiply(ret);
+
+        const auto add = time_modes(ret, {8, 16, 32, 64, 128, 256, 512}, false, parallel, add_to);
+        const auto mul = time_modes(ret, {8, 16, 32, 64, 128}, true, parallel, multiply);
+
+        ret.elementwise_vectorized_min = crossover(add, &ModeTimes::vectorized,
+            {&ModeTimes::serial}, ret.elementwise_vectorized_min);
+        ret.multiply_vectorized_min = crossover(mul, &ModeTimes::vectorized,
+            {&ModeTimes::serial}, ret.multiply_vectorized_min);
+
+        /* Parallel execution cannot be measured with one thread, the
+         * defaults are kept for a later thread count. */
+        if(parallel)
+        {
+            ret.elementwise_parallel_min = crossover(add, &ModeTimes::parallel,
+                {&ModeTimes::serial, &ModeTimes::vectorized}, ret.elementwise_parallel_min);
+            ret.multiply_parallel_min = crossover(mul, &ModeTimes::parallel,
+                {&ModeTimes::serial, &ModeTimes::vectorized}, ret.multiply_parallel_min);
+        }
+    }
+    catch(...)
+    {
+        set_kernel_config(previous);
+        throw;
+    }
+
+    set_kernel_config(previous);
+    return ret;
+}
+
+bool init_kernel_config(const std::string& path, bool retune, bool strict)
+{
+    if(!retune)
+    {
+        if(path.empty()) return false;
+
+        std::ifstream is{path};
+        if(is)
+        {
+            /* A broken default file is replaced like a missing one. */
+            try
+            {
+                set_kernel_config(load_kernel_config(path));
+                return false;
+            }
+            catch(const std::exception&)
+            {
+                if(strict) throw;
+            }
+        }
+    }
+
+    set_kernel_config(tune_kernel_config());
+    if(!path.empty())
+    {
+        /* A first run without a writable config directory still uses
+         * the tuned values. */
+        try
+        {
+            save_kernel_config(path, kernel_config());
+        }
+        catch(const std::runtime_error&)
+        {
+            if(retune) throw;
+        }
+    }
+    return true;
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Kernel configuration.", "[kernels]")
+{
+    const KernelConfig previous = kernel_config();
+    const unsigned int threads = thread_count();
+
+    set_thread_count(1);
+    CHECK(select_mode(10, 100, 1000) == ExecutionMode::serial);
+    CHECK(select_mode(100, 100, 1000) == ExecutionMode::vectorized);
+    CHECK(select_mode(5000, 100, 1000) == ExecutionMode::vectorized);
+    set_thread_count(2);
+    CHECK(select_mode(5000, 100, 1000) == ExecutionMode::parallel);
+    CHECK(select_mode(5000, 10000, 1000) == ExecutionMode::parallel);
+
+    KernelConfig config;
+    config.elementwise_vectorized_min = 12;
+    config.multiply_parallel_min = 345;
+    config.multiply_variant = MultiplyVariant::axpy;
+    config.multiply_tile = 16;
+    config.transpose_block = 0;
+    const std::string path = "kernelconfig_test.txt";
+    save_kernel_config(path, config);
+    const KernelConfig loaded = load_kernel_config(path);
+    CHECK(loaded.elementwise_vectorized_min == 12);
+    CHECK(loaded.elementwise_parallel_min == config.elementwise_parallel_min);
+    CHECK(loaded.multiply_vectorized_min == config.multiply_vectorized_min);
+    CHECK(loaded.multiply_parallel_min == 345);
+    CHECK(loaded.multiply_variant == MultiplyVariant::axpy);
+    CHECK(loaded.multiply_tile == 16);
+    CHECK(loaded.transpose_block == 0);
+
+    {
+        std::ofstream os{path, std::ios::trunc};
+        os << config_header << "\nmultiply_vectorized_min -1\n";
+    }
+    CHECK_THROWS_AS(load_kernel_config(path), std::invalid_argument&);
+    {
+        std::ofstream os{path, std::ios::trunc};
+        os << config_header << "\nmultiply_variant avx\n";
+    }
+    CHECK_THROWS_AS(load_kernel_config(path), std::invalid_argument&);
+    {
+        std::ofstream os{path, std::ios::trunc};
+        os << "elementwise_vectorized_min 1\n";
+    }
+    CHECK_THROWS_AS(load_kernel_config(path), std::invalid_argument&);
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(load_kernel_config(path), std::runtime_error&);
+
+    /* Every mode gives the same results. */
+    const std::vector<unsigned int> sizes{5, 9, 17};
+    for(unsigned int n : sizes)
+    {
+        std::vector<int> va(n * n);
+        std::vector<int> vb(n * n);
+        for(unsigned int i = 0; i < n * n; i++)
+        {
+            va[i] = static_cast<int>(i % 11) - 5;
+            vb[i] = static_cast<int>(i % 5) * 3 - 2;
+        }
+        const ConcreteSquareMatrix a{n, va};
+        const ConcreteSquareMatrix b{n, vb};
+
+        std::vector<int> sum(n * n);
+        std::vector<int> diff(n * n);
+        std::vector<int> prod(n * n, 0);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            for(unsigned int j = 0; j < n; j++)
+            {
+                sum[i * n + j] = va[i * n + j] + vb[i * n + j];
+                diff[i * n + j] = va[i * n + j] - vb[i * n + j];
+                for(unsigned int k = 0; k < n; k++)
+                {
+                    prod[i * n + j] += va[i * n + k] * vb[k * n + j];
+                }
+            }
+        }
+
+        for(std::uint64_t vectorized_min : {never, std::uint64_t{0}})
+        {
+            for(std::uint64_t parallel_min : {never, std::uint64_t{0}})
+            {
+                config.elementwise_vectorized_min = config.multiply_vectorized_min = vectorized_min;
+                config.elementwise_parallel_min = config.multiply_parallel_min = parallel_min;
+                set_kernel_config(config);
+
+                CHECK((a + b) == ConcreteSquareMatrix(n, sum));
+                CHECK((a - b) == ConcreteSquareMatrix(n, diff));
+                CHECK((a * b) == ConcreteSquareMatrix(n, prod));
+            }
+        }
+
+        /* And every product variant, with tiles and blocks that do not
+         * divide n. */
+        config.multiply_vectorized_min = 0;
+        config.multiply_parallel_min = never;
+        for(MultiplyVariant variant : {MultiplyVariant::dot, MultiplyVariant::axpy})
+        {
+            for(unsigned int tile : {0u, 4u})
+            {
+                for(unsigned int block : {0u, 3u})
+                {
+                    config.multiply_variant = variant;
+                    config.multiply_tile = tile;
+                    config.transpose_block = block;
+                    set_kernel_config(config);
+                    CHECK((a * b) == ConcreteSquareMatrix(n, prod));
+                }
+            }
+        }
+    }
+
+    set_thread_count(threads);
+    set_kernel_config(previous);
+}
+
+TEST_CASE("Kernel tuning.", "[kernels]")
+{
+    const KernelConfig previous = kernel_config();
+    const std::string dir = "kernelconfig_test";
+    const std::string path = dir + "/host/kernels.conf";
+
+    /* The first run tunes and writes the file, later runs load it. */
+    std::remove(path.c_str());
+    CHECK(init_kernel_config(path, false));
+    const KernelConfig tuned = load_kernel_config(path);
+    CHECK(format_kernel_config(tuned) == format_kernel_config(kernel_config()));
+    CHECK(tuned.multiply_tile <= 64);
+    CHECK(tuned.transpose_block <= 64);
+    CHECK(!init_kernel_config(path, false));
+    CHECK(format_kernel_config(kernel_config()) == format_kernel_config(tuned));
+
+    /* Saving leaves no temporary file behind. */
+    save_kernel_config(path, tuned);
+    CHECK(format_kernel_config(load_kernel_config(path)) == format_kernel_config(tuned));
+#ifdef __linux__
+    CHECK_FALSE(std::ifstream{path + ".tmp" + std::to_string(getpid())}.good());
+#else
+    CHECK_FALSE(std::ifstream{path + ".tmp"}.good());
+#endif
+
+    /* A broken file is retuned, unless it was asked for explicitly. */
+    {
+        std::ofstream os{path, std::ios::trunc};
+    }
+    CHECK_THROWS_AS(init_kernel_config(path, false, true), std::invalid_argument&);
+    CHECK(init_kernel_config(path, false));
+    CHECK_NOTHROW(load_kernel_config(path));
+
+    std::remove(path.c_str());
+    std::remove((dir + "/host").c_str());
+    std::remove(dir.c_str());
+
+    /* A mode that only loses, or wins by less than the margin, in the
+     * measured range keeps the fallback. */
+    const std::vector<ModeTimes> times = {{8, 10.0, 20.0, 0.0}, {16, 40.0, 30.0, 0.0},
+                                          {32, 160.0, 100.0, 0.0}};
+    CHECK(crossover(times, &ModeTimes::vectorized, {&ModeTimes::serial}, 77) == 16);
+    CHECK(crossover(times, &ModeTimes::serial, {&ModeTimes::vectorized}, 77) == 77);
+    const std::vector<ModeTimes> close = {{8, 100.0, 97.0, 0.0}};
+    CHECK(crossover(close, &ModeTimes::vectorized, {&ModeTimes::serial}, 77) == 77);
+
+    setenv("SQM_KERNEL_CONFIG", path.c_str(), 1);
+    CHECK(default_kernel_config_path() == path);
+    unsetenv("SQM_KERNEL_CONFIG");
+    CHECK(default_kernel_config_path().find("sqm-calc/kernels.conf") != std::string::npos);
+
+    set_kernel_config(previous);
+}
+
+#endif // SQM_TESTS
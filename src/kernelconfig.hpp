@@ -0,0 +1,145 @@
+/** \file kernelconfig.hpp
+ *  \brief Size thresholds and loop shapes that pick how the
+ *         ConcreteSquareMatrix kernels run, and their tuning on the
+ *         current host.
+ */
+
+#ifndef KERNELCONFIG_H
+#define KERNELCONFIG_H
+
+#include <cstdint>
+#include <string>
+
+/** \brief Ways a kernel can run.
+ */
+enum class ExecutionMode : unsigned int
+{
+    /** \brief Plain loop over the elements. */
+    serial,
+    /** \brief Values gathered to contiguous buffers, loops the compiler
+     *         vectorizes. */
+    vectorized,
+    /** \brief Split over threads. */
+    parallel
+};
+
+/** \brief Loop shapes of the vectorized product, which compilers turn
+ *         into different SIMD code.
+ */
+enum class MultiplyVariant : unsigned int
+{
+    /** \brief Dot products of rows with the packed transpose of the
+     *         right operand, a vector reduction per element. */
+    dot,
+    /** \brief Rows of the right operand scaled and added to the result
+     *         row, vector multiply-adds without a reduction. */
+    axpy
+};
+
+/** \struct KernelConfig
+ *  \brief Smallest sizes at which the kernels switch to vectorized and
+ *         parallel execution, and the shape of the vectorized product.
+ */
+struct KernelConfig
+{
+    /** \brief Elements from which + and - are vectorized. Off by
+     *         default, gathering the elements usually costs more than
+     *         the vector loop saves. */
+    std::uint64_t elementwise_vectorized_min = UINT64_MAX;
+    /** \brief Elements from which + and - run in parallel. */
+    std::uint64_t elementwise_parallel_min = 1 << 18;
+    /** \brief Row size from which products are vectorized. */
+    std::uint64_t multiply_vectorized_min = 8;
+    /** \brief Row size from which products run in parallel. */
+    std::uint64_t multiply_parallel_min = 64;
+    /** \brief Loop shape of vectorized products. */
+    MultiplyVariant multiply_variant = MultiplyVariant::dot;
+    /** \brief Row size of the cache tiles of vectorized products, 0 for
+     *         whole rows. */
+    unsigned int multiply_tile = 0;
+    /** \brief Row size of the blocks in which the right operand of a dot
+     *         product is transposed, 0 for whole rows. */
+    unsigned int transpose_block = 32;
+};
+
+/** \brief Picks the mode for a problem size. Parallel execution needs
+ *         more than one thread, see thread_count().
+ *  \param size Problem size.
+ *  \param vectorized_min Size from which to vectorize.
+ *  \param parallel_min Size from which to run in parallel.
+ *  \return Mode for size.
+ */
+ExecutionMode select_mode(std::uint64_t size, std::uint64_t vectorized_min,
+                          std::uint64_t parallel_min);
+
+/** \brief Get the configuration in use. At first use it is loaded from
+ *         default_kernel_config_path() if that file exists and is valid,
+ *         else it is the defaults of KernelConfig.
+ *  \return Reference to the current KernelConfig.
+ */
+const KernelConfig& kernel_config();
+
+/** \brief Replaces the configuration. Must not be called while matrix
+ *         operations run.
+ *  \param config New configuration.
+ */
+void set_kernel_config(const KernelConfig& config);
+
+/** \brief File the configuration of this host is kept in: the
+ *         SQM_KERNEL_CONFIG environment variable if it is set, else
+ *         sqm-calc/kernels.conf in XDG_CONFIG_HOME or in ~/.config.
+ *  \return Path of the file, empty if there is none.
+ */
+std::string default_kernel_config_path();
+
+/** \brief Reads a configuration from a file of "name value" lines.
+ *         Missing names keep their default value, unknown names are
+ *         skipped.
+ *  \param path Path of the file.
+ *  \return Configuration of the file.
+ *  \throw std::runtime_error if the file cannot be read.
+ *  \throw std::invalid_argument if the file is not a valid config.
+ */
+KernelConfig load_kernel_config(const std::string& path);
+
+/** \brief Writes a configuration to a file, creating its directory. The
+ *         file is replaced at once, readers never see a partial file.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param config Configuration to write.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void save_kernel_config(const std::string& path, const KernelConfig& config);
+
+/** \brief Formats a configuration as the "name value" lines of its file.
+ *  \param config Configuration to format.
+ *  \return One line per setting.
+ */
+std::string format_kernel_config(const KernelConfig& config);
+
+/** \brief Measures the product variants, tile sizes and transpose block
+ *         sizes at one size and keeps the fastest, then measures serial,
+ *         vectorized and parallel execution of the kernels over a range
+ *         of sizes and returns the sizes from which each mode is fastest.
+ *         A choice other than the default is only taken if it is clearly
+ *         faster, and a mode that is not fastest within the range keeps
+ *         its default threshold. Takes a fraction of a second.
+ *  \return Tuned configuration. The current configuration is not changed.
+ */
+KernelConfig tune_kernel_config();
+
+/** \brief Sets up the configuration at startup. Loads path if it exists,
+ *         else tunes the kernels and writes the result to path, as it
+ *         does for any path if retune is set. An invalid file is
+ *         treated like a missing one unless strict is set.
+ *  \param path Configuration file, empty to tune only if retune is set.
+ *  \param retune true to tune even if path exists.
+ *  \param strict true if path was given by the user, so that an invalid
+ *         file is an error rather than replaced.
+ *  \return true if the kernels were tuned.
+ *  \throw std::invalid_argument if strict is set and path is not a valid
+ *         config.
+ *  \throw std::runtime_error if path cannot be written after retuning.
+ */
+bool init_kernel_config(const std::string& path, bool retune, bool strict = false);
+
+#endif // KERNELCONFIG_H
@@ -2,242 +2,181 @@
  *  \brief Main implementation file.
  */
 
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <stack>
-#include <memory>
-#include <locale>
-#include <exception>
+#include <stdexcept>
 #include "utils.hpp"
-#include "element.hpp"
 #include "squarematrix.hpp"
-#include "compositesquarematrix.hpp"
+#include "calculator.hpp"
+#include "executiontrace.hpp"
+#include "threadconfig.hpp"
+#include "kernelconfig.hpp"
 
-#define CATCH_CONFIG_RUNNER
-#include "catch.hpp"
+static bool enable_counters(Calculator& calc)
+{
+    try
+    {
+        calc.setPerfCounters(true);
+    }
+    catch(std::runtime_error& e)
+    {
+        std::cerr << "Hardware counters are not available: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
 
 /** \brief Main function for I/O and erroneous input handling.
+ *
+ *  "--batch [FILE]" runs the commands in FILE, or standard input if FILE
+ *  is "-" or missing, without prompts. "--timing" prints the timing of
+ *  every evaluation in batch mode too. "--perf" prints the hardware
+ *  counters of every command. "--trace FILE" traces parallel work from
+ *  the start and writes it to FILE as Chrome trace JSON at exit.
+ *  "--threads N" sets the number of threads, which otherwise comes from
+ *  SQM_THREADS or the CPUs available to the process, and "--cpus LIST"
+ *  pins the worker threads to the CPUs in LIST, such as "0-3,8".
+ *  The kernel configuration, the sizes from which the kernels are
+ *  vectorized or run in parallel and the shape of the product loops, is
+ *  loaded from "--kernel-config FILE" or default_kernel_config_path().
+ *  If the file does not exist yet, or with "--tune", the kernels are
+ *  tuned on this host and the result is written to the file. An invalid
+ *  default file is replaced the same way, an invalid "--kernel-config"
+ *  file is an error. The tests
+ *  are in the separate sqm-tests runner.
+ *
  *  \return 0 if success, else non-zero.
  */
 int main(int argc, char** argv)
 {
-    if(n_threads == 0)
+    bool batch = false;
+    bool timing = false;
+    bool perf = false;
+    bool tune = false;
+    const char* script = nullptr;
+    const char* trace = nullptr;
+    const char* threads = nullptr;
+    const char* cpus = nullptr;
+    const char* kernels = nullptr;
+
+    for(int i = 1; i < argc; i++)
     {
-        std::cout << _RED_ << "Cannot read the amount of system threads." << std::endl;
-        std::cout << "Exiting." << _END_ << std::endl;
-        return -1;
-    }
-
-    int res = Catch::Session().run(argc, argv);
-
-    std::stack<std::unique_ptr<SquareMatrix>> mstack;
-    std::string buffer;
-    Valuation valuation;
-
-    std::cout << _YEL_ << "*** SQUARE MATRIX CALCULATOR ***" << _END_ << std::endl;
-    std::cout << "* Make a selection:" << std::endl;
-    std::cout << "* Input operation: " << _GRN_ << "\"+\" \"-\" \"*\" \"/\"" << _END_ << "." << std::endl;
-    std::cout << "* Input " << _GRN_ << "\"quit\"" << _END_ << " to quit." << std::endl;
-    std::cout << "* Input " << _GRN_ << "\"clearval\"" << _END_ << " to clear valuation map." << std::endl;
-    std::cout << "* Input " << _GRN_ << "\"printval\"" << _END_ << " to print valuation map." << std::endl;
-    std::cout << "* Input " << _GRN_ << "\"stacksize\"" << _END_ << " to print stack size." << std::endl;
-    std::cout << "* Input " << _GRN_ << "\"=\"" << _END_ << " to evaluate matrix at the stack top." << std::endl;
-    std::cout << "* Input matrix in string format to add it to stack." << std::endl;
-    std::cout << "* \tExample: " << _GRN_ << "\"[[1,2][a,b]]\"." << _END_ << std::endl;
-    std::cout << "* \tExample: " << _GRN_ << "\"[[4,2][5,6]]\"." << _END_ << std::endl;
-    std::cout << "* Input valuation in format " << _GRN_ << "\"x=2\"" << _END_ << " to add it to valuation map." << std::endl;
-
-    std::string prompt{_YEL_+ "Please input a selection and press ENTER." + _END_};
-    while(get_user_input(std::cout, std::cin, prompt, buffer))
-    {
-        if(buffer == "clearval")
+        if(std::strcmp(argv[i], "--batch") == 0 ||
+           std::strcmp(argv[i], "-b") == 0)
         {
-            valuation.clear();
-            std::cout << _GRN_ << "Valuation map cleared." << _END_ << std::endl;
+            batch = true;
+            if(i + 1 < argc && (argv[i + 1][0] != '-' ||
+                                std::strcmp(argv[i + 1], "-") == 0))
+            {
+                script = argv[++i];
+            }
         }
-        else if(buffer == "stacksize")
+        else if(std::strcmp(argv[i], "--timing") == 0)
         {
-            std::cout << _GRN_ << "Stack size: " << mstack.size() << _END_ << std::endl;
+            timing = true;
         }
-        else if(buffer == "printval")
+        else if(std::strcmp(argv[i], "--perf") == 0)
         {
-            if(valuation.size() == 0)
-            {
-                std::cout << _GRN_ << "Valuation map is empty." << _END_ << std::endl;
-            }
-            else
-            {
-                for(auto it = valuation.begin(); it != valuation.end(); it++)
-                {
-                    std::cout << _GRN_ << it->first << " = " << it->second << _END_ << std::endl;
-                }
-            }
+            perf = true;
         }
-        else if(buffer == "quit")
+        else if(std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
         {
-            break;
+            threads = argv[++i];
         }
-        else if(buffer == "+" || buffer == "-" ||
-                buffer == "*" || buffer == "/")
+        else if(std::strcmp(argv[i], "--cpus") == 0 && i + 1 < argc)
         {
-            if(mstack.size() < 2)
-            {
-                std::cout << _RED_ << "Too few matrices in stack." << _END_ << std::endl;
-            }
-            else
-            {
-                auto m1 = std::move(mstack.top());
-                mstack.pop();
-                auto m2 = std::move(mstack.top());
-                mstack.pop();
-
-                char opchar = buffer[0];
-
-                std::function<ConcreteSquareMatrix(
-                    const ConcreteSquareMatrix&,
-                    const ConcreteSquareMatrix&)> func;
-
-                switch(opchar)
-                {
-                    case '+':
-                        func = [](const ConcreteSquareMatrix& m1,
-                                  const ConcreteSquareMatrix& m2)
-                                  {return m1 + m2;};
-                        break;
-
-                    case '-':
-                        func = [](const ConcreteSquareMatrix& m1,
-                                  const ConcreteSquareMatrix& m2)
-                                  {return m1 - m2;};
-                        break;
-
-                    case '*':
-                        func = [](const ConcreteSquareMatrix& m1,
-                                  const ConcreteSquareMatrix& m2)
-                                  {return m1 * m2;};
-                        break;
-
-                    case '/':
-                        func = [](const ConcreteSquareMatrix& m1,
-                                  const ConcreteSquareMatrix& m2)
-                                  {return m1 / m2;};
-                        break;
-
-                    default:
-                        std::cout << "Something went terribly wrong." << std::endl;
-                        return -1;
-                }
-
-                CompositeSquareMatrix csm{*m1, *m2, func, opchar};
-
-                csm.print(std::cout);
-                std::cout << std::endl;
-
-                mstack.push(
-                    std::move(std::unique_ptr<CompositeSquareMatrix>{
-                        static_cast<CompositeSquareMatrix*>(csm.clone())}));
-            }
+            cpus = argv[++i];
         }
-        else if(buffer == "=")
+        else if(std::strcmp(argv[i], "--tune") == 0)
         {
-            if(mstack.size() < 1)
-            {
-                std::cout << _RED_ << "Stack is empty." << _END_ << std::endl;
-            }
-            else
-            {
-                try
-                {
-                    std::unique_ptr<SquareMatrix> mptr{mstack.top()->clone()};
-                    std::cout << _BLU_ << "Calculating : " << _END_ << _GRN_ << mptr->toString() << _END_ << std::endl;
-                    std::cout << _BLU_ << "Result : " << _END_;
-                    std::cout << _GRN_;
-                    mptr->evaluate(valuation).print(std::cout);
-                    std::cout << _END_ << std::endl;
-                }
-                catch(std::exception& e)
-                {
-                    std::cout << _RED_ << "Error while calculating matrices: ";
-                    std::cout << e.what() << _END_ << std::endl;
-                }
-            }
-
+            tune = true;
         }
-        else if(isalpha(buffer[0]))
+        else if(std::strcmp(argv[i], "--kernel-config") == 0 && i + 1 < argc)
         {
-            std::string num;
-            char var = buffer[0];
-
-            if(buffer[1] != '=')
-            {
-                std::cout << _RED_ << "Invalid valuation input." << _END_ << std::endl;
-            }
-            else
-            {
-                for(unsigned int i = 2; i < buffer.size(); i++)
-                {
-                    if(!std::isdigit(buffer[i]))
-                    {
-                        std::cout << _RED_ << "Invalid valuation input." << _END_ << std::endl;
-                        break;
-                    }
-                    num += buffer[i];
-                }
-
-                try
-                {
-                    valuation.insert({var, std::stoi(num)});
-                    std::cout << _GRN_ << "Added valuation." << _END_ << std::endl;
-                }
-                catch(std::exception)
-                {
-                    std::cout << _RED_ << "Invalid valuation input." << _END_ << std::endl;
-                }
-            }
-
+            kernels = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace = argv[++i];
         }
-        else if(buffer[0] == '[')
+        else
         {
-            bool is_alpha;
+            std::cerr << "Unknown argument " << argv[i] << "." << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--batch [FILE]] [--timing] [--perf] [--trace FILE]"
+                      << " [--threads N] [--cpus LIST] [--tune] [--kernel-config FILE]" << std::endl;
+            return 1;
+        }
+    }
 
-            /* Determine whether we are to
-             * create VariableElements or IntElements.
-             */
-            for(unsigned int i = 2; i < buffer.size(); i++)
+    try
+    {
+        if(threads != nullptr)
+        {
+            char* end = nullptr;
+            const unsigned long n = std::strtoul(threads, &end, 10);
+            if(*end != '\0' || n == 0 || n > max_thread_count)
             {
-                if(isalpha(buffer[i]))
-                {
-                    is_alpha = true;
-                    break;
-                }
+                throw std::invalid_argument(std::string{"Invalid thread count "} + threads + ".");
             }
+            set_thread_count(static_cast<unsigned int>(n));
+        }
+        if(cpus != nullptr) set_cpu_affinity(parse_cpu_list(cpus));
+        init_kernel_config(kernels != nullptr ? kernels : default_kernel_config_path(), tune,
+                           kernels != nullptr);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-            try
-            {
-                if(is_alpha)
-                {
-                    mstack.push(
-                        std::unique_ptr<SquareMatrix>{
-                            new SymbolicSquareMatrix{buffer}});
-                }
-                else
-                {
-                    mstack.push(
-                        std::unique_ptr<SquareMatrix>{
-                            new ConcreteSquareMatrix{buffer}});
-                }
+    if(trace != nullptr) set_tracing(true);
 
-                std::cout << _GRN_ << "Added matrix to stack." << _END_ << std::endl;
-            }
-            catch(std::exception)
+    int ret = 0;
+    if(batch)
+    {
+        /* Results are written in blocks, not flushed per line. */
+        std::ios::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+
+        Calculator calc{std::cout, std::cerr, false};
+        calc.setTiming(timing);
+        if(perf && !enable_counters(calc)) return 1;
+        if(script == nullptr || std::strcmp(script, "-") == 0)
+        {
+            ret = calc.runBatch(std::cin) == 0 ? 0 : 1;
+        }
+        else
+        {
+            std::ifstream is{script};
+            if(!is)
             {
-                std::cout << _RED_ << "Input was not recognized." << _END_ << std::endl;
+                std::cerr << "Could not open " << script << "." << std::endl;
+                return 1;
             }
+            ret = calc.runBatch(is) == 0 ? 0 : 1;
         }
-        else
+    }
+    else
+    {
+        Calculator calc{std::cout, std::cerr, true};
+        if(perf && !enable_counters(calc)) return 1;
+        calc.runInteractive(std::cin);
+    }
+
+    if(trace != nullptr)
+    {
+        std::ofstream os{trace};
+        write_chrome_trace(os);
+        os.close();
+        if(!os)
         {
-            std::cout << _RED_ << "Input was not recognized." << _END_ << std::endl;
+            std::cerr << "Could not write trace " << trace << "." << std::endl;
+            ret = 1;
         }
     }
 
-    return res;
+    return ret;
 }
@@ -0,0 +1,661 @@
+/** \file matrixexchange.cpp
+ *  \brief Matrix Market and CSV implementation file.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "matrixexchange.hpp"
+#include "matrixformat.hpp"
+#include "matrixparser.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+/* Splits a stream to lines, reading it exchange_chunk_size bytes at
+ * a time. Lines point to the buffer and are valid until the next call.
+ * The buffer grows only for lines longer than a chunk. */
+class LineReader
+{
+    public:
+        explicit LineReader(std::istream& new_is) :
+            is(new_is), buf(exchange_chunk_size),
+            begin(0), scanned(0), end(0), line(0), eof(false) {}
+
+        /* Sets [first, last) to the next line without the line end. */
+        bool next(const char*& first, const char*& last)
+        {
+            for(;;)
+            {
+                const void* nl = std::memchr(buf.data() + scanned, '\n', end - scanned);
+                if(nl != nullptr)
+                {
+                    first = buf.data() + begin;
+                    last = static_cast<const char*>(nl);
+                    begin = scanned = last - buf.data() + 1;
+                    break;
+                }
+
+                scanned = end;
+                if(eof)
+                {
+                    if(begin == end) return false;
+                    first = buf.data() + begin;
+                    last = buf.data() + end;
+                    begin = scanned = end;
+                    break;
+                }
+
+                fill();
+            }
+
+            if(last != first && last[-1] == '\r') last--;
+            line++;
+            return true;
+        }
+
+        /* Number of the last line returned, from 1. */
+        std::size_t lineNumber() const
+        {
+            return line;
+        }
+
+    private:
+        void fill()
+        {
+            std::memmove(buf.data(), buf.data() + begin, end - begin);
+            end -= begin;
+            scanned -= begin;
+            begin = 0;
+
+            if(end == buf.size()) buf.resize(buf.size() * 2);
+
+            is.read(buf.data() + end, buf.size() - end);
+            const std::streamsize got = is.gcount();
+            end += static_cast<std::size_t>(got);
+            if(got == 0 || !is) eof = true;
+        }
+
+        std::istream& is;
+        std::vector<char> buf;
+        std::size_t begin;
+        std::size_t scanned;
+        std::size_t end;
+        std::size_t line;
+        bool eof;
+};
+
+/* Collects formatted output to chunks of format_chunk_size. */
+class ChunkWriter
+{
+    public:
+        explicit ChunkWriter(std::ostream& new_os) :
+            os(new_os), buf(format_chunk_size), len(0) {}
+
+        /* Pointer to room for at least size more characters. */
+        char* room(std::size_t size)
+        {
+            if(len + size > buf.size()) flush();
+            return buf.data() + len;
+        }
+
+        /* Marks the characters up to p as written. */
+        void advance(char* p)
+        {
+            len = p - buf.data();
+        }
+
+        void write(const char* str)
+        {
+            const std::size_t size = std::strlen(str);
+            advance(std::copy(str, str + size, room(size)));
+        }
+
+        void flush()
+        {
+            os.write(buf.data(), len);
+            len = 0;
+        }
+
+    private:
+        std::ostream& os;
+        std::vector<char> buf;
+        std::size_t len;
+};
+
+static inline const char* skip_blank(const char* p, const char* last)
+{
+    while(p != last && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static inline bool is_blank(const char* p, const char* last)
+{
+    return skip_blank(p, last) == last;
+}
+
+/* Reads a blank-separated integer, nullptr if there is none. */
+static inline const char* next_int(const char* p, const char* last, int& out)
+{
+    return parse_integer(skip_blank(p, last), last, out);
+}
+
+static std::string line_error(const char* what, const LineReader& lines)
+{
+    return std::string{what} + " on line " + std::to_string(lines.lineNumber()) + ".";
+}
+
+/* Lowercase words of the banner line. */
+static std::vector<std::string> banner_words(const char* p, const char* last)
+{
+    std::vector<std::string> words;
+    std::string word;
+
+    for(; p != last; p++)
+    {
+        if(*p == ' ' || *p == '\t')
+        {
+            if(!word.empty()) words.push_back(std::move(word));
+            word.clear();
+        }
+        else
+        {
+            word.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(*p))));
+        }
+    }
+    if(!word.empty()) words.push_back(std::move(word));
+
+    return words;
+}
+
+/* Next line that is neither a comment nor blank. */
+static bool next_data_line(LineReader& lines, const char*& first, const char*& last)
+{
+    while(lines.next(first, last))
+    {
+        first = skip_blank(first, last);
+        if(first != last && *first != '%') return true;
+    }
+    return false;
+}
+
+enum class Symmetry
+{
+    general,
+    symmetric,
+    skew
+};
+
+/* Checks that element (i, j) can be set to v. */
+static void check_entry(std::size_t i, std::size_t j, int v, Symmetry sym,
+                        const LineReader& lines)
+{
+    if(sym != Symmetry::skew)
+    {
+        return;
+    }
+    if(i == j && v != 0)
+    {
+        throw std::invalid_argument(line_error(
+            "Nonzero diagonal in skew-symmetric matrix", lines));
+    }
+    if(v == std::numeric_limits<int>::min())
+    {
+        throw std::invalid_argument(line_error("Integer overflow", lines));
+    }
+}
+
+/* Sets element (i, j) and its mirror. */
+static void set_entry(std::vector<int>& values, std::size_t n, std::size_t i,
+                      std::size_t j, int v, Symmetry sym)
+{
+    values[i * n + j] = v;
+    if(sym != Symmetry::general && i != j)
+    {
+        values[j * n + i] = sym == Symmetry::skew ? -v : v;
+    }
+}
+
+/* Coordinate entry, zero-based. */
+struct CoordinateEntry
+{
+    std::size_t i;
+    std::size_t j;
+    int v;
+};
+
+ConcreteSquareMatrix readMatrixMarket(std::istream& is)
+{
+    LineReader lines{is};
+    const char* first = nullptr;
+    const char* last = nullptr;
+
+    if(!lines.next(first, last))
+    {
+        throw std::invalid_argument("Not a Matrix Market file.");
+    }
+
+    const std::vector<std::string> banner = banner_words(first, last);
+    if(banner.size() != 5 || banner[0] != "%%matrixmarket" || banner[1] != "matrix")
+    {
+        throw std::invalid_argument("Not a Matrix Market file.");
+    }
+
+    const bool coordinate = banner[2] == "coordinate";
+    if(!coordinate && banner[2] != "array")
+    {
+        throw std::invalid_argument("Unknown Matrix Market format.");
+    }
+
+    const bool pattern = banner[3] == "pattern";
+    if(banner[3] != "integer" && !(pattern && coordinate))
+    {
+        throw std::invalid_argument("Only integer Matrix Market files are supported.");
+    }
+
+    Symmetry sym = Symmetry::general;
+    if(banner[4] == "symmetric") sym = Symmetry::symmetric;
+    else if(banner[4] == "skew-symmetric") sym = Symmetry::skew;
+    else if(banner[4] != "general")
+    {
+        throw std::invalid_argument("Unsupported Matrix Market symmetry.");
+    }
+
+    int rows = 0;
+    int cols = 0;
+    int entries = 0;
+    if(!next_data_line(lines, first, last) ||
+       (first = next_int(first, last, rows)) == nullptr ||
+       (first = next_int(first, last, cols)) == nullptr ||
+       (coordinate && (first = next_int(first, last, entries)) == nullptr) ||
+       !is_blank(first, last) || rows < 0 || cols < 0 || entries < 0)
+    {
+        throw std::invalid_argument("Invalid Matrix Market size line.");
+    }
+    if(rows != cols)
+    {
+        throw std::invalid_argument("Not a squarematrix (rows != columns).");
+    }
+
+    if(static_cast<unsigned int>(rows) > max_exchange_n)
+    {
+        throw std::invalid_argument("Matrix Market matrix is too large.");
+    }
+
+    const std::size_t n = static_cast<std::size_t>(rows);
+    std::vector<int> values;
+
+    if(coordinate)
+    {
+        std::vector<CoordinateEntry> stored;
+        for(int k = 0; k < entries; k++)
+        {
+            int i = 0;
+            int j = 0;
+            int v = 1;
+            if(!next_data_line(lines, first, last) ||
+               (first = next_int(first, last, i)) == nullptr ||
+               (first = next_int(first, last, j)) == nullptr ||
+               (!pattern && (first = next_int(first, last, v)) == nullptr) ||
+               !is_blank(first, last))
+            {
+                throw std::invalid_argument(line_error("Invalid Matrix Market entry", lines));
+            }
+            if(i < 1 || j < 1 || i > rows || j > rows)
+            {
+                throw std::invalid_argument(line_error("Matrix Market index out of range", lines));
+            }
+
+            check_entry(i - 1, j - 1, v, sym, lines);
+            stored.push_back(CoordinateEntry{static_cast<std::size_t>(i - 1),
+                                             static_cast<std::size_t>(j - 1), v});
+        }
+
+        values.assign(n * n, 0);
+        for(const CoordinateEntry& e : stored)
+        {
+            set_entry(values, n, e.i, e.j, e.v, sym);
+        }
+    }
+    else
+    {
+        /* Column-major, only the lower triangle if there is symmetry. The
+         * skew-symmetric diagonal is not stored. */
+        const std::size_t count = sym == Symmetry::general ? n * n :
+            sym == Symmetry::skew ? n * (n - 1) / 2 : n * (n + 1) / 2;
+        std::vector<int> stored;
+
+        while(stored.size() < count && next_data_line(lines, first, last))
+        {
+            for(first = skip_blank(first, last); first != last;
+                first = skip_blank(first, last))
+            {
+                int v = 0;
+                if(stored.size() == count ||
+                   (first = parse_integer(first, last, v)) == nullptr)
+                {
+                    throw std::invalid_argument(line_error("Invalid Matrix Market entry", lines));
+                }
+                if(sym == Symmetry::skew && v == std::numeric_limits<int>::min())
+                {
+                    throw std::invalid_argument(line_error("Integer overflow", lines));
+                }
+                stored.push_back(v);
+            }
+        }
+
+        if(stored.size() < count)
+        {
+            throw std::invalid_argument("Matrix Market file is truncated.");
+        }
+
+        values.assign(n * n, 0);
+        std::size_t k = 0;
+        for(std::size_t j = 0; j < n; j++)
+        {
+            for(std::size_t i = sym == Symmetry::general ? 0 : j + (sym == Symmetry::skew);
+                i < n; i++)
+            {
+                set_entry(values, n, i, j, stored[k++], sym);
+            }
+        }
+    }
+
+    if(next_data_line(lines, first, last))
+    {
+        throw std::invalid_argument(line_error("Extra Matrix Market entry", lines));
+    }
+
+    return ConcreteSquareMatrix{static_cast<unsigned int>(n), values};
+}
+
+void writeMatrixMarket(std::ostream& os, const ConcreteSquareMatrix& m,
+                       MatrixMarketFormat format)
+{
+    const unsigned int n = m.getRowSize();
+    const bool coordinate = format == MatrixMarketFormat::coordinate;
+    ChunkWriter out{os};
+
+    out.write(coordinate ? "%%MatrixMarket matrix coordinate integer general\n"
+                         : "%%MatrixMarket matrix array integer general\n");
+
+    if(coordinate)
+    {
+        std::size_t entries = 0;
+        for(unsigned int i = 0; i < n; i++)
+        {
+            for(const IntElement* e : m.block(i * n, n))
+            {
+                if(e->getVal() != 0) entries++;
+            }
+        }
+
+        std::ostringstream size;
+        size << n << ' ' << n << ' ' << entries << '\n';
+        out.write(size.str().c_str());
+
+        for(unsigned int i = 0; i < n; i++)
+        {
+            const std::vector<IntElement*> row = m.block(i * n, n);
+            for(unsigned int j = 0; j < n; j++)
+            {
+                const int v = row[j]->getVal();
+                if(v == 0) continue;
+
+                char* p = out.room(3 * max_int_length + 3);
+                p = format_int(p, static_cast<int>(i + 1));
+                *p++ = ' ';
+                p = format_int(p, static_cast<int>(j + 1));
+                *p++ = ' ';
+                p = format_int(p, v);
+                *p++ = '\n';
+                out.advance(p);
+            }
+        }
+    }
+    else
+    {
+        std::ostringstream size;
+        size << n << ' ' << n << '\n';
+        out.write(size.str().c_str());
+
+        /* Rows are gathered to write the columns. */
+        std::vector<int> values;
+        values.reserve(static_cast<std::size_t>(n) * n);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            for(const IntElement* e : m.block(i * n, n)) values.push_back(e->getVal());
+        }
+
+        for(unsigned int j = 0; j < n; j++)
+        {
+            for(unsigned int i = 0; i < n; i++)
+            {
+                char* p = out.room(max_int_length + 1);
+                p = format_int(p, values[static_cast<std::size_t>(i) * n + j]);
+                *p++ = '\n';
+                out.advance(p);
+            }
+        }
+    }
+
+    out.flush();
+}
+
+ConcreteSquareMatrix readCsv(std::istream& is)
+{
+    LineReader lines{is};
+    const char* first = nullptr;
+    const char* last = nullptr;
+    std::size_t n = 0;
+    std::vector<std::vector<ElementPtr<IntElement>>> elements;
+
+    while(lines.next(first, last))
+    {
+        if(is_blank(first, last)) continue;
+        if(!elements.empty() && elements.size() == n)
+        {
+            throw std::invalid_argument(line_error("Too many rows", lines));
+        }
+
+        std::vector<ElementPtr<IntElement>> row;
+        row.reserve(n);
+
+        for(;;)
+        {
+            int v = 0;
+            first = next_int(first, last, v);
+            if(first == nullptr)
+            {
+                throw std::invalid_argument(line_error("Invalid CSV value", lines));
+            }
+            row.push_back(make_element<IntElement>(v));
+
+            first = skip_blank(first, last);
+            if(first == last) break;
+            if(*first++ != ',')
+            {
+                throw std::invalid_argument(line_error("Invalid CSV value", lines));
+            }
+        }
+
+        if(elements.empty()) n = row.size();
+        if(row.size() != n)
+        {
+            throw std::invalid_argument(line_error("Invalid CSV row length", lines));
+        }
+        elements.push_back(std::move(row));
+    }
+
+    if(elements.size() != n)
+    {
+        throw std::invalid_argument("Not a squarematrix (rows != columns).");
+    }
+
+    return ConcreteSquareMatrix{static_cast<unsigned int>(n), std::move(elements)};
+}
+
+void writeCsv(std::ostream& os, const ConcreteSquareMatrix& m)
+{
+    const unsigned int n = m.getRowSize();
+    ChunkWriter out{os};
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        const std::vector<IntElement*> row = m.block(i * n, n);
+        for(unsigned int j = 0; j < n; j++)
+        {
+            char* p = out.room(max_int_length + 1);
+            p = format_int(p, row[j]->getVal());
+            *p++ = j + 1 < n ? ',' : '\n';
+            out.advance(p);
+        }
+    }
+
+    out.flush();
+}
+
+static bool is_csv_path(const std::string& path)
+{
+    const std::string ext{".csv"};
+    return path.size() >= ext.size() &&
+           path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+ConcreteSquareMatrix importMatrix(const std::string& path)
+{
+    std::ifstream is{path, std::ios::binary};
+    if(!is)
+    {
+        throw std::runtime_error("Could not open matrix file.");
+    }
+
+    return is_csv_path(path) ? readCsv(is) : readMatrixMarket(is);
+}
+
+void exportMatrix(const std::string& path, const ConcreteSquareMatrix& m)
+{
+    std::ofstream os{path, std::ios::binary | std::ios::trunc};
+    if(!os)
+    {
+        throw std::runtime_error("Could not open matrix file for writing.");
+    }
+
+    if(is_csv_path(path)) writeCsv(os, m);
+    else writeMatrixMarket(os, m);
+
+    os.close();
+    if(!os)
+    {
+        throw std::runtime_error("Could not write matrix file.");
+    }
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Matrix Market files.", "[MatrixMarket][exchange]")
+{
+    ConcreteSquareMatrix conc{"[[1,0,-3][0,0,0][2147483647,-2147483648,5]]"};
+
+    std::ostringstream coord;
+    writeMatrixMarket(coord, conc);
+    CHECK(coord.str() ==
+          "%%MatrixMarket matrix coordinate integer general\n"
+          "3 3 5\n1 1 1\n1 3 -3\n3 1 2147483647\n3 2 -2147483648\n3 3 5\n");
+
+    std::ostringstream array;
+    writeMatrixMarket(array, conc, MatrixMarketFormat::array);
+    CHECK(array.str() ==
+          "%%MatrixMarket matrix array integer general\n"
+          "3 3\n1\n0\n2147483647\n0\n0\n-2147483648\n-3\n0\n5\n");
+
+    std::istringstream coord_in{coord.str()};
+    std::istringstream array_in{array.str()};
+    CHECK(readMatrixMarket(coord_in) == conc);
+    CHECK(readMatrixMarket(array_in) == conc);
+
+    std::istringstream symm{"%%MatrixMarket Matrix coordinate pattern symmetric\r\n"
+                            "% comment\r\n\r\n2 2 2\r\n2 1\r\n  1 1 \r\n"};
+    CHECK(readMatrixMarket(symm).toString() == "[[1,1][1,0]]");
+
+    std::istringstream skew{"%%MatrixMarket matrix array integer skew-symmetric\n"
+                            "3 3\n1\n2\n3\n"};
+    CHECK(readMatrixMarket(skew).toString() == "[[0,-1,-2][1,0,-3][2,3,0]]");
+
+    std::istringstream symm_array{"%%MatrixMarket matrix array integer symmetric\n"
+                                  "2 2\n1 2\n3\n"};
+    CHECK(readMatrixMarket(symm_array).toString() == "[[1,2][2,3]]");
+
+    /* Array values are all read before the matrix is allocated. */
+    std::istringstream short_array{"%%MatrixMarket matrix array integer general\n"
+                                   "30000 30000\n1\n2\n"};
+    CHECK_THROWS_AS(readMatrixMarket(short_array), std::invalid_argument&);
+
+    std::istringstream empty{"%%MatrixMarket matrix coordinate integer general\n0 0 0\n"};
+    CHECK(readMatrixMarket(empty).toString() == "[]");
+
+    for(const char* bad : {"", "[[1]]",
+        "%%MatrixMarket matrix coordinate real general\n1 1 1\n1 1 1.5\n",
+        "%%MatrixMarket matrix array pattern general\n1 1\n",
+        "%%MatrixMarket matrix coordinate integer general\n2 3 0\n",
+        "%%MatrixMarket matrix coordinate integer general\n2 2 1\n3 1 1\n",
+        "%%MatrixMarket matrix coordinate integer general\n2 2 2\n1 1 1\n",
+        "%%MatrixMarket matrix coordinate integer general\n2 2 1\n1 1 1\n2 2 2\n",
+        "%%MatrixMarket matrix coordinate integer skew-symmetric\n1 1 1\n1 1 1\n",
+        "%%MatrixMarket matrix array integer general\n2 2\n1\n2\n3\n",
+        "%%MatrixMarket matrix array integer general\n1 1\n1 x\n",
+        "%%MatrixMarket matrix array integer general\n2000000000 2000000000\n1\n",
+        "%%MatrixMarket matrix coordinate integer general\n8193 8193 0\n"})
+    {
+        std::istringstream is{bad};
+        CHECK_THROWS_AS(readMatrixMarket(is), std::invalid_argument&);
+    }
+}
+
+TEST_CASE("CSV files.", "[CSV][exchange]")
+{
+    ConcreteSquareMatrix conc{"[[1,-2][30,2147483647]]"};
+
+    std::ostringstream os;
+    writeCsv(os, conc);
+    CHECK(os.str() == "1,-2\n30,2147483647\n");
+
+    std::istringstream is{os.str()};
+    CHECK(readCsv(is) == conc);
+
+    std::istringstream spaced{"\n 1 ,\t-2\r\n30,2147483647\r\n\r\n"};
+    CHECK(readCsv(spaced) == conc);
+
+    std::istringstream empty{""};
+    CHECK(readCsv(empty).toString() == "[]");
+
+    for(const char* bad : {"1,2\n3\n", "1,2\n3,4\n5,6\n", "1,2\n", "1,,2\n",
+                           "1,2,\n3,4,\n", "1;2\n3;4\n", "2147483648\n"})
+    {
+        std::istringstream in{bad};
+        CHECK_THROWS_AS(readCsv(in), std::invalid_argument&);
+    }
+
+    /* Larger than a chunk, lines cross chunk boundaries. */
+    ConcreteSquareMatrix big{150};
+    std::stringstream csv;
+    std::stringstream mm;
+    writeCsv(csv, big);
+    writeMatrixMarket(mm, big);
+    CHECK(csv.str().size() > exchange_chunk_size);
+    CHECK(readCsv(csv) == big);
+    CHECK(readMatrixMarket(mm) == big);
+
+    const std::string path{"sqm_test_matrix.csv"};
+    exportMatrix(path, big);
+    CHECK(importMatrix(path) == big);
+    std::remove(path.c_str());
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,96 @@
+/** \file matrixexchange.hpp
+ *  \brief Matrix Market and CSV readers and writers.
+ */
+
+#ifndef MATRIXEXCHANGE_H
+#define MATRIXEXCHANGE_H
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include "squarematrix.hpp"
+
+/** \brief Size of the chunks the readers take from the stream at a time.
+ */
+const std::size_t exchange_chunk_size = 64 * 1024;
+
+/** \brief Largest row size readMatrixMarket() accepts. Each element of
+ *         the matrix made takes an element pointer and an element slab
+ *         block, 24 bytes on 64-bit targets, so a matrix this size takes
+ *         1.5 GiB, and the dense buffer it is made of 256 MiB more.
+ */
+const unsigned int max_exchange_n = 8 * 1024;
+
+/** \brief Layout of a written Matrix Market file.
+ */
+enum class MatrixMarketFormat
+{
+    /** \brief "array", all elements in column-major order. */
+    array,
+    /** \brief "coordinate", one "i j value" line per nonzero element. */
+    coordinate
+};
+
+/** \brief Reads a square integer matrix in Matrix Market format.
+ *
+ *  Both coordinate and array files are read, with integer or (coordinate
+ *  only) pattern fields and general, symmetric or skew-symmetric symmetry.
+ *  The input is taken in chunks of exchange_chunk_size. The elements are
+ *  collected to a dense n * n buffer before the matrix is made of it.
+ *  Coordinate entries and array values are kept until the last one is
+ *  read, so that the buffer is only allocated for input that has all of
+ *  them. Coordinate entries not given are zero; a repeated entry replaces
+ *  the earlier one.
+ *
+ *  \param is Stream to read from.
+ *  \return New instance of ConcreteSquareMatrix.
+ *  \throw std::invalid_argument if the input is invalid, not square, not
+ *         integer or larger than max_exchange_n.
+ */
+ConcreteSquareMatrix readMatrixMarket(std::istream& is);
+
+/** \brief Writes a matrix in Matrix Market format with integer field and
+ *         general symmetry, in chunks of format_chunk_size.
+ *  \param os Stream to write to.
+ *  \param m Matrix to write.
+ *  \param format Array or coordinate layout.
+ */
+void writeMatrixMarket(std::ostream& os, const ConcreteSquareMatrix& m,
+                       MatrixMarketFormat format = MatrixMarketFormat::coordinate);
+
+/** \brief Reads a square integer matrix from comma-separated values, one
+ *         row per line. Blank lines, spaces and tabs around values and
+ *         "\r\n" line ends are allowed. Reads in chunks like
+ *         readMatrixMarket().
+ *  \param is Stream to read from.
+ *  \return New instance of ConcreteSquareMatrix.
+ *  \throw std::invalid_argument if the input is invalid or not square.
+ */
+ConcreteSquareMatrix readCsv(std::istream& is);
+
+/** \brief Writes a matrix as comma-separated values, one row per line,
+ *         in chunks of format_chunk_size.
+ *  \param os Stream to write to.
+ *  \param m Matrix to write.
+ */
+void writeCsv(std::ostream& os, const ConcreteSquareMatrix& m);
+
+/** \brief Reads a file with readMatrixMarket(), or readCsv() if the
+ *         name ends with ".csv".
+ *  \param path Path of the file.
+ *  \return New instance of ConcreteSquareMatrix.
+ *  \throw std::runtime_error if the file cannot be read.
+ *  \throw std::invalid_argument if the contents are invalid.
+ */
+ConcreteSquareMatrix importMatrix(const std::string& path);
+
+/** \brief Writes a file with writeCsv() if the name ends with ".csv",
+ *         else with writeMatrixMarket() in coordinate format.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param m Matrix to write.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void exportMatrix(const std::string& path, const ConcreteSquareMatrix& m);
+
+#endif // MATRIXEXCHANGE_H
@@ -0,0 +1,581 @@
+/** \file matrixfile.cpp
+ *  \brief Binary matrix file implementation file.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "matrixfile.hpp"
+#include "bitpacking.hpp"
+#include "matrixformat.hpp"
+#include "tiledsquarematrix.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SQM_HAVE_MMAP 1
+#endif
+
+static_assert(sizeof(MatrixFileHeader) == 32, "MatrixFileHeader has padding.");
+static_assert(sizeof(int) == 4, "Matrix files store 32-bit elements.");
+
+static bool little_endian()
+{
+    const std::uint32_t one = 1;
+    char c;
+    std::memcpy(&c, &one, 1);
+    return c == 1;
+}
+
+MatrixFileMapping::MatrixFileMapping(const std::string& path) :
+    addr(nullptr), len(0)
+{
+#ifdef SQM_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error("Could not open matrix file.");
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Could not read matrix file.");
+    }
+
+    len = static_cast<std::size_t>(st.st_size);
+    if(len != 0)
+    {
+        void* p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not map matrix file.");
+        }
+        addr = static_cast<const char*>(p);
+    }
+
+    /* The mapping stays valid without the descriptor. */
+    ::close(fd);
+#else
+    std::ifstream is{path, std::ios::binary};
+    if(!is)
+    {
+        throw std::runtime_error("Could not open matrix file.");
+    }
+
+    buffer.assign(std::istreambuf_iterator<char>{is},
+                  std::istreambuf_iterator<char>{});
+    addr = buffer.data();
+    len = buffer.size();
+#endif
+}
+
+MatrixFileMapping::~MatrixFileMapping()
+{
+#ifdef SQM_HAVE_MMAP
+    if(addr != nullptr) ::munmap(const_cast<char*>(addr), len);
+#endif
+}
+
+const char* MatrixFileMapping::data() const
+{
+    return addr;
+}
+
+std::size_t MatrixFileMapping::size() const
+{
+    return len;
+}
+
+/* Checks the header and that the payload fits in the file. */
+static MatrixFileHeader read_header(const MatrixFileMapping& mapping)
+{
+    MatrixFileHeader h;
+    if(mapping.size() < sizeof(h))
+    {
+        throw std::invalid_argument("Not a matrix file.");
+    }
+    std::memcpy(&h, mapping.data(), sizeof(h));
+
+    if(std::memcmp(h.magic, matrix_file_magic, sizeof(h.magic)) != 0 ||
+       h.version != matrix_file_version)
+    {
+        throw std::invalid_argument("Not a matrix file.");
+    }
+    if(h.element_width != sizeof(int))
+    {
+        throw std::invalid_argument("Unsupported element width in matrix file.");
+    }
+    if(((h.flags & matrix_file_little_endian) != 0) != little_endian())
+    {
+        throw std::invalid_argument("Byte order of the matrix file does not match.");
+    }
+    if(h.payload_offset % alignof(int) != 0)
+    {
+        throw std::invalid_argument("Misaligned matrix file payload.");
+    }
+
+    /* Compressed blocks are checked while unpacking, here only that each
+     * has room for its size so that n cannot claim a huge allocation. */
+    const bool compressed = (h.flags & matrix_file_compressed) != 0;
+    const std::uint64_t size = static_cast<std::uint64_t>(h.n) * h.n;
+    const std::uint64_t count = compressed ?
+        (size + packed_block_size - 1) / packed_block_size : size;
+    const std::uint64_t unit = compressed ? min_packed_block_bytes : h.element_width;
+    if(h.payload_offset > mapping.size() ||
+       (mapping.size() - h.payload_offset) / unit < count)
+    {
+        throw std::invalid_argument("Matrix file is truncated.");
+    }
+
+    return h;
+}
+
+MappedSquareMatrix::MappedSquareMatrix(const std::string& path) :
+    mapping(std::make_shared<MatrixFileMapping>(path)), n(0), values(nullptr)
+{
+    const MatrixFileHeader h = read_header(*mapping);
+    if(h.flags & matrix_file_compressed)
+    {
+        throw std::invalid_argument("Compressed matrix file, use loadMatrixFile().");
+    }
+
+    n = h.n;
+    values = reinterpret_cast<const int*>(mapping->data() + h.payload_offset);
+}
+
+unsigned int MappedSquareMatrix::getRowSize() const
+{
+    return n;
+}
+
+SquareMatrix* MappedSquareMatrix::clone() const
+{
+    return new MappedSquareMatrix{*this};
+}
+
+void MappedSquareMatrix::print(std::ostream& os) const
+{
+    print_matrix(os, n, values);
+}
+
+std::string MappedSquareMatrix::toString() const
+{
+    return format_matrix(n, values);
+}
+
+ConcreteSquareMatrix MappedSquareMatrix::evaluate(const Valuation&) const
+{
+    return ConcreteSquareMatrix{
+        n, std::vector<int>(values, values + static_cast<std::size_t>(n) * n)};
+}
+
+int MappedSquareMatrix::at(unsigned int i, unsigned int j) const
+{
+    if(i >= n || j >= n)
+    {
+        throw std::out_of_range("Index out of range.");
+    }
+
+    return values[static_cast<std::size_t>(i) * n + j];
+}
+
+const int* MappedSquareMatrix::data() const
+{
+    return values;
+}
+
+/* Collects elements to blocks of packed_block_size and writes them
+ * bit-packed. */
+class BlockPacker
+{
+    public:
+        explicit BlockPacker(std::ostream& new_os) : os(new_os), count(0) {}
+
+        void push(const int* values, unsigned int len)
+        {
+            for(unsigned int i = 0; i < len; i++)
+            {
+                block[count++] = values[i];
+                if(count == packed_block_size) flush();
+            }
+        }
+
+        /* Pads the last block with its first value, which does not
+         * widen its range. */
+        void finish()
+        {
+            if(count == 0) return;
+            while(count < packed_block_size) block[count++] = block[0];
+            flush();
+        }
+
+    private:
+        void flush()
+        {
+            unsigned char out[max_packed_block_bytes];
+            os.write(reinterpret_cast<const char*>(out), pack_block(block, out));
+            count = 0;
+        }
+
+        std::ostream& os;
+        int block[packed_block_size];
+        unsigned int count;
+};
+
+/* Writes the header and then the rows one at a time, fill_row(i, out)
+ * putting the n elements of row i to out. The rows may come from path
+ * itself, a MappedSquareMatrix of it for instance, so the file is written
+ * next to path and renamed over it at the end. */
+template <typename RowFiller>
+static void write_matrix_file(const std::string& path, unsigned int n,
+                              RowFiller fill_row, bool compressed)
+{
+#ifdef SQM_HAVE_MMAP
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+#else
+    const std::string tmp = path + ".tmp";
+#endif
+    std::ofstream os{tmp, std::ios::binary | std::ios::trunc};
+    if(!os)
+    {
+        throw std::runtime_error("Could not open matrix file for writing.");
+    }
+
+    MatrixFileHeader h;
+    std::memcpy(h.magic, matrix_file_magic, sizeof(h.magic));
+    h.version = matrix_file_version;
+    h.n = n;
+    h.element_width = sizeof(int);
+    h.flags = little_endian() ? matrix_file_little_endian : 0;
+    h.payload_offset = matrix_file_alignment;
+
+    /* Compressed files are not mapped, so they need no page alignment. */
+    if(compressed)
+    {
+        h.flags |= matrix_file_compressed;
+        h.payload_offset = sizeof(h);
+    }
+
+    const std::vector<char> padding(h.payload_offset - sizeof(h), 0);
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    os.write(padding.data(), padding.size());
+
+    try
+    {
+        BlockPacker packer{os};
+        std::vector<int> row(n);
+        for(unsigned int i = 0; i < n && os; i++)
+        {
+            fill_row(i, row.data());
+            if(compressed)
+            {
+                packer.push(row.data(), n);
+            }
+            else
+            {
+                os.write(reinterpret_cast<const char*>(row.data()), n * sizeof(int));
+            }
+        }
+        packer.finish();
+    }
+    catch(...)
+    {
+        os.close();
+        std::remove(tmp.c_str());
+        throw;
+    }
+
+    os.close();
+    if(!os || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Could not write matrix file.");
+    }
+}
+
+static void save_values(const std::string& path, unsigned int n,
+                        const int* values, bool compressed)
+{
+    write_matrix_file(path, n, [n, values](unsigned int i, int* out)
+    {
+        std::copy(values + static_cast<std::size_t>(i) * n,
+                  values + static_cast<std::size_t>(i + 1) * n, out);
+    }, compressed);
+}
+
+static void save_concrete(const std::string& path, const ConcreteSquareMatrix& m,
+                          bool compressed)
+{
+    const unsigned int n = m.getRowSize();
+    write_matrix_file(path, n, [n, &m](unsigned int i, int* out)
+    {
+        for(const IntElement* e : m.block(i * n, n)) *out++ = e->getVal();
+    }, compressed);
+}
+
+/* Rows are asked for in order, so one row of tiles is kept in memory. */
+static void save_tiled(const std::string& path, const TiledSquareMatrix& m,
+                       bool compressed)
+{
+    const unsigned int n = m.getRowSize();
+    const unsigned int tile = m.getTileSize();
+    std::vector<int> band;
+
+    write_matrix_file(path, n, [&](unsigned int i, int* out)
+    {
+        if(i % tile == 0) m.readRowBand(i / tile, band);
+
+        const int* row = band.data() + static_cast<std::size_t>(i % tile) * n;
+        std::copy(row, row + n, out);
+    }, compressed);
+}
+
+static void save_matrix(const std::string& path, const SquareMatrix& m,
+                        const Valuation& val, bool compressed)
+{
+    if(auto c = dynamic_cast<const ConcreteSquareMatrix*>(&m))
+    {
+        save_concrete(path, *c, compressed);
+    }
+    else if(auto mapped = dynamic_cast<const MappedSquareMatrix*>(&m))
+    {
+        save_values(path, mapped->getRowSize(), mapped->data(), compressed);
+    }
+    else if(auto tiled = dynamic_cast<const TiledSquareMatrix*>(&m))
+    {
+        save_tiled(path, *tiled, compressed);
+    }
+    else
+    {
+        save_concrete(path, m.evaluate(val), compressed);
+    }
+}
+
+void saveMatrixFile(const std::string& path, unsigned int n, const int* values)
+{
+    save_values(path, n, values, false);
+}
+
+void saveMatrixFile(const std::string& path, unsigned int n,
+                    const MatrixRowFiller& fill_row)
+{
+    write_matrix_file(path, n, fill_row, false);
+}
+
+void saveMatrixFile(const std::string& path, const SquareMatrix& m,
+                    const Valuation& val)
+{
+    save_matrix(path, m, val, false);
+}
+
+void saveCompressedMatrixFile(const std::string& path, const SquareMatrix& m,
+                              const Valuation& val)
+{
+    save_matrix(path, m, val, true);
+}
+
+ConcreteSquareMatrix loadMatrixFile(const std::string& path)
+{
+    const MatrixFileMapping mapping{path};
+    const MatrixFileHeader h = read_header(mapping);
+    const std::size_t size = static_cast<std::size_t>(h.n) * h.n;
+    const char* p = mapping.data() + h.payload_offset;
+
+    if(!(h.flags & matrix_file_compressed))
+    {
+        const int* values = reinterpret_cast<const int*>(p);
+        return ConcreteSquareMatrix{h.n, std::vector<int>(values, values + size)};
+    }
+
+    const std::size_t blocks = (size + packed_block_size - 1) / packed_block_size;
+    std::vector<int> values(blocks * packed_block_size);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(p);
+    const unsigned char* end =
+        reinterpret_cast<const unsigned char*>(mapping.data() + mapping.size());
+
+    for(std::size_t i = 0; i < blocks; i++)
+    {
+        const std::size_t bytes = end - in < 8 ? 0 : packed_block_bytes(in);
+        if(bytes == 0 || static_cast<std::size_t>(end - in) < bytes)
+        {
+            throw std::invalid_argument("Matrix file is truncated.");
+        }
+
+        unpack_block(in, values.data() + i * packed_block_size);
+        in += bytes;
+    }
+
+    values.resize(size);
+    return ConcreteSquareMatrix{h.n, values};
+}
+
+std::unique_ptr<SquareMatrix> openMatrixFile(const std::string& path)
+{
+    bool compressed = false;
+    {
+        const MatrixFileMapping mapping{path};
+        compressed = (read_header(mapping).flags & matrix_file_compressed) != 0;
+    }
+
+    if(compressed)
+    {
+        return std::unique_ptr<SquareMatrix>{
+            new ConcreteSquareMatrix{loadMatrixFile(path)}};
+    }
+
+    return std::unique_ptr<SquareMatrix>{new MappedSquareMatrix{path}};
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Binary matrix files.", "[MatrixFile][MappedSquareMatrix]")
+{
+    const std::string path{"sqm_test_matrix.bin"};
+    ConcreteSquareMatrix conc{"[[1,-2,3][4,5,-6][2147483647,8,-2147483648]]"};
+
+    saveMatrixFile(path, conc);
+    {
+        MappedSquareMatrix mapped{path};
+        CHECK(mapped.getRowSize() == 3);
+        CHECK(mapped.at(2, 0) == 2147483647);
+        CHECK(mapped.at(0, 1) == -2);
+        CHECK_THROWS_AS(mapped.at(3, 0), std::out_of_range&);
+        CHECK(reinterpret_cast<std::uintptr_t>(mapped.data()) %
+              matrix_file_alignment == 0);
+
+        CHECK(mapped.toString() == conc.toString());
+        CHECK(mapped.evaluate(Valuation{}) == conc);
+
+        std::stringstream ss;
+        mapped.print(ss);
+        CHECK(ss.str() == conc.toString());
+
+        /* Copies share the mapping, also after the file is gone. */
+        std::unique_ptr<SquareMatrix> clone{mapped.clone()};
+        std::remove(path.c_str());
+        CHECK(clone->toString() == conc.toString());
+    }
+
+    const int values[] = {1, 2, 3, 4};
+    saveMatrixFile(path, 2, values);
+    MappedSquareMatrix m2{path};
+    CHECK(m2.toString() == "[[1,2][3,4]]");
+
+    SymbolicSquareMatrix symb{"[[a,1][2,3]]"};
+    CHECK_THROWS(saveMatrixFile(path, symb));
+    saveMatrixFile(path, symb, Valuation{{'a', 7}});
+    CHECK(MappedSquareMatrix{path}.toString() == "[[7,1][2,3]]");
+
+    saveMatrixFile(path, ConcreteSquareMatrix{});
+    CHECK(MappedSquareMatrix{path}.toString() == "[]");
+
+    {
+        std::ofstream os{path, std::ios::binary | std::ios::trunc};
+        os << "[[1,2][3,4]]";
+    }
+    CHECK_THROWS_AS(MappedSquareMatrix{path}, std::invalid_argument&);
+
+    /* Truncated payload. */
+    saveMatrixFile(path, 2, values);
+    {
+        std::ifstream is{path, std::ios::binary};
+        std::string bytes{std::istreambuf_iterator<char>{is},
+                          std::istreambuf_iterator<char>{}};
+        std::ofstream os{path, std::ios::binary | std::ios::trunc};
+        os.write(bytes.data(), bytes.size() - 1);
+    }
+    CHECK_THROWS_AS(MappedSquareMatrix{path}, std::invalid_argument&);
+
+    /* A loaded file saved onto itself, its mapping still in use. */
+    saveMatrixFile(path, 2, values);
+    {
+        MappedSquareMatrix self{path};
+        saveMatrixFile(path, self);
+        CHECK(self.toString() == "[[1,2][3,4]]");
+        CHECK(MappedSquareMatrix{path}.toString() == "[[1,2][3,4]]");
+        saveCompressedMatrixFile(path, self);
+        CHECK(loadMatrixFile(path).toString() == "[[1,2][3,4]]");
+    }
+    CHECK_THROWS_AS(saveMatrixFile(path, 2, [](unsigned int, int*)
+        {
+            throw std::runtime_error("No rows.");
+        }), std::runtime_error&);
+    CHECK(loadMatrixFile(path).toString() == "[[1,2][3,4]]");
+
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(MappedSquareMatrix{path}, std::runtime_error&);
+}
+
+TEST_CASE("Compressed matrix files.", "[MatrixFile][bitpacking]")
+{
+    const std::string path{"sqm_test_matrix.sqz"};
+    const std::string plain{"sqm_test_matrix.bin"};
+
+    /* Random elements are in -99..99, 8 bits per element. */
+    ConcreteSquareMatrix conc{60};
+    saveCompressedMatrixFile(path, conc);
+    saveMatrixFile(plain, conc);
+    CHECK(loadMatrixFile(path) == conc);
+    CHECK(loadMatrixFile(plain) == conc);
+    CHECK(openMatrixFile(path)->toString() == conc.toString());
+    CHECK(dynamic_cast<MappedSquareMatrix*>(openMatrixFile(plain).get()) != nullptr);
+    CHECK_THROWS_AS(MappedSquareMatrix{path}, std::invalid_argument&);
+
+    std::ifstream packed{path, std::ios::binary | std::ios::ate};
+    CHECK(static_cast<std::size_t>(packed.tellg()) < 60 * 60 * sizeof(int) / 3);
+
+    ConcreteSquareMatrix same{"[[5,5,5][5,5,5][5,5,5]]"};
+    saveCompressedMatrixFile(path, same);
+    CHECK(loadMatrixFile(path) == same);
+
+    SymbolicSquareMatrix symb{"[[a,-2147483648][2147483647,0]]"};
+    saveCompressedMatrixFile(path, symb, Valuation{{'a', 1}});
+    CHECK(loadMatrixFile(path).toString() == "[[1,-2147483648][2147483647,0]]");
+
+    saveCompressedMatrixFile(path, ConcreteSquareMatrix{});
+    CHECK(loadMatrixFile(path).toString() == "[]");
+
+    /* Truncated block. */
+    saveCompressedMatrixFile(path, conc);
+    {
+        std::ifstream is{path, std::ios::binary};
+        std::string bytes{std::istreambuf_iterator<char>{is},
+                          std::istreambuf_iterator<char>{}};
+        std::ofstream os{path, std::ios::binary | std::ios::trunc};
+        os.write(bytes.data(), bytes.size() - 1);
+    }
+    CHECK_THROWS_AS(loadMatrixFile(path), std::invalid_argument&);
+
+    /* Row size too large for the payload is rejected before allocating. */
+    saveCompressedMatrixFile(path, same);
+    {
+        std::ifstream is{path, std::ios::binary};
+        std::string bytes{std::istreambuf_iterator<char>{is},
+                          std::istreambuf_iterator<char>{}};
+        MatrixFileHeader h;
+        std::memcpy(&h, bytes.data(), sizeof(h));
+        h.n = 4000000000u;
+        std::memcpy(&bytes[0], &h, sizeof(h));
+        std::ofstream os{path, std::ios::binary | std::ios::trunc};
+        os.write(bytes.data(), bytes.size());
+    }
+    CHECK_THROWS_AS(loadMatrixFile(path), std::invalid_argument&);
+    CHECK_THROWS_AS(openMatrixFile(path), std::invalid_argument&);
+
+    std::remove(path.c_str());
+    std::remove(plain.c_str());
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,233 @@
+/** \file matrixfile.hpp
+ *  \brief Binary matrix files and MappedSquareMatrix.
+ */
+
+#ifndef MATRIXFILE_H
+#define MATRIXFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "squarematrix.hpp"
+
+/** \brief First bytes of a binary matrix file.
+ */
+const char matrix_file_magic[8] = {'S', 'Q', 'M', 'B', 'I', 'N', '\r', '\n'};
+
+/** \brief Version written to new binary matrix files.
+ */
+const std::uint32_t matrix_file_version = 1;
+
+/** \brief Flag set if the file is little-endian.
+ */
+const std::uint32_t matrix_file_little_endian = 1;
+
+/** \brief Flag set if the payload is bit-packed, see pack_block().
+ */
+const std::uint32_t matrix_file_compressed = 2;
+
+/** \brief Alignment of the payload in the file, one page on common
+ *         systems, so the elements of a mapped file start on a page.
+ */
+const std::size_t matrix_file_alignment = 4096;
+
+/** \struct MatrixFileHeader
+ *  \brief Header at the start of a binary matrix file. It is followed by
+ *         padding up to payload_offset, and then n * n elements of
+ *         element_width bytes in row-major order. In compressed files the
+ *         elements are in blocks of packed_block_size written by
+ *         pack_block(), the last block padded.
+ */
+struct MatrixFileHeader
+{
+    /** \brief matrix_file_magic.
+     */
+    char magic[8];
+
+    /** \brief File format version.
+     */
+    std::uint32_t version;
+
+    /** \brief Row size of the matrix.
+     */
+    std::uint32_t n;
+
+    /** \brief Bytes per element, sizeof(int).
+     */
+    std::uint32_t element_width;
+
+    /** \brief matrix_file_* flags.
+     */
+    std::uint32_t flags;
+
+    /** \brief Offset of the first element from the start of the file.
+     */
+    std::uint64_t payload_offset;
+};
+
+/** \class MatrixFileMapping
+ *  \brief Read-only view of a whole file. The file is memory-mapped on
+ *         POSIX systems, so pages are read in on demand, and read into
+ *         memory elsewhere.
+ */
+class MatrixFileMapping
+{
+    public:
+        /** \brief Maps a file.
+         *  \param path Path of the file.
+         *  \throw std::runtime_error if the file cannot be opened or mapped.
+         */
+        explicit MatrixFileMapping(const std::string& path);
+
+        /** \brief Unmaps the file.
+         */
+        ~MatrixFileMapping();
+
+        MatrixFileMapping(const MatrixFileMapping&) = delete;
+        MatrixFileMapping& operator=(const MatrixFileMapping&) = delete;
+
+        /** \brief Get the contents of the file.
+         *  \return Pointer to the first byte.
+         */
+        const char* data() const;
+
+        /** \brief Get the size of the file.
+         *  \return Byte count.
+         */
+        std::size_t size() const;
+
+    private:
+        const char* addr;
+        std::size_t len;
+        std::vector<char> buffer;
+};
+
+/** \class MappedSquareMatrix
+ *  \brief Concrete matrix that uses the payload of a binary matrix file
+ *         as its storage, without copying it.
+ *
+ *  Copies share the mapping. Loading takes constant time; elements are
+ *  read from the file when they are first touched.
+ */
+class MappedSquareMatrix : public SquareMatrix
+{
+    public:
+        /** \brief Loads a binary matrix file.
+         *  \param path Path of the file.
+         *  \throw std::runtime_error if the file cannot be read.
+         *  \throw std::invalid_argument if it is not a valid uncompressed
+         *         matrix file for this system.
+         */
+        explicit MappedSquareMatrix(const std::string& path);
+
+        /** \brief Get row size of the matrix.
+         *  \return Value of member n.
+         */
+        unsigned int getRowSize() const override;
+
+        /** \brief Returns pointer to a copy of this sharing the mapping.
+         *  \return SquareMatrix pointer.
+         */
+        SquareMatrix* clone() const override;
+
+        /** \brief Prints string representation to output stream.
+         *  \param os std::ostream reference.
+         */
+        void print(std::ostream& os) const override;
+
+        /** \brief Returns string representation of the matrix.
+         *  \return std::string.
+         */
+        std::string toString() const override;
+
+        /** \brief Copies the elements to a ConcreteSquareMatrix.
+         *  \param val Valuation map (unused).
+         *  \return New instance of ConcreteSquareMatrix.
+         */
+        ConcreteSquareMatrix evaluate(const Valuation& val) const override;
+
+        /** \brief Element getter.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \return Value of the element.
+         *  \throw std::out_of_range if i or j is not below n.
+         */
+        int at(unsigned int i, unsigned int j) const;
+
+        /** \brief Get the elements in row-major order.
+         *  \return Pointer into the mapping.
+         */
+        const int* data() const;
+
+    private:
+        std::shared_ptr<const MatrixFileMapping> mapping;
+        unsigned int n;
+        const int* values;
+};
+
+/** \brief Writes n * n integers in row-major order to a binary matrix file.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param n Row size.
+ *  \param values Pointer to the integers.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void saveMatrixFile(const std::string& path, unsigned int n, const int* values);
+
+/** \brief Fills out with the n elements of row i.
+ */
+using MatrixRowFiller = std::function<void(unsigned int i, int* out)>;
+
+/** \brief Writes a matrix to a binary matrix file one row at a time, for
+ *         matrices that are not in memory as a whole. Rows are asked for
+ *         in order.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param n Row size.
+ *  \param fill_row Function giving the rows.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void saveMatrixFile(const std::string& path, unsigned int n,
+                    const MatrixRowFiller& fill_row);
+
+/** \brief Writes a matrix to a binary matrix file. Matrices other than
+ *         ConcreteSquareMatrix and MappedSquareMatrix are evaluated first.
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param m Matrix to write.
+ *  \param val Valuation map for evaluating m.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void saveMatrixFile(const std::string& path, const SquareMatrix& m,
+                    const Valuation& val = Valuation{});
+
+/** \brief Writes a matrix to a compressed binary matrix file. Elements are
+ *         bit-packed in blocks, which shrinks matrices of small-range or
+ *         repeated values several times. See saveMatrixFile().
+ *  \param path Path of the file, overwritten if it exists.
+ *  \param m Matrix to write.
+ *  \param val Valuation map for evaluating m.
+ *  \throw std::runtime_error if the file cannot be written.
+ */
+void saveCompressedMatrixFile(const std::string& path, const SquareMatrix& m,
+                              const Valuation& val = Valuation{});
+
+/** \brief Reads a compressed or uncompressed binary matrix file to
+ *         a ConcreteSquareMatrix.
+ *  \param path Path of the file.
+ *  \return New instance of ConcreteSquareMatrix.
+ *  \throw std::runtime_error if the file cannot be read.
+ *  \throw std::invalid_argument if it is not a valid matrix file.
+ */
+ConcreteSquareMatrix loadMatrixFile(const std::string& path);
+
+/** \brief Opens a binary matrix file: uncompressed files are mapped to
+ *         a MappedSquareMatrix, compressed ones read with loadMatrixFile().
+ *  \param path Path of the file.
+ *  \return Pointer to the new SquareMatrix.
+ *  \throw std::runtime_error if the file cannot be read.
+ *  \throw std::invalid_argument if it is not a valid matrix file.
+ */
+std::unique_ptr<SquareMatrix> openMatrixFile(const std::string& path);
+
+#endif // MATRIXFILE_H
@@ -0,0 +1,407 @@
+/** \file matrixformat.cpp
+ *  \brief Matrix formatting implementation file.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include "matrixformat.hpp"
+#include "workerpool.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+/* "00" to "99", two digits are written at a time. */
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline std::size_t digit_count(unsigned int u)
+{
+    if(u < 10) return 1;
+    if(u < 100) return 2;
+    if(u < 1000) return 3;
+    if(u < 10000) return 4;
+    if(u < 100000) return 5;
+    if(u < 1000000) return 6;
+    if(u < 10000000) return 7;
+    if(u < 100000000) return 8;
+    if(u < 1000000000) return 9;
+    return 10;
+}
+
+/* Magnitude of v, also for INT_MIN. */
+static inline unsigned int magnitude(int v)
+{
+    return v < 0 ? 0u - static_cast<unsigned int>(v)
+                 : static_cast<unsigned int>(v);
+}
+
+std::size_t formatted_length(int v)
+{
+    return (v < 0 ? 1 : 0) + digit_count(magnitude(v));
+}
+
+char* format_int(char* out, int v)
+{
+    unsigned int u = magnitude(v);
+    if(v < 0) *out++ = '-';
+
+    char* const end = out + digit_count(u);
+    char* p = end;
+
+    while(u >= 100)
+    {
+        const unsigned int i = (u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+    }
+
+    if(u >= 10)
+    {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + u);
+    }
+
+    return end;
+}
+
+static inline std::size_t element_length(const IntElement& e)
+{
+    return formatted_length(e.getVal());
+}
+
+static inline char* format_element(char* out, const IntElement& e)
+{
+    return format_int(out, e.getVal());
+}
+
+static inline std::size_t element_length(const Element& e)
+{
+    if(auto i = dynamic_cast<const IntElement*>(&e)) return element_length(*i);
+    if(dynamic_cast<const VariableElement*>(&e)) return 1;
+    return e.toString().size();
+}
+
+static inline char* format_element(char* out, const Element& e)
+{
+    if(auto i = dynamic_cast<const IntElement*>(&e)) return format_element(out, *i);
+    if(auto v = dynamic_cast<const VariableElement*>(&e))
+    {
+        *out++ = v->getVal();
+        return out;
+    }
+
+    const std::string str = e.toString();
+    return std::copy(str.begin(), str.end(), out);
+}
+
+template <typename T>
+static std::size_t row_length(const std::vector<ElementPtr<T>>& row)
+{
+    /* Brackets and commas. */
+    std::size_t len = row.empty() ? 2 : row.size() + 1;
+    for(const auto& e : row) len += element_length(*e);
+    return len;
+}
+
+template <typename T>
+static char* write_row(char* out, const std::vector<ElementPtr<T>>& row)
+{
+    *out++ = '[';
+    bool firstel = true;
+    for(const auto& e : row)
+    {
+        if(!firstel) *out++ = ',';
+        out = format_element(out, *e);
+        firstel = false;
+    }
+    *out++ = ']';
+    return out;
+}
+
+/* Row-major ints seen as rows, for format_matrix(unsigned int, const int*). */
+struct IntRow
+{
+    const int* data;
+    unsigned int n;
+};
+
+struct IntRows
+{
+    const int* data;
+    unsigned int n;
+
+    unsigned int size() const {return n;}
+    IntRow operator[](unsigned int i) const
+    {
+        return IntRow{data + static_cast<std::size_t>(i) * n, n};
+    }
+};
+
+static std::size_t row_length(const IntRow& row)
+{
+    std::size_t len = row.n == 0 ? 2 : row.n + 1;
+    for(unsigned int j = 0; j < row.n; j++) len += formatted_length(row.data[j]);
+    return len;
+}
+
+static char* write_row(char* out, const IntRow& row)
+{
+    *out++ = '[';
+    for(unsigned int j = 0; j < row.n; j++)
+    {
+        if(j != 0) *out++ = ',';
+        out = format_int(out, row.data[j]);
+    }
+    *out++ = ']';
+    return out;
+}
+
+/* Rows are measured and formatted on the WorkerPool. Each row gets the
+ * region of the buffer its offset points to, so threads never write to
+ * the same place. Formatting only reads the elements. */
+template <typename Rows>
+static std::string write_matrix_parallel(const Rows& rows)
+{
+    const unsigned int n = rows.size();
+    std::vector<std::size_t> offsets(n + 1, 0);
+
+    parallel_for(0, n, 16, [&rows, &offsets](unsigned int b, unsigned int e)
+    {
+        for(unsigned int i = b; i < e; i++) offsets[i + 1] = row_length(rows[i]);
+    });
+
+    /* After the opening bracket. */
+    offsets[0] = 1;
+    for(unsigned int i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+
+    std::string str(offsets[n] + 1, '\0');
+    char* const out = &str[0];
+    out[0] = '[';
+    out[offsets[n]] = ']';
+
+    parallel_for(0, n, 16, [&rows, &offsets, out](unsigned int b, unsigned int e)
+    {
+        for(unsigned int i = b; i < e; i++) write_row(out + offsets[i], rows[i]);
+    });
+
+    return str;
+}
+
+template <typename Rows>
+static std::string write_matrix(const Rows& rows)
+{
+    if(rows.size() >= parallel_format_min_rows) return write_matrix_parallel(rows);
+
+    const unsigned int n = rows.size();
+    std::size_t len = 2;
+    for(unsigned int i = 0; i < n; i++) len += row_length(rows[i]);
+
+    std::string str(len, '\0');
+    char* out = &str[0];
+    *out++ = '[';
+    for(unsigned int i = 0; i < n; i++) out = write_row(out, rows[i]);
+    *out = ']';
+
+    return str;
+}
+
+template <typename Rows>
+static void write_matrix(std::ostream& os, const Rows& rows,
+                         std::size_t chunk_size)
+{
+    if(rows.size() >= parallel_format_min_rows)
+    {
+        const std::string str = write_matrix_parallel(rows);
+        os.write(str.data(), str.size());
+        return;
+    }
+
+    /* Small matrices need no more than their own size. */
+    const unsigned int n = rows.size();
+    const std::size_t estimate = n == 0 ? 2 : row_length(rows[0]) * n + 2;
+    std::vector<char> buf(std::max<std::size_t>(
+        std::min(chunk_size, estimate), 1));
+    std::size_t used = 0;
+
+    buf[used++] = '[';
+    for(unsigned int i = 0; i < n; i++)
+    {
+        /* One more for the closing bracket. */
+        const std::size_t len = row_length(rows[i]);
+        if(used + len + 1 > buf.size())
+        {
+            os.write(buf.data(), used);
+            used = 0;
+            if(len + 1 > buf.size()) buf.resize(len + 1);
+        }
+        used = write_row(buf.data() + used, rows[i]) - buf.data();
+    }
+
+    if(used == buf.size())
+    {
+        os.write(buf.data(), used);
+        used = 0;
+    }
+    buf[used++] = ']';
+    os.write(buf.data(), used);
+}
+
+std::size_t formatted_length(const std::vector<ElementPtr<IntElement>>& row)
+{
+    return row_length(row);
+}
+
+std::size_t formatted_length(const std::vector<ElementPtr<Element>>& row)
+{
+    return row_length(row);
+}
+
+char* format_row(char* out, const std::vector<ElementPtr<IntElement>>& row)
+{
+    return write_row(out, row);
+}
+
+char* format_row(char* out, const std::vector<ElementPtr<Element>>& row)
+{
+    return write_row(out, row);
+}
+
+std::string format_matrix(const std::vector<std::vector<ElementPtr<IntElement>>>& rows)
+{
+    return write_matrix(rows);
+}
+
+std::string format_matrix(const std::vector<std::vector<ElementPtr<Element>>>& rows)
+{
+    return write_matrix(rows);
+}
+
+void print_matrix(std::ostream& os,
+                  const std::vector<std::vector<ElementPtr<IntElement>>>& rows,
+                  std::size_t chunk_size)
+{
+    write_matrix(os, rows, chunk_size);
+}
+
+void print_matrix(std::ostream& os,
+                  const std::vector<std::vector<ElementPtr<Element>>>& rows,
+                  std::size_t chunk_size)
+{
+    write_matrix(os, rows, chunk_size);
+}
+
+std::string format_matrix(unsigned int n, const int* values)
+{
+    return write_matrix(IntRows{values, n});
+}
+
+void print_matrix(std::ostream& os, unsigned int n, const int* values,
+                  std::size_t chunk_size)
+{
+    write_matrix(os, IntRows{values, n}, chunk_size);
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Integer formatting.", "[format]")
+{
+    const std::vector<int> values{
+        0, 1, -1, 9, 10, -10, 99, 100, 12345, -99999, 1000000000,
+        std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+
+    for(int v : values)
+    {
+        char buf[max_int_length];
+        char* end = format_int(buf, v);
+        CHECK(std::string(buf, end) == std::to_string(v));
+        CHECK(formatted_length(v) == static_cast<std::size_t>(end - buf));
+    }
+}
+
+TEST_CASE("Matrix formatting.", "[format][SquareMatrix]")
+{
+    std::vector<std::vector<ElementPtr<IntElement>>> conc;
+    for(int i = 0; i < 3; i++)
+    {
+        std::vector<ElementPtr<IntElement>> row;
+        for(int j = 0; j < 3; j++)
+        {
+            row.push_back(ElementPtr<IntElement>{new IntElement{i * 100 - j}});
+        }
+        conc.push_back(std::move(row));
+    }
+
+    const std::string expected{"[[0,-1,-2][100,99,98][200,199,198]]"};
+    CHECK(format_matrix(conc) == expected);
+    CHECK(formatted_length(conc[1]) == 11);
+
+    /* Chunks smaller than the output and smaller than a row. */
+    for(std::size_t chunk : {1, 5, 13, 64, 4096})
+    {
+        std::stringstream ss;
+        print_matrix(ss, conc, chunk);
+        CHECK(ss.str() == expected);
+    }
+
+    std::vector<std::vector<ElementPtr<Element>>> symb(1);
+    symb[0].push_back(ElementPtr<Element>{new VariableElement{'x'}});
+    symb[0].push_back(ElementPtr<Element>{new IntElement{-7}});
+    CHECK(format_matrix(symb) == "[[x,-7]]");
+
+    const int ints[] = {0, -1, -2, 100, 99, 98, 200, 199, 198};
+    CHECK(format_matrix(3, ints) == expected);
+    std::stringstream ints_ss;
+    print_matrix(ints_ss, 3, ints, 7);
+    CHECK(ints_ss.str() == expected);
+
+    std::stringstream ss;
+    print_matrix(ss, symb);
+    CHECK(ss.str() == "[[x,-7]]");
+
+    CHECK(format_matrix(std::vector<std::vector<ElementPtr<Element>>>{}) == "[]");
+    std::stringstream empty;
+    print_matrix(empty, std::vector<std::vector<ElementPtr<IntElement>>>{}, 1);
+    CHECK(empty.str() == "[]");
+}
+
+TEST_CASE("Parallel matrix formatting.", "[format][WorkerPool][thread]")
+{
+    const unsigned int n = parallel_format_min_rows + 3;
+    std::vector<std::vector<ElementPtr<IntElement>>> rows;
+    std::string expected{"["};
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        std::vector<ElementPtr<IntElement>> row;
+        expected += "[";
+        for(unsigned int j = 0; j < n; j++)
+        {
+            /* Rows of different lengths. */
+            const int v = static_cast<int>(i * j) * (j % 2 ? -1 : 1);
+            row.push_back(ElementPtr<IntElement>{new IntElement{v}});
+            expected += std::to_string(v);
+            expected += j + 1 < n ? "," : "]";
+        }
+        rows.push_back(std::move(row));
+    }
+    expected += "]";
+
+    CHECK(format_matrix(rows) == expected);
+
+    std::stringstream ss;
+    print_matrix(ss, rows, 16);
+    CHECK(ss.str() == expected);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,105 @@
+/** \file matrixformat.hpp
+ *  \brief Formatting of matrices to string format "[[1,2][3,4]]".
+ */
+
+#ifndef MATRIXFORMAT_H
+#define MATRIXFORMAT_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "element.hpp"
+#include "elementptr.hpp"
+
+/** \brief Size of the chunks print_matrix() writes to a stream.
+ */
+const std::size_t format_chunk_size = 64 * 1024;
+
+/** \brief Matrices with at least this many rows are formatted on the
+ *         WorkerPool, each row into its own part of one buffer.
+ */
+const unsigned int parallel_format_min_rows = 256;
+
+/** \brief Longest formatted int, "-2147483648".
+ */
+const std::size_t max_int_length = 11;
+
+/** \brief Get the number of characters format_int() writes for v.
+ *  \param v Integer.
+ *  \return Character count.
+ */
+std::size_t formatted_length(int v);
+
+/** \brief Writes v in decimal, like std::to_chars. No locale, no
+ *         allocation and no terminating null.
+ *  \param out Buffer with room for max_int_length characters.
+ *  \param v Integer.
+ *  \return Pointer one past the last character written.
+ */
+char* format_int(char* out, int v);
+
+/** \name Row formatting
+ *  \brief formatted_length() gives the exact size of a row "[e,...,e]",
+ *         format_row() writes it and returns one past its end.
+ */
+//@{
+std::size_t formatted_length(const std::vector<ElementPtr<IntElement>>& row);
+std::size_t formatted_length(const std::vector<ElementPtr<Element>>& row);
+char* format_row(char* out, const std::vector<ElementPtr<IntElement>>& row);
+char* format_row(char* out, const std::vector<ElementPtr<Element>>& row);
+//@}
+
+/** \brief Formats a matrix to a string. The size is computed first, so
+ *         the string is allocated once. Rows are formatted in parallel if
+ *         there are at least parallel_format_min_rows of them.
+ *  \param rows Elements of the matrix.
+ *  \return String representation of the matrix.
+ */
+std::string format_matrix(const std::vector<std::vector<ElementPtr<IntElement>>>& rows);
+
+/** \brief See format_matrix(const std::vector<std::vector<ElementPtr<IntElement>>>&).
+ *  \param rows Elements of the matrix.
+ *  \return String representation of the matrix.
+ */
+std::string format_matrix(const std::vector<std::vector<ElementPtr<Element>>>& rows);
+
+/** \brief Writes a matrix to a stream in chunks, without building
+ *         the whole string. Matrices with at least
+ *         parallel_format_min_rows rows are formatted in parallel to one
+ *         buffer instead, and written to os with a single write.
+ *  \param os Output stream.
+ *  \param rows Elements of the matrix.
+ *  \param chunk_size Size of the chunks written to os.
+ */
+void print_matrix(std::ostream& os,
+                  const std::vector<std::vector<ElementPtr<IntElement>>>& rows,
+                  std::size_t chunk_size = format_chunk_size);
+
+/** \brief See print_matrix(std::ostream&, const std::vector<std::vector<ElementPtr<IntElement>>>&, std::size_t).
+ *  \param os Output stream.
+ *  \param rows Elements of the matrix.
+ *  \param chunk_size Size of the chunks written to os.
+ */
+void print_matrix(std::ostream& os,
+                  const std::vector<std::vector<ElementPtr<Element>>>& rows,
+                  std::size_t chunk_size = format_chunk_size);
+
+/** \brief Formats n * n integers in row-major order as a matrix.
+ *  \param n Row size.
+ *  \param values Pointer to the integers.
+ *  \return String representation of the matrix.
+ */
+std::string format_matrix(unsigned int n, const int* values);
+
+/** \brief Writes n * n integers in row-major order to a stream as a
+ *         matrix, like print_matrix() for elements.
+ *  \param os Output stream.
+ *  \param n Row size.
+ *  \param values Pointer to the integers.
+ *  \param chunk_size Size of the chunks written to os.
+ */
+void print_matrix(std::ostream& os, unsigned int n, const int* values,
+                  std::size_t chunk_size = format_chunk_size);
+
+#endif // MATRIXFORMAT_H
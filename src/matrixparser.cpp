@@ -0,0 +1,1055 @@
+/** \file matrixparser.cpp
+ *  \brief Matrix parser implementation file.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
+#include "matrixparser.hpp"
+#include "fixedsquarematrix.hpp"
+#include "workerpool.hpp"
+#ifdef SQM_TESTS
+#include <cstring>
+#include <memory>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include "catch.hpp"
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define SQM_HAVE_SSE2 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#define SQM_HAVE_FD_READ 1
+#endif
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' ||
+           c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline const char* skip_space(const char* p, const char* last)
+{
+    while(p != last && is_space(*p)) p++;
+    return p;
+}
+
+/* Reads an optionally signed decimal integer, fails on overflow. */
+static inline bool parse_int(const char*& p, const char* last, int& out)
+{
+    bool negative = false;
+    if(p != last && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if(p == last || !is_digit(*p)) return false;
+
+    const unsigned long long limit =
+        static_cast<unsigned long long>(std::numeric_limits<int>::max()) +
+        (negative ? 1 : 0);
+    unsigned long long val = 0;
+
+    while(p != last && is_digit(*p))
+    {
+        val = val * 10 + static_cast<unsigned int>(*p - '0');
+        if(val > limit) return false;
+        p++;
+    }
+
+    out = negative ? static_cast<int>(-static_cast<long long>(val))
+                   : static_cast<int>(val);
+    return true;
+}
+
+#ifdef SQM_HAVE_SSE2
+/* Bit i is set if p[i] is a decimal digit, for 16 characters. */
+static inline unsigned int digit_mask16(const char* p)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    /* Unsigned d <= 9, SSE2 has no unsigned byte compare. */
+    const __m128i le9 = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    return static_cast<unsigned int>(_mm_movemask_epi8(le9));
+}
+
+/* Bit i is set if p[i] == c, for 16 characters. */
+static inline unsigned int char_mask16(const char* p, char c)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return static_cast<unsigned int>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+}
+#endif
+
+/* parse_int() that finds the end of the digit run with one vector compare
+ * and converts it without per-character checks. Runs of ten or more
+ * digits, which may overflow, and the last 16 characters of the input
+ * go to parse_int(). */
+static inline bool parse_int_fast(const char*& p, const char* last, int& out)
+{
+#ifdef SQM_HAVE_SSE2
+    const char* q = p;
+    if(q == last) return false;
+    const bool negative = *q == '-';
+    if(*q == '-' || *q == '+') q++;
+
+    if(last - q >= 16)
+    {
+        const unsigned int len = __builtin_ctz(~digit_mask16(q));
+        if(len == 0) return false;
+
+        if(len < 10)
+        {
+            int val = 0;
+            for(unsigned int i = 0; i < len; i++)
+            {
+                val = val * 10 + (q[i] - '0');
+            }
+            out = negative ? -val : val;
+            p = q + len;
+            return true;
+        }
+    }
+#endif
+    return parse_int(p, last, out);
+}
+
+struct ConcreteElementParser
+{
+    bool operator()(const char*& p, const char* last, int& out) const
+    {
+        return parse_int_fast(p, last, out);
+    }
+};
+
+struct SymbolicElementParser
+{
+    bool operator()(const char*& p, const char* last, SymbolicToken& out) const
+    {
+        if(p != last && is_alpha(*p))
+        {
+            out.is_variable = true;
+            out.value = *p++;
+            return true;
+        }
+
+        out.is_variable = false;
+        return parse_int_fast(p, last, out.value);
+    }
+};
+
+/* Number of elements in the row starting at p, counted from the commas.
+ * Only used to size the output, so it does not validate anything. */
+static unsigned long long first_row_length(const char* p, const char* last)
+{
+    unsigned long long commas = 0;
+#ifdef SQM_HAVE_SSE2
+    for(; last - p >= 16; p += 16)
+    {
+        const unsigned int close = char_mask16(p, ']');
+        const unsigned int comma = char_mask16(p, ',');
+        if(close != 0)
+        {
+            /* Commas before the first ']' only. */
+            const unsigned int before = (1u << __builtin_ctz(close)) - 1;
+            return commas + __builtin_popcount(comma & before) + 1;
+        }
+        commas += __builtin_popcount(comma);
+    }
+#endif
+    const char* end = std::find(p, last, ']');
+    return commas + std::count(p, end, ',') + 1;
+}
+
+/* Parses rows "[e,...,e]" separated by whitespace, from p up to the first
+ * character that does not start a row. A row size of 0 in n is taken from
+ * the first row, all other rows must match it. */
+template <typename T, typename ElementParser>
+static const char* parse_rows(const char*& p, const char* last,
+                              std::vector<T>& values, unsigned int& n,
+                              unsigned int& rows, ElementParser parse_element)
+{
+    rows = 0;
+    while(p != last && *p == '[')
+    {
+        p++;
+        unsigned int cols = 0;
+
+        while(true)
+        {
+            p = skip_space(p, last);
+
+            T t;
+            if(!parse_element(p, last, t)) return "Invalid string.";
+            values.push_back(t);
+            cols++;
+
+            p = skip_space(p, last);
+            if(p == last) return "Invalid string.";
+            if(*p == ']') break;
+            if(*p != ',') return "Invalid string.";
+            p++;
+        }
+
+        if(n == 0)
+        {
+            n = cols;
+        }
+        else if(cols != n)
+        {
+            return "Invalid string (row size).";
+        }
+
+        rows++;
+        p = skip_space(p + 1, last);
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+struct RowRange
+{
+    std::vector<T> values;
+    unsigned int n;
+    unsigned int rows;
+    const char* end;
+    const char* err;
+};
+
+/* Parses the rows in [p, last) on pool, p being just after the opening
+ * bracket. The string is cut into ranges at row starts: elements never
+ * contain '[', so the next one after any position begins a row. Ranges
+ * are parsed independently and the row sizes checked when joining them.
+ * Returns false if the input is invalid or too short to be worth it. */
+template <typename T, typename ElementParser>
+static bool parse_matrix_parallel(const char* p, const char* last,
+                                  unsigned int& n, std::vector<T>& values,
+                                  ElementParser parse_element,
+                                  WorkerPool& pool, std::size_t chunk_size)
+{
+    p = skip_space(p, last);
+    const std::size_t size = last - p;
+    const unsigned int count = static_cast<unsigned int>(std::min<std::size_t>(
+        pool.getConcurrency(), size / std::max<std::size_t>(chunk_size, 1)));
+    if(count < 2) return false;
+
+    std::vector<const char*> bounds(count + 1, last);
+    bounds[0] = p;
+    for(unsigned int i = 1; i < count; i++)
+    {
+        bounds[i] = std::find(std::max(bounds[i - 1], p + size / count * i),
+                              last, '[');
+    }
+
+    std::vector<RowRange<T>> ranges(count);
+    pool.run(count, [&](unsigned int i)
+    {
+        RowRange<T>& r = ranges[i];
+        const char* q = bounds[i];
+        r.n = 0;
+        r.err = parse_rows(q, bounds[i + 1], r.values, r.n, r.rows,
+                           parse_element);
+        r.end = q;
+    });
+
+    /* Join: same row size everywhere, and n rows in total. */
+    n = 0;
+    unsigned long long rows = 0;
+    std::size_t total = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        const RowRange<T>& r = ranges[i];
+        if(r.err != nullptr) return false;
+        if(i + 1 < count && r.end != bounds[i + 1]) return false;
+        if(r.rows == 0) continue;
+        if(n == 0) n = r.n;
+        if(r.n != n) return false;
+        rows += r.rows;
+        total += r.values.size();
+    }
+
+    const char* q = ranges.back().end;
+    if(rows == 0 || rows != n) return false;
+    if(q == last || *q != ']' || skip_space(q + 1, last) != last) return false;
+
+    std::vector<std::size_t> offsets(count, 0);
+    for(unsigned int i = 1; i < count; i++)
+    {
+        offsets[i] = offsets[i - 1] + ranges[i - 1].values.size();
+    }
+
+    values.resize(total);
+    pool.run(count, [&](unsigned int i)
+    {
+        std::copy(ranges[i].values.begin(), ranges[i].values.end(),
+                  values.begin() + offsets[i]);
+    });
+
+    return true;
+}
+
+template <typename T, typename ElementParser>
+static const char* parse_matrix(const char* p, const char* last,
+                                unsigned int& n, std::vector<T>& values,
+                                ElementParser parse_element)
+{
+    n = 0;
+    values.clear();
+
+    p = skip_space(p, last);
+    if(p == last || *p != '[') return "Invalid string (first bracket).";
+    p = skip_space(p + 1, last);
+
+    /* Invalid input falls through to the serial parser,
+     * which finds the error to report. */
+    if(static_cast<std::size_t>(last - p) >= parallel_parse_min_size &&
+       parse_matrix_parallel(p, last, n, values, parse_element,
+                             WorkerPool::instance(), parallel_parse_chunk_size))
+    {
+        return nullptr;
+    }
+    n = 0;
+    values.clear();
+
+    /* Every element takes at least two characters, which caps the
+     * reservation for malformed input. */
+    const unsigned long long row = first_row_length(p, last);
+    values.reserve(std::min<unsigned long long>(
+        row * row, static_cast<unsigned long long>(last - p) / 2 + 1));
+
+    unsigned int rows = 0;
+    const char* err = parse_rows(p, last, values, n, rows, parse_element);
+    if(err != nullptr) return err;
+
+    if(p == last || *p != ']' || rows == 0) return "Invalid string.";
+    if(rows != n) return "Invalid string (elements size).";
+
+    /* Check if there is still stuff in the string. */
+    if(skip_space(p + 1, last) != last) return "Invalid string.";
+
+    return nullptr;
+}
+
+const char* parse_integer(const char* first, const char* last, int& out)
+{
+    if(first == last) return nullptr;
+    return parse_int_fast(first, last, out) ? first : nullptr;
+}
+
+const char* parse_concrete(const char* first, const char* last,
+                           unsigned int& n, std::vector<int>& values)
+{
+    return parse_matrix(first, last, n, values, ConcreteElementParser{});
+}
+
+const char* parse_symbolic(const char* first, const char* last,
+                           unsigned int& n, std::vector<SymbolicToken>& values)
+{
+    return parse_matrix(first, last, n, values, SymbolicElementParser{});
+}
+
+/* Character sources of the streaming parser. peek() returns the next
+ * character as unsigned char, or -1 at the end of input. */
+
+class StreamSource
+{
+    public:
+        explicit StreamSource(std::streambuf* new_buf) : buf(new_buf) {}
+
+        int peek()
+        {
+            const auto c = buf->sgetc();
+            return traits::eq_int_type(c, traits::eof()) ?
+                -1 : static_cast<unsigned char>(traits::to_char_type(c));
+        }
+
+        void bump() {buf->sbumpc();}
+
+    private:
+        using traits = std::char_traits<char>;
+        std::streambuf* buf;
+};
+
+#ifdef SQM_HAVE_FD_READ
+class FdSource
+{
+    public:
+        explicit FdSource(int new_fd) :
+            fd(new_fd), chunk(matrix_stream_chunk_size), pos(0), end(0),
+            failed(false) {}
+
+        int peek()
+        {
+            if(pos == end && !fill()) return -1;
+            return static_cast<unsigned char>(chunk[pos]);
+        }
+
+        void bump() {pos++;}
+
+        bool readFailed() const {return failed;}
+
+    private:
+        bool fill()
+        {
+            ssize_t r = 0;
+            do
+            {
+                r = ::read(fd, chunk.data(), chunk.size());
+            } while(r < 0 && errno == EINTR);
+
+            failed = r < 0;
+            pos = 0;
+            end = r > 0 ? static_cast<std::size_t>(r) : 0;
+            return end != 0;
+        }
+
+        int fd;
+        std::vector<char> chunk;
+        std::size_t pos;
+        std::size_t end;
+        bool failed;
+};
+#endif
+
+template <typename Source>
+static inline void skip_space(Source& src)
+{
+    int c = src.peek();
+    while(c >= 0 && is_space(static_cast<char>(c)))
+    {
+        src.bump();
+        c = src.peek();
+    }
+}
+
+/* Streaming counterpart of parse_int(). */
+template <typename Source>
+static inline bool read_int(Source& src, int& out)
+{
+    bool negative = false;
+    int c = src.peek();
+    if(c == '-' || c == '+')
+    {
+        negative = c == '-';
+        src.bump();
+        c = src.peek();
+    }
+    if(c < 0 || !is_digit(static_cast<char>(c))) return false;
+
+    const unsigned long long limit =
+        static_cast<unsigned long long>(std::numeric_limits<int>::max()) +
+        (negative ? 1 : 0);
+    unsigned long long val = 0;
+
+    while(c >= 0 && is_digit(static_cast<char>(c)))
+    {
+        val = val * 10 + static_cast<unsigned int>(c - '0');
+        if(val > limit) return false;
+        src.bump();
+        c = src.peek();
+    }
+
+    out = negative ? static_cast<int>(-static_cast<long long>(val))
+                   : static_cast<int>(val);
+    return true;
+}
+
+struct ConcreteElementReader
+{
+    template <typename Source>
+    bool operator()(Source& src, int& out) const
+    {
+        return read_int(src, out);
+    }
+};
+
+struct SymbolicElementReader
+{
+    template <typename Source>
+    bool operator()(Source& src, SymbolicToken& out) const
+    {
+        const int c = src.peek();
+        if(c >= 0 && is_alpha(static_cast<char>(c)))
+        {
+            out.is_variable = true;
+            out.value = c;
+            src.bump();
+            return true;
+        }
+
+        out.is_variable = false;
+        return read_int(src, out.value);
+    }
+};
+
+/* Same grammar and errors as parse_matrix(), but reads one character at
+ * a time and stops right after the closing bracket. Extra rows are
+ * rejected as soon as they start, so bad input cannot grow the result
+ * past n * n elements. */
+template <typename T, typename Source, typename ElementReader>
+static const char* parse_matrix_stream(Source& src, unsigned int& n,
+                                       const RowHandler<T>& on_row,
+                                       ElementReader read_element)
+{
+    n = 0;
+
+    skip_space(src);
+    if(src.peek() != '[') return "Invalid string (first bracket).";
+    src.bump();
+    skip_space(src);
+
+    std::vector<T> row;
+    unsigned int rows = 0;
+
+    while(src.peek() == '[')
+    {
+        if(rows != 0 && rows == n) return "Invalid string (elements size).";
+        src.bump();
+        row.clear();
+
+        while(true)
+        {
+            skip_space(src);
+
+            T t;
+            if(!read_element(src, t)) return "Invalid string.";
+            row.push_back(t);
+
+            skip_space(src);
+            const int c = src.peek();
+            if(c == ']') break;
+            if(c != ',') return "Invalid string.";
+            src.bump();
+
+            if(rows != 0 && row.size() == n) return "Invalid string (row size).";
+        }
+
+        if(rows == 0)
+        {
+            n = static_cast<unsigned int>(row.size());
+            row.reserve(n);
+        }
+        else if(row.size() != n)
+        {
+            return "Invalid string (row size).";
+        }
+
+        on_row(row);
+        rows++;
+        src.bump();
+        skip_space(src);
+    }
+
+    if(src.peek() != ']' || rows == 0) return "Invalid string.";
+    if(rows != n) return "Invalid string (elements size).";
+    src.bump();
+
+    return nullptr;
+}
+
+template <typename T, typename ElementReader>
+static const char* parse_istream(std::istream& is, unsigned int& n,
+                                 const RowHandler<T>& on_row,
+                                 ElementReader read_element)
+{
+    n = 0;
+    const std::istream::sentry sentry(is, true);
+    if(!sentry) return "Invalid string (first bracket).";
+
+    StreamSource src{is.rdbuf()};
+    const char* err = parse_matrix_stream(src, n, on_row, read_element);
+
+    if(src.peek() < 0) is.setstate(std::ios_base::eofbit);
+    if(err != nullptr) is.setstate(std::ios_base::failbit);
+    return err;
+}
+
+const char* parse_concrete_stream(std::istream& is, unsigned int& n,
+                                  const RowHandler<int>& on_row)
+{
+    return parse_istream(is, n, on_row, ConcreteElementReader{});
+}
+
+const char* parse_symbolic_stream(std::istream& is, unsigned int& n,
+                                  const RowHandler<SymbolicToken>& on_row)
+{
+    return parse_istream(is, n, on_row, SymbolicElementReader{});
+}
+
+const char* parse_concrete_fd(int fd, unsigned int& n,
+                              const RowHandler<int>& on_row)
+{
+#ifdef SQM_HAVE_FD_READ
+    FdSource src{fd};
+    const char* err = parse_matrix_stream(src, n, on_row, ConcreteElementReader{});
+    if(src.readFailed()) return "Read error.";
+    return err;
+#else
+    (void)fd;
+    (void)on_row;
+    n = 0;
+    return "Reading file descriptors is not supported.";
+#endif
+}
+
+ConcreteSquareMatrix readConcreteSquareMatrix(std::istream& is)
+{
+    unsigned int n = 0;
+    std::vector<std::vector<ElementPtr<IntElement>>> elements;
+
+    const char* err = parse_concrete_stream(is, n,
+        [&elements](const std::vector<int>& values)
+        {
+            std::vector<ElementPtr<IntElement>> row;
+            row.reserve(values.size());
+            for(int v : values) row.push_back(make_element<IntElement>(v));
+            elements.push_back(std::move(row));
+        });
+
+    if(err != nullptr)
+    {
+        throw std::invalid_argument(err);
+    }
+
+    return ConcreteSquareMatrix{n, std::move(elements)};
+}
+
+std::unique_ptr<SquareMatrix> readSquareMatrix(std::istream& is)
+{
+    unsigned int n = 0;
+
+    /* Rows stay IntElements until the first variable shows up. */
+    std::vector<std::vector<ElementPtr<IntElement>>> int_rows;
+    std::vector<std::vector<ElementPtr<Element>>> rows;
+    bool symbolic = false;
+
+    const char* err = parse_symbolic_stream(is, n,
+        [&](const std::vector<SymbolicToken>& tokens)
+        {
+            if(!symbolic)
+            {
+                symbolic = std::any_of(tokens.begin(), tokens.end(),
+                    [](const SymbolicToken& t) {return t.is_variable;});
+
+                if(symbolic)
+                {
+                    for(auto& r : int_rows)
+                    {
+                        rows.emplace_back(r.begin(), r.end());
+                    }
+                    int_rows.clear();
+                }
+                else
+                {
+                    std::vector<ElementPtr<IntElement>> row;
+                    row.reserve(tokens.size());
+                    for(const auto& t : tokens)
+                    {
+                        row.push_back(make_element<IntElement>(t.value));
+                    }
+                    int_rows.push_back(std::move(row));
+                    return;
+                }
+            }
+
+            std::vector<ElementPtr<Element>> row;
+            row.reserve(tokens.size());
+            for(const auto& t : tokens)
+            {
+                if(t.is_variable)
+                {
+                    row.push_back(make_element<VariableElement>(
+                        static_cast<char>(t.value)));
+                }
+                else
+                {
+                    row.push_back(make_element<IntElement>(t.value));
+                }
+            }
+            rows.push_back(std::move(row));
+        });
+
+    if(err != nullptr)
+    {
+        throw std::invalid_argument(err);
+    }
+
+    if(symbolic)
+    {
+        return std::unique_ptr<SquareMatrix>{
+            new SymbolicSquareMatrix{n, std::move(rows)}};
+    }
+
+    if(n <= max_fixed_n)
+    {
+        std::vector<int> values;
+        values.reserve(n * n);
+        for(const auto& r : int_rows)
+        {
+            for(const auto& e : r) values.push_back(e->getVal());
+        }
+        return makeConcreteSquareMatrix(n, values);
+    }
+
+    return std::unique_ptr<SquareMatrix>{
+        new ConcreteSquareMatrix{n, std::move(int_rows)}};
+}
+
+#ifdef SQM_TESTS
+
+static const char* parse_concrete(const std::string& str,
+                                  unsigned int& n, std::vector<int>& values)
+{
+    return parse_concrete(str.data(), str.data() + str.size(), n, values);
+}
+
+TEST_CASE("Concrete matrix parser.", "[parser][ConcreteSquareMatrix]")
+{
+    unsigned int n = 0;
+    std::vector<int> v;
+
+    CHECK(parse_concrete("[[1,2][3,4]]", n, v) == nullptr);
+    CHECK(n == 2);
+    CHECK(v == (std::vector<int>{1, 2, 3, 4}));
+
+    CHECK(parse_concrete(" [ [ -1 , +2 ]\n[2147483647,-2147483648] ] ", n, v) == nullptr);
+    CHECK(v == (std::vector<int>{-1, 2, 2147483647, -2147483647 - 1}));
+
+    CHECK(parse_concrete("[[7]]", n, v) == nullptr);
+    CHECK(n == 1);
+    CHECK(v.size() == 1);
+
+    CHECK(parse_concrete("", n, v) != nullptr);
+    CHECK(parse_concrete("[]", n, v) != nullptr);
+    CHECK(parse_concrete("[[]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1 2]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[- 1]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[a]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[2147483648]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[-2147483649]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,2][3]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,2][3,4]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,2][3,4]]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,2,3][4,5,6]]", n, v) != nullptr);
+    CHECK(parse_concrete("[[1,1,1,1,1,1,1,1,1,1,1,1,1]]", n, v) != nullptr);
+}
+
+TEST_CASE("Parallel matrix parser.", "[parser][WorkerPool][thread]")
+{
+    WorkerPool pool{3};
+    const unsigned int size = 150;
+
+    std::string str{"[ "};
+    for(unsigned int i = 0; i < size; i++)
+    {
+        str += "[";
+        for(unsigned int j = 0; j < size; j++)
+        {
+            str += std::to_string(static_cast<int>(i * size + j) - 1000);
+            str += j + 1 < size ? ", " : "]\n";
+        }
+    }
+    str += "] ";
+
+    auto parallel = [&pool](const std::string& s, unsigned int& n,
+                            std::vector<int>& v)
+    {
+        return parse_matrix_parallel(s.data() + 1, s.data() + s.size(), n, v,
+                                     ConcreteElementParser{}, pool, 1000);
+    };
+
+    unsigned int n = 0;
+    unsigned int serial_n = 0;
+    std::vector<int> v;
+    std::vector<int> serial_v;
+
+    REQUIRE(parse_concrete(str, serial_n, serial_v) == nullptr);
+    CHECK(parallel(str, n, v));
+    CHECK(n == size);
+    CHECK(v == serial_v);
+
+    /* Too short to split. */
+    CHECK(!parallel("[[1,2][3,4]]", n, v));
+
+    std::string bad_row{str};
+    bad_row.replace(bad_row.find("]\n[", bad_row.size() / 2), 3, ",1]\n[");
+    CHECK(!parallel(bad_row, n, v));
+    CHECK(parse_concrete(bad_row, n, v) != nullptr);
+
+    std::string extra_row{str};
+    extra_row.insert(extra_row.size() - 2, "[1]");
+    CHECK(!parallel(extra_row, n, v));
+
+    std::string nested{str};
+    nested[nested.find(", ", nested.size() / 3)] = '[';
+    CHECK(!parallel(nested, n, v));
+
+    std::string tail{str};
+    tail += "x";
+    CHECK(!parallel(tail, n, v));
+}
+
+/* Copy of str that ends right before an unreadable page, so reading
+ * past its end crashes the test. Without mmap() it is only unterminated. */
+class GuardedBuffer
+{
+    public:
+        explicit GuardedBuffer(const std::string& str) : size(str.size())
+        {
+#ifdef __linux__
+            page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            void* m = mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            REQUIRE(m != MAP_FAILED);
+            map = static_cast<char*>(m);
+            REQUIRE(mprotect(map + page, page, PROT_NONE) == 0);
+            data = map + page - size;
+#else
+            copy.reset(new char[size == 0 ? 1 : size]);
+            data = copy.get();
+#endif
+            std::memcpy(data, str.data(), size);
+        }
+
+        ~GuardedBuffer()
+        {
+#ifdef __linux__
+            munmap(map, 2 * page);
+#endif
+        }
+
+        const char* begin() const {return data;}
+        const char* end() const {return data + size;}
+
+    private:
+        std::size_t size;
+        char* data;
+#ifdef __linux__
+        std::size_t page;
+        char* map;
+#else
+        std::unique_ptr<char[]> copy;
+#endif
+};
+
+TEST_CASE("Truncated ranges are not read past their end.", "[parser]")
+{
+    const std::vector<std::string> inputs{
+        "[", "[[", "[[1,", "[[-", "[[+", "[[1,2][", "[[1,2][3,", "[[1,2][3,4",
+        "[[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,", "[[a,"};
+
+    for(const auto& in : inputs)
+    {
+        INFO(in);
+        const GuardedBuffer buf{in};
+        unsigned int n = 0;
+        std::vector<int> v;
+        std::vector<SymbolicToken> sv;
+        int out = 0;
+        CHECK(parse_concrete(buf.begin(), buf.end(), n, v) != nullptr);
+        CHECK(parse_symbolic(buf.begin(), buf.end(), n, sv) != nullptr);
+
+        const char* p = buf.end();
+        CHECK(!parse_int_fast(p, buf.end(), out));
+    }
+}
+
+TEST_CASE("Vectorized integer parsing matches the scalar one.", "[parser][simd]")
+{
+    const std::string pad(20, ']');
+    const std::vector<std::string> inputs{
+        "0", "7", "-7", "+7", "123456789", "-123456789", "1234567890",
+        "2147483647", "-2147483648", "2147483648", "-2147483649",
+        "000000000000000000042", "99999999999999999999", "-", "+", "a",
+        "--1", "12a", "1 2", "-0"};
+
+    for(const auto& in : inputs)
+    {
+        const std::string str = in + pad;
+        const char* last = str.data() + str.size();
+
+        const char* p1 = str.data();
+        const char* p2 = str.data();
+        int v1 = 0;
+        int v2 = 0;
+        const bool ok1 = parse_int(p1, last, v1);
+        const bool ok2 = parse_int_fast(p2, last, v2);
+
+        INFO(in);
+        CHECK(ok1 == ok2);
+        if(ok1)
+        {
+            CHECK(v1 == v2);
+            CHECK(p1 == p2);
+        }
+    }
+
+    const std::string row{"[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17][1]"};
+    CHECK(first_row_length(row.data() + 1, row.data() + row.size()) == 17);
+    CHECK(first_row_length(row.data(), row.data() + 5) == 3);
+}
+
+TEST_CASE("Symbolic matrix parser.", "[parser][SymbolicSquareMatrix]")
+{
+    unsigned int n = 0;
+    std::vector<SymbolicToken> v;
+    const std::string str{"[[a,-2][3,Z]]"};
+
+    CHECK(parse_symbolic(str.data(), str.data() + str.size(), n, v) == nullptr);
+    CHECK(n == 2);
+    REQUIRE(v.size() == 4);
+    CHECK(v[0].is_variable);
+    CHECK(v[0].value == 'a');
+    CHECK(!v[1].is_variable);
+    CHECK(v[1].value == -2);
+    CHECK(v[3].value == 'Z');
+
+    const std::string bad{"[[ab,1][2,3]]"};
+    CHECK(parse_symbolic(bad.data(), bad.data() + bad.size(), n, v) != nullptr);
+}
+
+TEST_CASE("Streaming matrix parser.", "[parser][stream]")
+{
+    unsigned int n = 0;
+    std::vector<int> v;
+    auto collect = [&v](const std::vector<int>& row)
+    {
+        v.insert(v.end(), row.begin(), row.end());
+    };
+
+    std::istringstream ss{" [ [1, -2]\n[3,4] ]rest"};
+    CHECK(parse_concrete_stream(ss, n, collect) == nullptr);
+    CHECK(n == 2);
+    CHECK(v == (std::vector<int>{1, -2, 3, 4}));
+
+    /* The stream is left right after the matrix. */
+    std::string rest;
+    ss >> rest;
+    CHECK(rest == "rest");
+
+    std::istringstream bad_row{"[[1,2][3,4,5]]"};
+    CHECK(parse_concrete_stream(bad_row, n, collect) != nullptr);
+    CHECK(bad_row.fail());
+
+    std::istringstream extra_row{"[[1][2]]"};
+    CHECK(parse_concrete_stream(extra_row, n, collect) != nullptr);
+
+    std::istringstream cut{"[[1,2][3,4]"};
+    CHECK(parse_concrete_stream(cut, n, collect) != nullptr);
+    CHECK(cut.eof());
+
+    std::istringstream sym{"[[x,1][2,y]]"};
+    std::vector<SymbolicToken> tokens;
+    const char* err = parse_symbolic_stream(sym, n,
+        [&tokens](const std::vector<SymbolicToken>& row)
+        {
+            tokens.insert(tokens.end(), row.begin(), row.end());
+        });
+    CHECK(err == nullptr);
+    REQUIRE(tokens.size() == 4);
+    CHECK(tokens[0].is_variable);
+    CHECK(tokens[3].value == 'y');
+}
+
+TEST_CASE("Reading matrices from streams.", "[parser][stream][SquareMatrix]")
+{
+    std::istringstream ss{"[[1,2,3,4,5][6,7,8,9,10][1,1,1,1,1][2,2,2,2,2][3,3,3,3,3]]"
+                          "[[a,1][2,3]] [[1,2][3,4]] [[1,2]"};
+
+    ConcreteSquareMatrix conc = readConcreteSquareMatrix(ss);
+    CHECK(conc.getRowSize() == 5);
+    CHECK(conc.toString() ==
+          "[[1,2,3,4,5][6,7,8,9,10][1,1,1,1,1][2,2,2,2,2][3,3,3,3,3]]");
+
+    auto sym = readSquareMatrix(ss);
+    CHECK(sym->toString() == "[[a,1][2,3]]");
+    CHECK(dynamic_cast<SymbolicSquareMatrix*>(sym.get()) != nullptr);
+
+    auto small = readSquareMatrix(ss);
+    CHECK(small->toString() == "[[1,2][3,4]]");
+    CHECK(dynamic_cast<FixedConcreteSquareMatrix<2>*>(small.get()) != nullptr);
+
+    CHECK_THROWS_AS(readSquareMatrix(ss), std::invalid_argument&);
+}
+
+#ifdef SQM_HAVE_FD_READ
+TEST_CASE("Reading matrices from file descriptors.", "[parser][stream][fd]")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    /* Write a matrix bigger than one chunk, so tokens
+     * cross chunk boundaries. */
+    const unsigned int size = 400;
+    std::string str{"["};
+    for(unsigned int i = 0; i < size; i++)
+    {
+        str += "[";
+        for(unsigned int j = 0; j < size; j++)
+        {
+            str += std::to_string(i * size + j);
+            str += j + 1 < size ? "," : "]";
+        }
+    }
+    str += "]";
+    REQUIRE(str.size() > matrix_stream_chunk_size);
+
+    std::thread writer{[&str, &fds]()
+    {
+        const char* p = str.data();
+        std::size_t left = str.size();
+        while(left > 0)
+        {
+            const ssize_t w = ::write(fds[1], p, left);
+            if(w <= 0) break;
+            p += w;
+            left -= static_cast<std::size_t>(w);
+        }
+        ::close(fds[1]);
+    }};
+
+    unsigned int n = 0;
+    unsigned int rows = 0;
+    bool in_order = true;
+    const char* err = parse_concrete_fd(fds[0], n,
+        [&](const std::vector<int>& row)
+        {
+            for(unsigned int j = 0; j < row.size(); j++)
+            {
+                in_order = in_order &&
+                    row[j] == static_cast<int>(rows * size + j);
+            }
+            rows++;
+        });
+
+    writer.join();
+    ::close(fds[0]);
+
+    CHECK(err == nullptr);
+    CHECK(n == size);
+    CHECK(rows == size);
+    CHECK(in_order);
+}
+#endif
+
+#endif // SQM_TESTS
@@ -0,0 +1,140 @@
+/** \file matrixparser.hpp
+ *  \brief Parsers for matrices in string format "[[1,2][3,4]]".
+ */
+
+#ifndef MATRIXPARSER_H
+#define MATRIXPARSER_H
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <vector>
+#include "squarematrix.hpp"
+
+/** \brief Matrix strings at least this long are parsed on the WorkerPool.
+ */
+const std::size_t parallel_parse_min_size = 1024 * 1024;
+
+/** \brief Smallest part of a matrix string given to one thread.
+ */
+const std::size_t parallel_parse_chunk_size = 256 * 1024;
+
+/** \brief Size of the chunks parse_concrete_fd() reads at a time.
+ */
+const unsigned int matrix_stream_chunk_size = 64 * 1024;
+
+/** \struct SymbolicToken
+ *  \brief Element of a parsed symbolic matrix.
+ */
+struct SymbolicToken
+{
+    /** \brief true if the element is a variable, else an integer.
+     */
+    bool is_variable;
+
+    /** \brief Integer value, or the variable character.
+     */
+    int value;
+};
+
+/** \brief Parses an optionally signed decimal integer at the start of
+ *         the characters [first, last), with the same fast path as
+ *         the matrix parsers.
+ *  \param first Pointer to the first character.
+ *  \param last Pointer one past the last character.
+ *  \param out Set to the value.
+ *  \return Pointer past the integer, or nullptr if there is no integer
+ *          or it does not fit in an int.
+ */
+const char* parse_integer(const char* first, const char* last, int& out);
+
+/** \brief Parses an integer matrix from the characters [first, last).
+ *
+ *  Single pass, no locale lookups and no exceptions. The row length is
+ *  counted from the first row before parsing, so values is allocated once.
+ *  Whitespace is allowed between tokens. Strings of at least
+ *  parallel_parse_min_size characters are split into row ranges that are
+ *  parsed on the WorkerPool.
+ *
+ *  \param first Pointer to the first character.
+ *  \param last Pointer one past the last character.
+ *  \param n Set to the row size of the matrix.
+ *  \param values Set to the elements in row-major order.
+ *  \return nullptr on success, else a description of the error.
+ */
+const char* parse_concrete(const char* first, const char* last,
+                           unsigned int& n, std::vector<int>& values);
+
+/** \brief Parses a matrix of integers and single-letter variables
+ *         from the characters [first, last). See parse_concrete().
+ *
+ *  \param first Pointer to the first character.
+ *  \param last Pointer one past the last character.
+ *  \param n Set to the row size of the matrix.
+ *  \param values Set to the elements in row-major order.
+ *  \return nullptr on success, else a description of the error.
+ */
+const char* parse_symbolic(const char* first, const char* last,
+                           unsigned int& n, std::vector<SymbolicToken>& values);
+
+/** \brief Called with each row of a matrix as soon as it is complete.
+ */
+template <typename T>
+using RowHandler = std::function<void(const std::vector<T>& row)>;
+
+/** \brief Parses an integer matrix from a stream without buffering it.
+ *
+ *  Characters are taken from the stream buffer of is one at a time, so
+ *  only one row is held in memory besides what on_row keeps. Nothing after
+ *  the closing bracket is consumed.
+ *
+ *  \param is Stream to read from.
+ *  \param n Set to the row size of the matrix.
+ *  \param on_row Called for every row.
+ *  \return nullptr on success, else a description of the error.
+ */
+const char* parse_concrete_stream(std::istream& is, unsigned int& n,
+                                  const RowHandler<int>& on_row);
+
+/** \brief Parses a symbolic matrix from a stream without buffering it.
+ *         See parse_concrete_stream().
+ *
+ *  \param is Stream to read from.
+ *  \param n Set to the row size of the matrix.
+ *  \param on_row Called for every row.
+ *  \return nullptr on success, else a description of the error.
+ */
+const char* parse_symbolic_stream(std::istream& is, unsigned int& n,
+                                  const RowHandler<SymbolicToken>& on_row);
+
+/** \brief Parses an integer matrix from a file descriptor, reading it in
+ *         chunks of matrix_stream_chunk_size bytes. Data after the
+ *         closing bracket in the last chunk is discarded.
+ *
+ *  \param fd File descriptor to read from.
+ *  \param n Set to the row size of the matrix.
+ *  \param on_row Called for every row.
+ *  \return nullptr on success, else a description of the error.
+ */
+const char* parse_concrete_fd(int fd, unsigned int& n,
+                              const RowHandler<int>& on_row);
+
+/** \brief Reads a ConcreteSquareMatrix from a stream. Peak memory is the
+ *         matrix and one row.
+ *  \param is Stream to read from.
+ *  \return New instance of ConcreteSquareMatrix.
+ *  \throw std::invalid_argument if the input is invalid.
+ */
+ConcreteSquareMatrix readConcreteSquareMatrix(std::istream& is);
+
+/** \brief Reads a matrix from a stream. Matrices with variables become
+ *         SymbolicSquareMatrix, others ConcreteSquareMatrix, or
+ *         FixedConcreteSquareMatrix up to max_fixed_n rows.
+ *  \param is Stream to read from.
+ *  \return Pointer to the new SquareMatrix.
+ *  \throw std::invalid_argument if the input is invalid.
+ */
+std::unique_ptr<SquareMatrix> readSquareMatrix(std::istream& is);
+
+#endif // MATRIXPARSER_H
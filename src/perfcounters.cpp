@@ -0,0 +1,329 @@
+/** \file perfcounters.cpp
+ *  \brief Hardware performance counter implementation file.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "perfcounters.hpp"
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef SQM_TESTS
+#include <atomic>
+#include <thread>
+#include "squarematrix.hpp"
+#include "catch.hpp"
+#endif
+
+static const char* const perf_event_names[perf_event_count] =
+    {"cycles", "instructions", "cache-misses", "branch-misses", "tlb-misses"};
+
+const char* perf_event_name(PerfEvent event)
+{
+    return perf_event_names[static_cast<std::size_t>(event)];
+}
+
+bool PerfCounts::has(PerfEvent event) const
+{
+    return valid[static_cast<std::size_t>(event)];
+}
+
+double PerfCounts::get(PerfEvent event) const
+{
+    return has(event) ? values[static_cast<std::size_t>(event)] : 0.0;
+}
+
+double PerfCounts::ipc() const
+{
+    if(!has(PerfEvent::cycles) || !has(PerfEvent::instructions) ||
+       get(PerfEvent::cycles) == 0.0)
+    {
+        return 0.0;
+    }
+    return get(PerfEvent::instructions) / get(PerfEvent::cycles);
+}
+
+PerfCounts& PerfCounts::operator/=(double divisor)
+{
+    for(auto& v : values) v /= divisor;
+    return *this;
+}
+
+#ifdef __linux__
+
+/* Counter of one thread and the threads it starts. */
+static int open_counter(std::uint32_t type, std::uint64_t config, pid_t tid)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+                                    PERF_FLAG_FD_CLOEXEC));
+}
+
+/* Thread ids of the process, only the calling thread if they cannot be
+ * listed. */
+static std::vector<pid_t> process_threads()
+{
+    std::vector<pid_t> ret;
+    if(DIR* dir = opendir("/proc/self/task"))
+    {
+        while(const dirent* entry = readdir(dir))
+        {
+            const long tid = std::strtol(entry->d_name, nullptr, 10);
+            if(tid > 0) ret.push_back(static_cast<pid_t>(tid));
+        }
+        closedir(dir);
+    }
+
+    if(ret.empty()) ret.push_back(static_cast<pid_t>(syscall(SYS_gettid)));
+    return ret;
+}
+
+PerfCounters::PerfCounters()
+{
+    const std::uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const std::uint32_t types[perf_event_count] = {PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+    const std::uint64_t configs[perf_event_count] = {PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES, dtlb_read_miss};
+
+    /* An event missing from some thread would be undercounted, so it is
+     * dropped. A thread that exited after it was listed is not missed. */
+    int open_errno = 0;
+    std::array<bool, perf_event_count> missing{};
+    for(pid_t tid : process_threads())
+    {
+        for(std::size_t i = 0; i < perf_event_count; i++)
+        {
+            const int fd = open_counter(types[i], configs[i], tid);
+            if(fd >= 0)
+            {
+                fds[i].push_back(fd);
+            }
+            else if(errno != ESRCH)
+            {
+                missing[i] = true;
+                if(open_errno == 0) open_errno = errno;
+            }
+        }
+    }
+
+    for(std::size_t i = 0; i < perf_event_count; i++)
+    {
+        if(!missing[i]) continue;
+        for(int fd : fds[i]) close(fd);
+        fds[i].clear();
+    }
+
+    if(!isAvailable())
+    {
+        error = std::string{"perf_event_open failed: "} + std::strerror(open_errno);
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for(const auto& event : fds)
+    {
+        for(int fd : event) close(fd);
+    }
+}
+
+void PerfCounters::start()
+{
+    for(const auto& event : fds)
+    {
+        for(int fd : event)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfCounts PerfCounters::stop()
+{
+    for(const auto& event : fds)
+    {
+        for(int fd : event) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    /* An event is valid only if the counters of all threads were read. A
+     * thread that did not run leaves its counter enabled for no time. */
+    PerfCounts ret;
+    for(std::size_t i = 0; i < perf_event_count; i++)
+    {
+        double sum = 0.0;
+        bool complete = !fds[i].empty();
+        for(int fd : fds[i])
+        {
+            /* Value, time enabled and time running. */
+            std::uint64_t data[3];
+            if(read(fd, data, sizeof(data)) != sizeof(data) ||
+               (data[2] == 0 && data[1] != 0))
+            {
+                complete = false;
+                break;
+            }
+
+            if(data[2] != 0)
+            {
+                sum += static_cast<double>(data[0]) *
+                       static_cast<double>(data[1]) / static_cast<double>(data[2]);
+            }
+        }
+
+        if(complete)
+        {
+            ret.values[i] = sum;
+            ret.valid[i] = true;
+        }
+    }
+    return ret;
+}
+
+#else
+
+PerfCounters::PerfCounters() : error("Hardware counters need Linux perf_event_open.") {}
+
+PerfCounters::~PerfCounters() {}
+
+void PerfCounters::start() {}
+
+PerfCounts PerfCounters::stop()
+{
+    return PerfCounts{};
+}
+
+#endif // __linux__
+
+bool PerfCounters::isAvailable() const
+{
+    for(const auto& event : fds)
+    {
+        if(!event.empty()) return true;
+    }
+    return false;
+}
+
+const std::string& PerfCounters::getError() const
+{
+    return error;
+}
+
+PerfCounts count_perf_events(const std::function<void()>& func)
+{
+    PerfCounters counters;
+    counters.start();
+    func();
+    return counters.stop();
+}
+
+std::string format_perf_counts(const PerfCounts& counts)
+{
+    std::string ret;
+    char buf[64];
+    for(std::size_t i = 0; i < perf_event_count; i++)
+    {
+        if(!counts.valid[i]) continue;
+        std::snprintf(buf, sizeof(buf), "%s%s %.4g", ret.empty() ? "" : ", ",
+                      perf_event_names[i], counts.values[i]);
+        ret += buf;
+    }
+
+    if(ret.empty()) return "no counters";
+
+    if(counts.has(PerfEvent::cycles) && counts.has(PerfEvent::instructions))
+    {
+        std::snprintf(buf, sizeof(buf), ", IPC %.2f", counts.ipc());
+        ret += buf;
+    }
+    return ret;
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("PerfCounts formatting.", "[perf]")
+{
+    PerfCounts counts;
+    CHECK(format_perf_counts(counts) == "no counters");
+    CHECK(counts.ipc() == 0.0);
+
+    counts.values = {{2000.0, 3000.0, 10.0, 0.0, 4.0}};
+    counts.valid = {{true, true, true, false, true}};
+    CHECK(counts.ipc() == 1.5);
+    CHECK(counts.get(PerfEvent::branch_misses) == 0.0);
+    CHECK(format_perf_counts(counts) ==
+          "cycles 2000, instructions 3000, cache-misses 10, tlb-misses 4, IPC 1.50");
+
+    counts /= 10.0;
+    CHECK(counts.get(PerfEvent::cycles) == 200.0);
+    CHECK(std::string{perf_event_name(PerfEvent::tlb_misses)} == "tlb-misses");
+}
+
+TEST_CASE("PerfCounters count matrix operations.", "[perf]")
+{
+    ConcreteSquareMatrix a{32};
+    ConcreteSquareMatrix b{32};
+
+    PerfCounters counters;
+    CHECK(counters.isAvailable() == counters.getError().empty());
+
+    const PerfCounts counts = count_perf_events([&a, &b]{ a *= b; });
+    if(counters.isAvailable() && counts.has(PerfEvent::instructions))
+    {
+        CHECK(counts.get(PerfEvent::instructions) > 32.0 * 32 * 32);
+    }
+    else
+    {
+        WARN("Hardware counters are not available: " << counters.getError());
+    }
+}
+
+TEST_CASE("PerfCounters count threads that already run.", "[perf][thread]")
+{
+    std::atomic<int> stage{0};
+    volatile unsigned long sink = 0;
+    std::thread worker{[&stage, &sink]
+        {
+            while(stage.load() == 0) std::this_thread::yield();
+            for(unsigned long i = 0; i < 10000000; i++) sink = sink + i;
+            stage.store(2);
+        }};
+
+    PerfCounters counters;
+    counters.start();
+    stage.store(1);
+    while(stage.load() != 2) std::this_thread::yield();
+    const PerfCounts counts = counters.stop();
+    worker.join();
+
+    if(counts.has(PerfEvent::instructions))
+    {
+        CHECK(counts.get(PerfEvent::instructions) > 10000000.0);
+    }
+    else
+    {
+        WARN("Hardware counters are not available: " << counters.getError());
+    }
+}
+
+#endif // SQM_TESTS
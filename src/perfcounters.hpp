@@ -0,0 +1,137 @@
+/** \file perfcounters.hpp
+ *  \brief Hardware performance counters through Linux perf_event_open.
+ *         On other systems, or where the kernel refuses them, the
+ *         counters are reported unavailable.
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/** \brief Hardware events counted by PerfCounters.
+ */
+enum class PerfEvent : unsigned int
+{
+    /** \brief CPU cycles. */
+    cycles,
+    /** \brief Retired instructions. */
+    instructions,
+    /** \brief Last level cache misses. */
+    cache_misses,
+    /** \brief Mispredicted branches. */
+    branch_misses,
+    /** \brief Data TLB read misses. */
+    tlb_misses
+};
+
+/** \brief Number of values in PerfEvent.
+ */
+const std::size_t perf_event_count = 5;
+
+/** \brief Name of an event, such as "cache-misses".
+ *  \param event Event.
+ *  \return Name of the event.
+ */
+const char* perf_event_name(PerfEvent event);
+
+/** \struct PerfCounts
+ *  \brief Counted events. An event the hardware or kernel does not
+ *         provide, or that could not be counted on every thread, is
+ *         marked invalid.
+ */
+struct PerfCounts
+{
+    /** \brief Count of each event. */
+    std::array<double, perf_event_count> values{};
+    /** \brief true for the events that were counted. */
+    std::array<bool, perf_event_count> valid{};
+
+    /** \brief Tells if an event was counted.
+     *  \param event Event.
+     *  \return true if counted.
+     */
+    bool has(PerfEvent event) const;
+
+    /** \brief Get the count of an event.
+     *  \param event Event.
+     *  \return Count, 0 if not counted.
+     */
+    double get(PerfEvent event) const;
+
+    /** \brief Instructions per cycle.
+     *  \return IPC, 0 if either event was not counted.
+     */
+    double ipc() const;
+
+    /** \brief Divides every count, to get counts per run.
+     *  \param divisor Number of runs, above 0.
+     *  \return Reference to this.
+     */
+    PerfCounts& operator/=(double divisor);
+};
+
+/** \class PerfCounters
+ *  \brief Set of counters for the whole process. Each event is counted on
+ *         every thread that runs when the counters are opened, such as the
+ *         WorkerPool workers, and on the threads they start later, and the
+ *         counts are summed. Only user space is counted.
+ */
+class PerfCounters
+{
+    public:
+        /** \brief Opens the counters, disabled.
+         */
+        PerfCounters();
+
+        /** \brief Closes the counters.
+         */
+        ~PerfCounters();
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        /** \brief Tells if any counter could be opened.
+         *  \return true if counting works.
+         */
+        bool isAvailable() const;
+
+        /** \brief Get the reason the counters are not available.
+         *  \return Error message, empty if isAvailable().
+         */
+        const std::string& getError() const;
+
+        /** \brief Resets and starts the counters.
+         */
+        void start();
+
+        /** \brief Stops the counters.
+         *  \return Counts since start(), scaled up when the kernel
+         *          multiplexed the counters.
+         */
+        PerfCounts stop();
+
+    private:
+        /* Counters of each event, one per thread. */
+        std::array<std::vector<int>, perf_event_count> fds;
+        std::string error;
+};
+
+/** \brief Counts the events of one call of func.
+ *  \param func Operation to count.
+ *  \return Counts, all invalid if counting is not available.
+ */
+PerfCounts count_perf_events(const std::function<void()>& func);
+
+/** \brief Formats the counted events and IPC on one line, such as
+ *         "cycles 1.2e+06, instructions 2.4e+06, ..., IPC 2.00".
+ *  \param counts Counts to format.
+ *  \return Formatted counts, "no counters" if none is valid.
+ */
+std::string format_perf_counts(const PerfCounts& counts);
+
+#endif // PERFCOUNTERS_H
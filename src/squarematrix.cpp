@@ -2,93 +2,228 @@
  *  \brief SquareMatrix implementation file.
  */
 
-#include <future>
 #include <functional>
-#include <cmath>
 #include "squarematrix.hpp"
+#include "fixedsquarematrix.hpp"
+#include "matrixparser.hpp"
+#include "evaluationstats.hpp"
+#include "executiontrace.hpp"
+#include "threadconfig.hpp"
+#include "kernelconfig.hpp"
+#include "workerpool.hpp"
+#ifdef SQM_TESTS
 #include "catch.hpp"
+#endif
 
-template<>
-void ElementarySquareMatrix<IntElement>::t_oper(const ConcreteSquareMatrix& rhs,
-    std::function<IntElement(IntElement&, IntElement&)> func)
-{
-    std::vector<std::thread> v_threads;
-    const unsigned int m_size = pow(this->getRowSize(), 2.0);
-    unsigned int blocksz =
-        static_cast<unsigned int>(
-            ceil(static_cast<double>(m_size) /
-                 static_cast<double>(n_threads)));
-    unsigned int blockct = 0;
-    if(blocksz == 0)
+/* Function objects for fixed_oper(), C++11 has no generic lambdas. */
+struct FixedAdd
+{
+    template <typename M>
+    M operator()(const M& m1, const M& m2) const {return m1 + m2;}
+};
+
+struct FixedSubtract
+{
+    template <typename M>
+    M operator()(const M& m1, const M& m2) const {return m1 - m2;}
+};
+
+struct FixedMultiply
+{
+    template <typename M>
+    M operator()(const M& m1, const M& m2) const {return m1 * m2;}
+};
+
+template <unsigned int N, typename Op>
+static void fixed_oper(ConcreteSquareMatrix& lhs,
+                       const ConcreteSquareMatrix& rhs, Op op)
+{
+    using Fixed = FixedSquareMatrix<int, N>;
+    op(Fixed::fromConcrete(lhs), Fixed::fromConcrete(rhs)).assignTo(lhs);
+}
+
+template <typename Op>
+struct FixedOper
+{
+    ConcreteSquareMatrix& lhs;
+    const ConcreteSquareMatrix& rhs;
+    Op op;
+
+    template <unsigned int N>
+    void apply() {fixed_oper<N>(lhs, rhs, op);}
+};
+
+/** \brief Computes lhs = op(lhs, rhs) with unrolled FixedSquareMatrix
+ *         kernels if the matrices are small enough.
+ *  \return true if the operation was done, else false.
+ */
+template <typename Op>
+static bool small_oper(ConcreteSquareMatrix& lhs,
+                       const ConcreteSquareMatrix& rhs, Op op)
+{
+    FixedOper<Op> oper{lhs, rhs, op};
+    return fixed_dispatch(lhs.getRowSize(), oper);
+}
+
+using IntElementRows = std::vector<std::vector<ElementPtr<IntElement>>>;
+
+template <typename Op>
+static void elementwise_serial(IntElementRows& lhs, const IntElementRows& rhs, Op op)
+{
+    for(std::size_t i = 0; i < lhs.size(); i++)
     {
-        blockct = 0;
+        auto& lrow = lhs[i];
+        const auto& rrow = rhs[i];
+        for(std::size_t j = 0; j < lrow.size(); j++)
+        {
+            lrow[j]->setVal(op(lrow[j]->getVal(), rrow[j]->getVal()));
+        }
     }
-    else
+}
+
+/** \brief Elements are separate objects, so each of rows [first, last) is
+ *         gathered to contiguous buffers for a loop the compiler
+ *         vectorizes, then scattered back.
+ */
+template <typename Op>
+static void elementwise_vectorized(IntElementRows& lhs, const IntElementRows& rhs, Op op,
+                                   std::size_t first, std::size_t last)
+{
+    const std::size_t n = lhs.size();
+    std::vector<int> a(n);
+    std::vector<int> b(n);
+
+    for(std::size_t i = first; i < last; i++)
     {
-        blockct = ceil(m_size / blocksz);
+        auto& lrow = lhs[i];
+        const auto& rrow = rhs[i];
+        for(std::size_t j = 0; j < n; j++)
+        {
+            a[j] = lrow[j]->getVal();
+            b[j] = rrow[j]->getVal();
+        }
+
+        int* const pa = a.data();
+        const int* const pb = b.data();
+        for(std::size_t j = 0; j < n; j++) pa[j] = op(pa[j], pb[j]);
+
+        for(std::size_t j = 0; j < n; j++) lrow[j]->setVal(pa[j]);
     }
-    std::atomic_int turn{0};
-    std::atomic_int ends{static_cast<int>(blockct)};
-    std::vector<std::vector<std::shared_ptr<IntElement>>> temp;
+}
 
-    for(unsigned int i = 0; i < blockct; i++)
+/** \brief Copies the values of rows to v in row-major order, or
+ *         transposed in block * block blocks so that reads and writes
+ *         both stay in cache.
+ */
+static void pack_values(const IntElementRows& rows, std::vector<int>& v,
+                        unsigned int block, bool transposed)
+{
+    const unsigned int n = static_cast<unsigned int>(rows.size());
+    if(block == 0) block = n;
+
+    for(unsigned int ii = 0; ii < n; ii += block)
     {
-        v_threads.push_back(std::thread{[&turn, this, &rhs, &blocksz, &func, &ends]()
+        const unsigned int iend = std::min(n, ii + block);
+        for(unsigned int jj = 0; jj < n; jj += block)
         {
-            const unsigned int myturn = turn++;
-
-            auto lhs_fut = std::async(
-                std::launch::async, &ElementarySquareMatrix<IntElement>::block,
-                    this, (blocksz * myturn), blocksz);
-            auto rhs_fut = std::async(
-                std::launch::async, &ElementarySquareMatrix<IntElement>::block,
-                    rhs, (blocksz * myturn), blocksz);
-
-            auto block_lhs = lhs_fut.get();
-            auto block_rhs = rhs_fut.get();
-
-            std::vector<std::shared_ptr<IntElement>> results;
-            auto iter_rhs = block_rhs.cbegin();
-            int k = 0;
-            for(auto& el_lhs : block_lhs)
+            const unsigned int jend = std::min(n, jj + block);
+            for(unsigned int i = ii; i < iend; i++)
             {
-                std::shared_ptr<IntElement> result{
-                    new IntElement{func(*el_lhs, **iter_rhs++)}};
-
-                results.push_back(result);
-                k++;
+                for(unsigned int j = jj; j < jend; j++)
+                {
+                    v[transposed ? j * n + i : i * n + j] = rows[i][j]->getVal();
+                }
             }
+        }
+    }
+}
 
-            ends--;
-
-            // Wait until all other threads
-            // are done before writing to original matrix.
-            while(true)
+/** \brief Adds rows [first, last) of a * b to c, bt being b transposed.
+ *         Columns and the summed index run in tile-sized steps.
+ */
+static void multiply_dot(const int* a, const int* bt, int* c, unsigned int n,
+                         unsigned int tile, unsigned int first, unsigned int last)
+{
+    for(unsigned int jj = 0; jj < n; jj += tile)
+    {
+        const unsigned int jend = std::min(n, jj + tile);
+        for(unsigned int kk = 0; kk < n; kk += tile)
+        {
+            const unsigned int kend = std::min(n, kk + tile);
+            for(unsigned int i = first; i < last; i++)
             {
-                mtx.lock();
-                if(ends == 0)
+                const int* const row = a + i * n;
+                for(unsigned int j = jj; j < jend; j++)
                 {
-                    mtx.unlock();
-                    break;
+                    const int* const col = bt + j * n;
+                    int sum = 0;
+                    for(unsigned int k = kk; k < kend; k++) sum += row[k] * col[k];
+                    c[i * n + j] += sum;
                 }
-                mtx.unlock();
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
+        }
+    }
+}
 
-            // Write result back to original matrix.
-            mtx.lock();
-            auto iter = block_lhs.begin();
-            for(auto& res : results)
+/** \brief Adds rows [first, last) of a * b to c as scaled rows of b.
+ *         Columns and the summed index run in tile-sized steps.
+ */
+static void multiply_axpy(const int* a, const int* b, int* c, unsigned int n,
+                          unsigned int tile, unsigned int first, unsigned int last)
+{
+    for(unsigned int kk = 0; kk < n; kk += tile)
+    {
+        const unsigned int kend = std::min(n, kk + tile);
+        for(unsigned int jj = 0; jj < n; jj += tile)
+        {
+            const unsigned int jend = std::min(n, jj + tile);
+            for(unsigned int i = first; i < last; i++)
             {
-                std::swap(**iter++, *res);
+                int* const row = c + i * n;
+                for(unsigned int k = kk; k < kend; k++)
+                {
+                    const int aik = a[i * n + k];
+                    const int* const brow = b + k * n;
+                    for(unsigned int j = jj; j < jend; j++) row[j] += aik * brow[j];
+                }
             }
-            mtx.unlock();
-        }});
+        }
     }
+}
 
-    for(auto&& t : v_threads)
+template<>
+void ElementarySquareMatrix<IntElement>::elementwise(const ConcreteSquareMatrix& rhs, char op)
+{
+    const KernelConfig& config = kernel_config();
+    const std::uint64_t size = static_cast<std::uint64_t>(n) * n;
+    const auto add = [](int a, int b) {return a + b;};
+    const auto sub = [](int a, int b) {return a - b;};
+
+    switch(select_mode(size, config.elementwise_vectorized_min, config.elementwise_parallel_min))
     {
-        t.join();
+        case ExecutionMode::serial:
+            if(op == '+') elementwise_serial(elements, rhs.elements, add);
+            else elementwise_serial(elements, rhs.elements, sub);
+            break;
+        case ExecutionMode::vectorized:
+            if(op == '+') elementwise_vectorized(elements, rhs.elements, add, 0, n);
+            else elementwise_vectorized(elements, rhs.elements, sub, 0, n);
+            break;
+        case ExecutionMode::parallel:
+        {
+            /* Rows are independent and the elements exist already, so
+             * bands of rows can be updated in place on the pool. */
+            IntElementRows& lhs = elements;
+            const IntElementRows& other = rhs.elements;
+            parallel_for(0, n, 1, [&lhs, &other, op, add, sub](unsigned int first,
+                                                               unsigned int last)
+            {
+                TraceSpan span{"block compute", first};
+                if(op == '+') elementwise_vectorized(lhs, other, add, first, last);
+                else elementwise_vectorized(lhs, other, sub, first, last);
+            });
+            break;
+        }
     }
 }
 
@@ -100,7 +235,7 @@ std::ostream& operator<<(std::ostream& os, const SquareMatrix& e)
 template<>
 ElementarySquareMatrix<IntElement>::ElementarySquareMatrix(int m) : n(m)
 {
-    std::vector<std::vector<std::shared_ptr<IntElement>>> temp;
+    std::vector<std::vector<ElementPtr<IntElement>>> temp;
 
     auto seed = std::chrono::system_clock::now().time_since_epoch().count();
     std::default_random_engine generator(seed);
@@ -108,12 +243,11 @@ ElementarySquareMatrix<IntElement>::ElementarySquareMatrix(int m) : n(m)
 
     for(int n = 0; n < m; n++)
     {
-        std::vector<std::shared_ptr<IntElement>> row;
+        std::vector<ElementPtr<IntElement>> row;
 
         for(int j = 0; j < m; j++)
         {
-            row.push_back(std::shared_ptr<IntElement>{
-                new IntElement{distribution(generator)}});
+            row.push_back(make_element<IntElement>(distribution(generator)));
         }
 
         temp.push_back(std::move(row));
@@ -124,167 +258,85 @@ ElementarySquareMatrix<IntElement>::ElementarySquareMatrix(int m) : n(m)
 
 template<>
 ElementarySquareMatrix<IntElement>::ElementarySquareMatrix(
-    const std::string& str_m) : n(0)
+    unsigned int new_n, const std::vector<int>& values) : n(new_n)
 {
-    std::stringstream ss;
-    char c = 0;
-    int a;
-    bool looped = false;
-
-    ss << str_m;
-    ss >> std::skipws >> c;
-    if(c != '[' || !ss.good())
+    if(values.size() != static_cast<std::size_t>(n) * n)
     {
-        throw std::invalid_argument("Invalid string (first bracket).");
+        throw std::invalid_argument("Not a squarematrix (invalid n).");
     }
 
-    ss >> std::skipws >> c;
-    while(c != ']' && ss.good())
-    {
-        if(!looped)
-        {
-            looped = true;
-        }
+    elements.reserve(n);
+    auto it = values.cbegin();
 
-        if(c != '[' || !ss.good())
-        {
-            throw std::invalid_argument("Invalid string.");
-        }
+    for(unsigned int i = 0; i < n; i++)
+    {
+        std::vector<ElementPtr<IntElement>> row;
+        row.reserve(n);
 
-        std::vector<std::shared_ptr<IntElement>> row;
-        do
+        for(unsigned int j = 0; j < n; j++)
         {
-            ss >> std::skipws >> a >> c;
-            if(!ss.good())
-            {
-                throw std::invalid_argument("Invalid string.");
-            }
-            row.push_back(std::shared_ptr<IntElement>{new IntElement{a}});
+            row.push_back(make_element<IntElement>(*it++));
         }
-        while(c == ',');
-
-        if(c != ']') throw std::invalid_argument("Invalid string.");
 
-        if(elements.size() == 0)
-        {
-            n = row.size();
-        }
-        else if(row.size() != n)
-        {
-            throw std::invalid_argument("Invalid string (row size).");
-        }
         elements.push_back(std::move(row));
-        ss >> std::skipws >> c;
     }
+}
 
-    if(!looped)
-    {
-        throw std::invalid_argument("Invalid string.");
-    }
-    if(elements.size() != n)
-    {
-        throw std::invalid_argument("Invalid string (elements size).");
-    }
-    if(!ss.good())
+template<>
+ElementarySquareMatrix<IntElement>::ElementarySquareMatrix(
+    const std::string& str_m) : n(0)
+{
+    std::vector<int> values;
+    const char* err = parse_concrete(
+        str_m.data(), str_m.data() + str_m.size(), n, values);
+
+    if(err != nullptr)
     {
-        throw std::invalid_argument("Invalid string (bad stream).");
+        throw std::invalid_argument(err);
     }
     if(str_m.back() != ']')
     {
         throw std::invalid_argument("Invalid string (last bracket).");
     }
 
-    /* Check if there is still stuff in the stream. */
-    ss >> std::skipws >> c;
-    if(ss.good())
-    {
-        throw std::invalid_argument("Invalid string.");
-    }
+    *this = ConcreteSquareMatrix{n, values};
 }
 
 template<>
 ElementarySquareMatrix<Element>::ElementarySquareMatrix(
     const std::string& str_m) : n(0)
 {
-    std::stringstream ss;
-    char c = 0;
-    int a = 0;
-    bool looped = false;
+    std::vector<SymbolicToken> values;
+    const char* err = parse_symbolic(
+        str_m.data(), str_m.data() + str_m.size(), n, values);
 
-    ss << str_m;
-    ss >> std::skipws >> c;
-    if(c != '[' || !ss.good())
+    if(err != nullptr)
     {
-        throw std::invalid_argument("Invalid string (first bracket).");
+        throw std::invalid_argument(err);
     }
 
-    ss >> std::skipws >> c;
-    while(c != ']' && ss.good())
-    {
-        if(!looped)
-        {
-            looped = true;
-        }
+    elements.reserve(n);
+    auto it = values.cbegin();
 
-        if(c != '[' || !ss.good())
-        {
-            throw std::invalid_argument("Invalid string.");
-        }
+    for(unsigned int i = 0; i < n; i++)
+    {
+        std::vector<ElementPtr<Element>> row;
+        row.reserve(n);
 
-        std::vector<std::shared_ptr<Element>> row;
-        do
+        for(unsigned int j = 0; j < n; j++, it++)
         {
-            ss >> std::skipws >> a;
-            if(!ss.good())
+            if(it->is_variable)
             {
-                ss.clear();
-                ss >> c;
-                if(!ss.good() || !isalpha(c))
-                {
-                    throw std::invalid_argument("Invalid string.");
-                }
-                row.push_back(std::shared_ptr<Element>{new VariableElement{c}});
+                row.push_back(make_element<VariableElement>(
+                    static_cast<char>(it->value)));
             }
             else
             {
-                row.push_back(std::shared_ptr<Element>{new IntElement{a}});
+                row.push_back(make_element<IntElement>(it->value));
             }
-            ss >> std::skipws >> c;
         }
-        while(c == ',');
-
-        if(c != ']') throw std::invalid_argument("Invalid string.");
 
-        if(elements.size() == 0)
-        {
-            n = row.size();
-        }
-        else if(row.size() != n)
-        {
-            throw std::invalid_argument("Invalid string.");
-        }
         elements.push_back(std::move(row));
-        ss >> std::skipws >> c;
-    }
-
-    if(!looped)
-    {
-        throw std::invalid_argument("Invalid string.");
-    }
-    if(elements.size() != n)
-    {
-        throw std::invalid_argument("Invalid string (elements size).");
-    }
-    if(!ss.good())
-    {
-        throw std::invalid_argument("Invalid string (bad stream).");
-    }
-
-    /* Check if there is still stuff in the stream. */
-    ss >> std::skipws >> c;
-    if(ss.good())
-    {
-        throw std::invalid_argument("Invalid string.");
     }
 }
 
@@ -292,16 +344,15 @@ template<>
 ConcreteSquareMatrix
     SymbolicSquareMatrix::evaluate(const Valuation& val) const
 {
-    std::vector<std::vector<std::shared_ptr<IntElement>>> temp;
+    std::vector<std::vector<ElementPtr<IntElement>>> temp;
 
     for(const auto& row : elements)
     {
-        std::vector<std::shared_ptr<IntElement>> newrow;
+        std::vector<ElementPtr<IntElement>> newrow;
 
         for(const auto& e : row)
         {
-            newrow.push_back(std::shared_ptr<IntElement>{
-                new IntElement{e->evaluate(val)}});
+            newrow.push_back(make_element<IntElement>(e->evaluate(val)));
         }
 
         temp.push_back(std::move(newrow));
@@ -329,7 +380,7 @@ bool ConcreteSquareMatrix::operator==(const ConcreteSquareMatrix& m) const
         auto eit = rowit++->cbegin();
 
         bool equals = std::all_of(row.cbegin(), row.cend(),
-            [&eit](const std::shared_ptr<IntElement>& ep1)
+            [&eit](const ElementPtr<IntElement>& ep1)
             {return *ep1 == **eit++;});
 
         if(!equals) return false;
@@ -350,7 +401,7 @@ bool SymbolicSquareMatrix::operator==(const SymbolicSquareMatrix& m) const
         auto eit = rowit++->cbegin();
 
         bool equals = std::all_of(row.cbegin(), row.cend(),
-            [&eit](const std::shared_ptr<Element>& ep1)
+            [&eit](const ElementPtr<Element>& ep1)
             {return ep1->toString() == (**eit++).toString();});
 
         if(!equals) return false;
@@ -364,11 +415,9 @@ ConcreteSquareMatrix&
     ConcreteSquareMatrix::operator+=(const ConcreteSquareMatrix& m)
 {
     if(n != m.n) throw std::invalid_argument("Dimension mismatch.");
+    if(small_oper(*this, m, FixedAdd{})) return *this;
 
-    this->t_oper(m, [](IntElement& e1, IntElement& e2)
-    {
-        return IntElement{e1 + e2};
-    });
+    elementwise(m, '+');
 
     return *this;
 }
@@ -378,11 +427,9 @@ ConcreteSquareMatrix&
     ConcreteSquareMatrix::operator-=(const ConcreteSquareMatrix& m)
 {
     if(n != m.n) throw std::invalid_argument("Dimension mismatch.");
+    if(small_oper(*this, m, FixedSubtract{})) return *this;
 
-    this->t_oper(m, [](IntElement& e1, IntElement& e2)
-    {
-        return IntElement{e1 - e2};
-    });
+    elementwise(m, '-');
 
     return *this;
 }
@@ -392,30 +439,62 @@ ConcreteSquareMatrix&
     ConcreteSquareMatrix::operator*=(const ConcreteSquareMatrix& m)
 {
     if(n != m.n) throw std::invalid_argument("Dimension mismatch");
+    if(small_oper(*this, m, FixedMultiply{})) return *this;
 
-    std::vector<std::vector<std::shared_ptr<IntElement>>> prodv;
-
-	ConcreteSquareMatrix tm = m.transpose();
+    const KernelConfig& config = kernel_config();
+    const ExecutionMode mode = select_mode(n, config.multiply_vectorized_min,
+                                           config.multiply_parallel_min);
+    IntElementRows prodv(n);
 
-	for(auto& row : elements)
-	{
-        prodv.push_back(std::vector<std::shared_ptr<IntElement>>{});
-        for(auto& col : tm.elements)
+    if(mode == ExecutionMode::serial)
+    {
+        for(unsigned int i = 0; i < n; i++)
         {
-            std::vector<IntElement> iev(n);
-
-            std::transform(row.begin(), row.end(), col.begin(), iev.begin(),
-                [](std::shared_ptr<IntElement>& ep1,
-                   std::shared_ptr<IntElement>& ep2)
-                    {return IntElement{*ep1 * *ep2};});
+            prodv[i].reserve(n);
+            for(unsigned int j = 0; j < n; j++)
+            {
+                int sum = 0;
+                for(unsigned int k = 0; k < n; k++)
+                {
+                    sum += elements[i][k]->getVal() * m.elements[k][j]->getVal();
+                }
+                prodv[i].push_back(make_element<IntElement>(IntElement{sum}));
+            }
+        }
+    }
+    else
+    {
+        /* Values gathered to contiguous buffers, so the loops vectorize. */
+        const bool dot = config.multiply_variant == MultiplyVariant::dot;
+        std::vector<int> a(n * n);
+        std::vector<int> b(n * n);
+        pack_values(elements, a, 0, false);
+        pack_values(m.elements, b, config.transpose_block, dot);
+
+        std::vector<int> c(n * n, 0);
+        const unsigned int size = n;
+        const unsigned int tile = config.multiply_tile == 0 ? n : config.multiply_tile;
+        auto rows = [&a, &b, &c, size, tile, dot](unsigned int first, unsigned int last)
+        {
+            TraceSpan span{"block compute", first};
+            if(dot) multiply_dot(a.data(), b.data(), c.data(), size, tile, first, last);
+            else multiply_axpy(a.data(), b.data(), c.data(), size, tile, first, last);
+        };
 
-            IntElement sum;
-            for(auto& e: iev) sum += e;
+        if(mode == ExecutionMode::parallel) parallel_for(0, n, 1, rows);
+        else rows(0, n);
 
-            prodv.back().push_back(std::shared_ptr<IntElement>{
-                new IntElement{sum}});
+        /* Elements are made on this thread, in its arena. */
+        TraceSpan writeback_span{"writeback", n};
+        for(unsigned int i = 0; i < n; i++)
+        {
+            prodv[i].reserve(n);
+            for(unsigned int j = 0; j < n; j++)
+            {
+                prodv[i].push_back(make_element<IntElement>(IntElement{c[i * n + j]}));
+            }
         }
-	}
+    }
 
 	std::swap(elements, prodv);
 	return *this;
@@ -459,6 +538,8 @@ ConcreteSquareMatrix operator/(const ConcreteSquareMatrix& m1,
     return ret;
 }
 
+#ifdef SQM_TESTS
+
 TEST_CASE("Matrix blocks.", "[block][matrix][exception]")
 {
     ConcreteSquareMatrix conc{"[[1,2][3,4]]"};
@@ -538,15 +619,15 @@ TEST_CASE("Matrix blocks.", "[block][matrix][exception]")
 TEST_CASE("ConcreteSquareMatrix constructors, mutation and operators.",
           "[ConcreteSquareMatrix][constructor][assignment][mutator][math][op]")
 {
-    std::vector<std::vector<std::shared_ptr<IntElement>>> temp1{};
+    std::vector<std::vector<ElementPtr<IntElement>>> temp1{};
     int k = 1;
     for(int i = 0; i < 3; i++)
     {
-        std::vector<std::shared_ptr<IntElement>> row;
+        std::vector<ElementPtr<IntElement>> row;
 
         for(int j = 0; j < 3; j++)
         {
-            row.push_back(std::shared_ptr<IntElement>{new IntElement{k++}});
+            row.push_back(ElementPtr<IntElement>{new IntElement{k++}});
         }
 
         temp1.push_back(std::move(row));
@@ -636,13 +717,13 @@ TEST_CASE("ConcreteSquareMatrix constructors, mutation and operators.",
 TEST_CASE("ConcreteSquareMatrix errors.",
           "[ConcreteSquareMatrix][error][exception]")
 {
-    std::vector<std::shared_ptr<IntElement>> temp1;
-    temp1.push_back(std::move(std::shared_ptr<IntElement>{new IntElement{0}}));
-    std::vector<std::shared_ptr<IntElement>> temp2;
-    std::vector<std::shared_ptr<IntElement>> temp3;
+    std::vector<ElementPtr<IntElement>> temp1;
+    temp1.push_back(std::move(ElementPtr<IntElement>{new IntElement{0}}));
+    std::vector<ElementPtr<IntElement>> temp2;
+    std::vector<ElementPtr<IntElement>> temp3;
 
-    std::vector<std::vector<std::shared_ptr<IntElement>>> v{3};
-    std::vector<std::vector<std::shared_ptr<IntElement>>> v2;
+    std::vector<std::vector<ElementPtr<IntElement>>> v{3};
+    std::vector<std::vector<ElementPtr<IntElement>>> v2;
 
     v2.push_back(std::move(temp1));
     v2.push_back(std::move(temp2));
@@ -752,3 +833,5 @@ TEST_CASE("Large matrices.", "[matrix][large][stress][memory]")
 
     m1 += m2 += m3 += m4;
 }
+
+#endif // SQM_TESTS
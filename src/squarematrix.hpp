@@ -13,16 +13,21 @@
 #include <random>
 #include <thread>
 #include <mutex>
+#include <functional>
 #include "element.hpp"
+#include "elementarena.hpp"
+#include "matrixformat.hpp"
 #include "valuation.hpp"
 
-const unsigned int n_threads = std::thread::hardware_concurrency();
 static std::mutex mtx;
 
 /* Forward declaration. */
 template <typename T>
 class ElementarySquareMatrix;
 
+template <typename T, unsigned int N>
+class FixedSquareMatrix;
+
 using ConcreteSquareMatrix = ElementarySquareMatrix<IntElement>;
 using SymbolicSquareMatrix = ElementarySquareMatrix<Element>;
 
@@ -83,7 +88,7 @@ class ElementarySquareMatrix : public SquareMatrix
          */
         ElementarySquareMatrix() :
             n(0),
-            elements(std::move(std::vector<std::vector<std::shared_ptr<T>>>{})) {};
+            elements(std::move(std::vector<std::vector<ElementPtr<T>>>{})) {};
 
         /** \brief Constructs a random matrix.
          *  \param m Row/column count for the random matrix.
@@ -98,13 +103,22 @@ class ElementarySquareMatrix : public SquareMatrix
          */
         ElementarySquareMatrix(const std::string& str_m);
 
+        /** \brief Parametrized constructor.
+         *         Constructs ConcreteSquareMatrix from integers.
+         *
+         *  \param new_n Value for n.
+         *  \param values n * n integers in row-major order.
+         *  \throw std::invalid_argument if values has wrong size.
+         */
+        ElementarySquareMatrix(unsigned int new_n, const std::vector<int>& values);
+
         /** \brief Parametrized constructor.
          *  \param new_n Value for n.
          *  \param new_elements Value for elements.
          */
         ElementarySquareMatrix(
             unsigned int new_n,
-            std::vector<std::vector<std::shared_ptr<T>>> new_elements) :
+            std::vector<std::vector<ElementPtr<T>>> new_elements) :
                 n(new_n),
                 elements(std::move(new_elements))
         {
@@ -124,16 +138,15 @@ class ElementarySquareMatrix : public SquareMatrix
          *  \param Reference to ElementarySquareMatrix<T>.
          */
         ElementarySquareMatrix(const ElementarySquareMatrix<T>& m) :
-            n(m.n), elements(std::vector<std::vector<std::shared_ptr<T>>>{})
+            n(m.n), elements(std::vector<std::vector<ElementPtr<T>>>{})
         {
             for(const auto& row : m.elements)
             {
-                std::vector<std::shared_ptr<T>> newrow;
+                std::vector<ElementPtr<T>> newrow;
 
                 for(const auto& e : row)
                 {
-                    newrow.push_back(std::shared_ptr<T>{
-                        static_cast<T*>(e->clone())});
+                    newrow.push_back(clone_element(*e));
                 }
 
                 elements.push_back(std::move(newrow));
@@ -148,7 +161,7 @@ class ElementarySquareMatrix : public SquareMatrix
             elements(std::move(m.elements))
         {
             m.n = 0;
-            m.elements = std::vector<std::vector<std::shared_ptr<T>>>{};
+            m.elements = std::vector<std::vector<ElementPtr<T>>>{};
         }
 
         /** \brief Default destructor.
@@ -176,11 +189,10 @@ class ElementarySquareMatrix : public SquareMatrix
 
             for(const auto& row : m.elements)
             {
-                std::vector<std::shared_ptr<T>> newrow;
+                std::vector<ElementPtr<T>> newrow;
                 for(const auto& e : row)
                 {
-                    newrow.push_back(std::shared_ptr<T>{
-                        static_cast<T*>(e->clone())});
+                    newrow.push_back(clone_element(*e));
                 }
 
                 elements.push_back(std::move(newrow));
@@ -199,7 +211,7 @@ class ElementarySquareMatrix : public SquareMatrix
             elements = std::move(m.elements);
 
             m.n = 0;
-            m.elements = std::vector<std::vector<std::shared_ptr<T>>>{};
+            m.elements = std::vector<std::vector<ElementPtr<T>>>{};
 
             return *this;
         };
@@ -211,16 +223,14 @@ class ElementarySquareMatrix : public SquareMatrix
         {
             ElementarySquareMatrix<T> temp{};
             temp.n = n;
-            temp.elements = std::vector<std::vector<std::shared_ptr<T>>>{n};
+            temp.elements = std::vector<std::vector<ElementPtr<T>>>{n};
 
             for(const auto& row : elements)
             {
                 auto it = temp.elements.begin();
                 for(auto& e : row)
                 {
-                    it++->push_back
-                        (std::shared_ptr<T>{
-                            static_cast<T*>(e->clone())});
+                    it++->push_back(clone_element(*e));
                 }
             }
 
@@ -253,7 +263,7 @@ class ElementarySquareMatrix : public SquareMatrix
          */
         void print(std::ostream& os) const override
         {
-            os << this->toString();
+            print_matrix(os, elements);
         }
 
         /** \brief Returns string representation of the matrix.
@@ -261,26 +271,7 @@ class ElementarySquareMatrix : public SquareMatrix
          */
         std::string toString() const override
         {
-            std::string str("[");
-
-            for(const auto& vec : elements)
-            {
-                str += "[";
-
-                bool firstel = true;
-                for(const auto& e : vec)
-                {
-                    if(!firstel) str += ",";
-                    str += e->toString();
-                    firstel = false;
-                }
-
-                str += "]";
-            }
-
-            str += "]";
-
-            return str;
+            return format_matrix(elements);
         }
 
         /** \brief Evaluates SquareMatrix to a ConcreteSquareMatrix.
@@ -293,8 +284,27 @@ class ElementarySquareMatrix : public SquareMatrix
         /** \brief Returns a copy of elements.
          *  \return std::vector.
          */
-        std::vector<std::vector<std::shared_ptr<T>>>
-            cloneElements() const;
+        std::vector<std::vector<ElementPtr<T>>>
+            cloneElements() const
+        {
+            std::vector<std::vector<ElementPtr<T>>> ret;
+            ret.reserve(n);
+
+            for(const auto& row : elements)
+            {
+                std::vector<ElementPtr<T>> newrow;
+                newrow.reserve(n);
+
+                for(const auto& e : row)
+                {
+                    newrow.push_back(clone_element(*e));
+                }
+
+                ret.push_back(std::move(newrow));
+            }
+
+            return ret;
+        };
 
         /** \brief operator+= overload.
          *  \param m Reference to ElementarySquareMatrix<T>.
@@ -355,7 +365,8 @@ class ElementarySquareMatrix : public SquareMatrix
         /** \brief Return a block of pointers from the matrix.
          *  \param start Index of first element.
          *  \param step How many elements to include.
-         *  \return Vector of Element pointers.
+         *  \return Vector of Element pointers. The pointers do not own the
+         *          elements, they are valid as long as the matrix is.
          *
          *  Function considers indices as if the multi-dimensional
          *  matrix was unrolled to a single-dimensional vector.
@@ -369,54 +380,40 @@ class ElementarySquareMatrix : public SquareMatrix
          *  - Index 0 refers to first element at (0),(0) which is 2.
          *  - Index 5 refers to sixth element at (1),(2) which is 9.
          */
-        std::vector<std::shared_ptr<T>> block(unsigned int start,
-                                              unsigned int step) const
+        std::vector<T*> block(unsigned int start, unsigned int step) const
         {
-            unsigned int m_size = pow(n, 2.0);
+            const unsigned int m_size = n * n;
 
             if(start > m_size)
             {
                 throw std::out_of_range("Start index exceeds elements size.");
             }
-            if(step > m_size)
+            if(step > m_size || start + step > m_size)
             {
                 throw std::out_of_range("Step exceeds elements size.");
             }
 
-            std::vector<std::shared_ptr<T>> ret;
-
-            if(step == 0)
-            {
-                return ret;
-            }
-
-            std::vector<std::shared_ptr<T>> unrolled;
-            for(auto& row : elements)
-            {
-                for(auto& e : row)
-                {
-                    unrolled.push_back(e);
-                }
-            }
+            std::vector<T*> ret;
+            ret.reserve(step);
 
             for(unsigned int i = start; i < (start + step); i++)
             {
-                ret.push_back(unrolled.at(i));
+                ret.push_back(elements[i / n][i % n].get());
             }
 
             return ret;
         };
 
-        /** \brief Do multi-threaded operations.
-         *  \param rhs Reference to ConcreteSquareMatrix.
-         *  \param func Operation to perform on this and rhs.
-         */
-        void t_oper(const ConcreteSquareMatrix& rhs,
-            std::function<IntElement(IntElement&, IntElement&)> func);
-
     private:
+        /* this = this op rhs for op '+' or '-', in the ExecutionMode
+         * kernel_config() picks for the size. */
+        void elementwise(const ConcreteSquareMatrix& rhs, char op);
+
         unsigned int n;
-        std::vector<std::vector<std::shared_ptr<T>>> elements;
+        std::vector<std::vector<ElementPtr<T>>> elements;
+
+        template <typename U, unsigned int N>
+        friend class FixedSquareMatrix;
 };
 
 #endif // SQUAREMATRIX_H
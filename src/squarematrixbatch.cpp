@@ -0,0 +1,231 @@
+/** \file squarematrixbatch.cpp
+ *  \brief SquareMatrixBatch implementation file.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "squarematrixbatch.hpp"
+#include "workerpool.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+SquareMatrixBatch::SquareMatrixBatch(unsigned int new_n, unsigned int new_count) :
+    n(new_n), count(new_count),
+    elements(static_cast<std::size_t>(new_n) * new_n * new_count, 0) {}
+
+unsigned int SquareMatrixBatch::getRowSize() const
+{
+    return n;
+}
+
+unsigned int SquareMatrixBatch::getCount() const
+{
+    return count;
+}
+
+std::size_t SquareMatrixBatch::index(unsigned int k, unsigned int i, unsigned int j) const
+{
+    if(k >= count) throw std::out_of_range("Batch index out of range.");
+    if(i >= n || j >= n) throw std::out_of_range("Index out of range.");
+
+    return (static_cast<std::size_t>(i) * n + j) * count + k;
+}
+
+int SquareMatrixBatch::at(unsigned int k, unsigned int i, unsigned int j) const
+{
+    return elements[index(k, i, j)];
+}
+
+void SquareMatrixBatch::set(unsigned int k, unsigned int i, unsigned int j,
+                            int val)
+{
+    elements[index(k, i, j)] = val;
+}
+
+ConcreteSquareMatrix SquareMatrixBatch::getMatrix(unsigned int k) const
+{
+    if(k >= count) throw std::out_of_range("Batch index out of range.");
+
+    std::vector<std::vector<ElementPtr<IntElement>>> temp;
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        std::vector<ElementPtr<IntElement>> row;
+        for(unsigned int j = 0; j < n; j++)
+        {
+            row.push_back(make_element<IntElement>(
+                elements[index(k, i, j)]));
+        }
+        temp.push_back(std::move(row));
+    }
+
+    return ConcreteSquareMatrix{n, std::move(temp)};
+}
+
+void SquareMatrixBatch::setMatrix(unsigned int k, const ConcreteSquareMatrix& m)
+{
+    if(k >= count) throw std::out_of_range("Batch index out of range.");
+    if(m.getRowSize() != n) throw std::invalid_argument("Dimension mismatch.");
+
+    auto unrolled = m.block(0, n * n);
+    for(unsigned int ij = 0; ij < n * n; ij++)
+    {
+        elements[static_cast<std::size_t>(ij) * count + k] = unrolled[ij]->getVal();
+    }
+}
+
+int* SquareMatrixBatch::data()
+{
+    return elements.data();
+}
+
+const int* SquareMatrixBatch::data() const
+{
+    return elements.data();
+}
+
+SquareMatrixBatch operator*(const SquareMatrixBatch& b1,
+                            const SquareMatrixBatch& b2)
+{
+    if(b1.n != b2.n || b1.count != b2.count)
+    {
+        throw std::invalid_argument("Dimension mismatch.");
+    }
+
+    SquareMatrixBatch ret{b1.n, b1.count};
+    batch_multiply(b1.n, b1.count, b1.data(), b2.data(), ret.data());
+    return ret;
+}
+
+/* Products of matrices [first, last) of the batch, last - first is at
+ * most batch_block_size. The innermost loop runs over the batch and
+ * accumulates into a local array, so the compiler can vectorize it
+ * without worrying about aliasing. Full blocks get a compile-time
+ * trip count. */
+template <bool Full>
+static void batch_multiply_block(unsigned int n, unsigned int count,
+                                 const int* a, const int* b, int* c,
+                                 unsigned int first, unsigned int last)
+{
+    int acc[batch_block_size];
+    const unsigned int len = Full ? batch_block_size : last - first;
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        for(unsigned int j = 0; j < n; j++)
+        {
+            std::fill(acc, acc + len, 0);
+
+            for(unsigned int l = 0; l < n; l++)
+            {
+                const int* ap = a + (static_cast<std::size_t>(i) * n + l) * count + first;
+                const int* bp = b + (static_cast<std::size_t>(l) * n + j) * count + first;
+
+                for(unsigned int k = 0; k < len; k++)
+                {
+                    acc[k] += ap[k] * bp[k];
+                }
+            }
+
+            std::copy(acc, acc + len,
+                      c + (static_cast<std::size_t>(i) * n + j) * count + first);
+        }
+    }
+}
+
+void batch_multiply(unsigned int n, unsigned int count,
+                    const int* a, const int* b, int* c)
+{
+    const unsigned int blocks =
+        (count + batch_block_size - 1) / batch_block_size;
+
+    parallel_for(0, blocks, 1, [=](unsigned int first, unsigned int last)
+    {
+        for(unsigned int blk = first; blk < last; blk++)
+        {
+            const unsigned int begin = blk * batch_block_size;
+            const unsigned int end = begin + batch_block_size;
+
+            if(end <= count)
+            {
+                batch_multiply_block<true>(n, count, a, b, c, begin, end);
+            }
+            else
+            {
+                batch_multiply_block<false>(n, count, a, b, c, begin, count);
+            }
+        }
+    });
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("SquareMatrixBatch accessors.", "[SquareMatrixBatch][accessor][exception]")
+{
+    SquareMatrixBatch batch{2, 3};
+    ConcreteSquareMatrix m{"[[1,2][3,4]]"};
+
+    CHECK(batch.getRowSize() == 2);
+    CHECK(batch.getCount() == 3);
+    CHECK(batch.getMatrix(2).toString() == "[[0,0][0,0]]");
+
+    batch.setMatrix(1, m);
+    CHECK(batch.getMatrix(1) == m);
+    CHECK(batch.at(1, 1, 0) == 3);
+    CHECK(batch.data()[2 * 3 + 1] == 3);
+
+    batch.set(0, 0, 1, 7);
+    CHECK(batch.getMatrix(0).toString() == "[[0,7][0,0]]");
+
+    CHECK_THROWS(batch.getMatrix(3));
+    CHECK_THROWS(batch.setMatrix(3, m));
+    CHECK_THROWS(batch.setMatrix(0, ConcreteSquareMatrix{"[[1]]"}));
+    CHECK_THROWS(batch.at(0, 2, 0));
+
+    /* Each index is checked, not only the flat one. */
+    CHECK_THROWS_AS(batch.at(3, 0, 0), std::out_of_range&);
+    CHECK_THROWS_AS(batch.at(0, 0, 2), std::out_of_range&);
+    CHECK_THROWS_AS(batch.set(3, 0, 0, 1), std::out_of_range&);
+    CHECK_THROWS_AS(batch.set(0, 0, 2, 1), std::out_of_range&);
+    CHECK(batch.getMatrix(0).toString() == "[[0,7][0,0]]");
+    CHECK(batch.getMatrix(1) == m);
+}
+
+TEST_CASE("SquareMatrixBatch multiplication.", "[SquareMatrixBatch][math][op]")
+{
+    const unsigned int count = 1000;
+
+    for(unsigned int n = 1; n <= 5; n++)
+    {
+        SquareMatrixBatch b1{n, count};
+        SquareMatrixBatch b2{n, count};
+        std::vector<ConcreteSquareMatrix> m1;
+        std::vector<ConcreteSquareMatrix> m2;
+
+        for(unsigned int k = 0; k < count; k++)
+        {
+            m1.push_back(ConcreteSquareMatrix(static_cast<int>(n)));
+            m2.push_back(ConcreteSquareMatrix(static_cast<int>(n)));
+            b1.setMatrix(k, m1.back());
+            b2.setMatrix(k, m2.back());
+        }
+
+        SquareMatrixBatch prod = b1 * b2;
+
+        bool equals = true;
+        for(unsigned int k = 0; k < count; k++)
+        {
+            equals = equals && prod.getMatrix(k) == m1[k] * m2[k];
+        }
+        CHECK(equals);
+    }
+
+    CHECK_THROWS(SquareMatrixBatch(2, 3) * SquareMatrixBatch(3, 3));
+    CHECK_THROWS(SquareMatrixBatch(2, 3) * SquareMatrixBatch(2, 4));
+
+    SquareMatrixBatch empty = SquareMatrixBatch{3, 0} * SquareMatrixBatch{3, 0};
+    CHECK(empty.getCount() == 0);
+}
+
+#endif // SQM_TESTS
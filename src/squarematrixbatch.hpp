@@ -0,0 +1,120 @@
+/** \file squarematrixbatch.hpp
+ *  \brief SquareMatrixBatch header file.
+ */
+
+#ifndef SQUAREMATRIXBATCH_H
+#define SQUAREMATRIXBATCH_H
+
+#include <cstddef>
+#include <vector>
+#include "squarematrix.hpp"
+
+/** \brief Number of matrices a thread processes at a time in
+ *         batch_multiply(). Keeps the touched part of the batch in cache.
+ */
+const unsigned int batch_block_size = 256;
+
+/** \class SquareMatrixBatch
+ *  \brief Batch of same-sized integer matrices in structure-of-arrays layout.
+ *
+ *  Element (i),(j) of every matrix in the batch is stored contiguously,
+ *  so element-wise loops run across the batch dimension.
+ *
+ *  \verbatim
+ *  Batch of count = 3 matrices A, B, C with n = 2 is stored as:
+ *  [A00,B00,C00, A01,B01,C01, A10,B10,C10, A11,B11,C11]
+ *  \endverbatim
+ */
+class SquareMatrixBatch
+{
+    public:
+        /** \brief Parametrized constructor. Elements are initialized to 0.
+         *  \param new_n Row/column count of each matrix.
+         *  \param new_count Number of matrices in the batch.
+         */
+        SquareMatrixBatch(unsigned int new_n, unsigned int new_count);
+
+        /** \brief Get row size of the matrices.
+         *  \return Value of member n.
+         */
+        unsigned int getRowSize() const;
+
+        /** \brief Get number of matrices in the batch.
+         *  \return Value of member count.
+         */
+        unsigned int getCount() const;
+
+        /** \brief Element accessor.
+         *  \param k Index of the matrix in the batch.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \return Element (i),(j) of matrix k.
+         *  \throw std::out_of_range if k is not below count or i or j is
+         *         not below n.
+         */
+        int at(unsigned int k, unsigned int i, unsigned int j) const;
+
+        /** \brief Element mutator.
+         *  \param k Index of the matrix in the batch.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \param val New value.
+         *  \throw std::out_of_range if k is not below count or i or j is
+         *         not below n.
+         */
+        void set(unsigned int k, unsigned int i, unsigned int j, int val);
+
+        /** \brief Copies matrix k out of the batch.
+         *  \param k Index of the matrix in the batch.
+         *  \return New instance of ConcreteSquareMatrix.
+         */
+        ConcreteSquareMatrix getMatrix(unsigned int k) const;
+
+        /** \brief Copies m into the batch at index k.
+         *  \param k Index of the matrix in the batch.
+         *  \param m Reference to ConcreteSquareMatrix.
+         *  \throw std::invalid_argument if the row size of m is not n.
+         */
+        void setMatrix(unsigned int k, const ConcreteSquareMatrix& m);
+
+        /** \brief Raw structure-of-arrays storage.
+         *  \return Pointer to n * n * count integers.
+         */
+        int* data();
+
+        /** \brief Raw structure-of-arrays storage.
+         *  \return Pointer to n * n * count integers.
+         */
+        const int* data() const;
+
+        /** \brief operator* overload. Multiplies matrix k of b1 with
+         *         matrix k of b2 for every k.
+         *  \param b1 Reference to SquareMatrixBatch.
+         *  \param b2 Reference to SquareMatrixBatch.
+         *  \return Batch of products.
+         *  \throw std::invalid_argument if the batches differ in size.
+         */
+        friend SquareMatrixBatch operator*(const SquareMatrixBatch& b1,
+                                           const SquareMatrixBatch& b2);
+
+    private:
+        std::size_t index(unsigned int k, unsigned int i, unsigned int j) const;
+
+        unsigned int n;
+        unsigned int count;
+        std::vector<int> elements;
+};
+
+/** \brief Multiplies count pairs of n*n matrices stored in
+ *         structure-of-arrays layout (see SquareMatrixBatch).
+ *         Runs vectorized across the batch and in parallel on the WorkerPool.
+ *  \param n Row/column count of each matrix.
+ *  \param count Number of matrices.
+ *  \param a Left operands, n * n * count integers.
+ *  \param b Right operands, n * n * count integers.
+ *  \param c Output, n * n * count integers. Must not overlap a or b.
+ */
+void batch_multiply(unsigned int n, unsigned int count,
+                    const int* a, const int* b, int* c);
+
+#endif // SQUAREMATRIXBATCH_H
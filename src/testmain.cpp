@@ -0,0 +1,7 @@
+/** \file testmain.cpp
+ *  \brief Test runner main file. The test cases are compiled into the
+ *         sources with SQM_TESTS defined.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
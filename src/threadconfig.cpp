@@ -0,0 +1,246 @@
+/** \file threadconfig.cpp
+ *  \brief Thread configuration implementation file.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "threadconfig.hpp"
+#include "workerpool.hpp"
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+/* 0 until the count is first needed or set. */
+static std::atomic<unsigned int> configured_threads{0};
+
+unsigned int hardware_threads()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+static unsigned int affinity_cpus()
+{
+#ifdef __linux__
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        return static_cast<unsigned int>(CPU_COUNT(&set));
+    }
+#endif
+    return 0;
+}
+
+unsigned int available_cpus()
+{
+    unsigned int ret = hardware_threads();
+
+    const unsigned int affinity = affinity_cpus();
+    if(affinity > 0) ret = std::min(ret, affinity);
+
+    const unsigned int quota = cgroup_cpu_limit();
+    if(quota > 0) ret = std::min(ret, quota);
+
+    return std::max(ret, 1u);
+}
+
+/* Quota / period rounded up, 0 for no or invalid limit. */
+static unsigned int quota_cpus(double quota, double period)
+{
+    if(quota <= 0.0 || period <= 0.0) return 0;
+    return static_cast<unsigned int>(std::max(1.0, std::ceil(quota / period)));
+}
+
+unsigned int parse_cpu_max(const std::string& content)
+{
+    std::istringstream ss{content};
+    std::string quota;
+    double period = 0.0;
+    if(!(ss >> quota >> period) || quota == "max") return 0;
+
+    char* end = nullptr;
+    const double q = std::strtod(quota.c_str(), &end);
+    if(*end != '\0') return 0;
+    return quota_cpus(q, period);
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream is{path};
+    std::ostringstream ss;
+    ss << is.rdbuf();
+    return is ? ss.str() : std::string{};
+}
+
+unsigned int cgroup_cpu_limit()
+{
+#ifdef __linux__
+    /* cgroup v2: "0::/path" in /proc/self/cgroup. */
+    std::istringstream cgroups{read_file("/proc/self/cgroup")};
+    std::string line;
+    while(std::getline(cgroups, line))
+    {
+        if(line.compare(0, 3, "0::") != 0) continue;
+
+        const std::string dir = "/sys/fs/cgroup" + line.substr(3);
+        std::string content = read_file(dir + "/cpu.max");
+        if(content.empty()) content = read_file("/sys/fs/cgroup/cpu.max");
+        if(!content.empty()) return parse_cpu_max(content);
+    }
+
+    /* cgroup v1. */
+    const char* const dirs[] = {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"};
+    for(const char* dir : dirs)
+    {
+        std::istringstream quota{read_file(std::string{dir} + "/cpu.cfs_quota_us")};
+        std::istringstream period{read_file(std::string{dir} + "/cpu.cfs_period_us")};
+        double q = 0.0;
+        double p = 0.0;
+        if(quota >> q && period >> p) return quota_cpus(q, p);
+    }
+#endif
+    return 0;
+}
+
+std::vector<unsigned int> parse_cpu_list(const std::string& list)
+{
+    if(list.empty() || list.back() == ',')
+    {
+        throw std::invalid_argument("Invalid CPU list " + list + ".");
+    }
+
+    std::vector<unsigned int> ret;
+    std::istringstream ss{list};
+    std::string item;
+    while(std::getline(ss, item, ','))
+    {
+        unsigned long first = 0;
+        unsigned long last = 0;
+        char* end = nullptr;
+
+        first = std::strtoul(item.c_str(), &end, 10);
+        if(end == item.c_str()) throw std::invalid_argument("Invalid CPU list " + list + ".");
+        last = first;
+        if(*end == '-')
+        {
+            const char* second = end + 1;
+            last = std::strtoul(second, &end, 10);
+            if(end == second) throw std::invalid_argument("Invalid CPU list " + list + ".");
+        }
+        if(*end != '\0' || last < first || last > 65535)
+        {
+            throw std::invalid_argument("Invalid CPU list " + list + ".");
+        }
+
+        for(unsigned long cpu = first; cpu <= last; cpu++)
+        {
+            ret.push_back(static_cast<unsigned int>(cpu));
+        }
+    }
+
+    return ret;
+}
+
+unsigned int default_thread_count()
+{
+    const char* env = std::getenv("SQM_THREADS");
+    if(env != nullptr && *env != '\0')
+    {
+        char* end = nullptr;
+        const unsigned long n = std::strtoul(env, &end, 10);
+        if(*end == '\0' && n > 0 && n <= max_thread_count) return static_cast<unsigned int>(n);
+    }
+    return available_cpus();
+}
+
+unsigned int thread_count()
+{
+    unsigned int ret = configured_threads.load();
+    if(ret == 0)
+    {
+        ret = default_thread_count();
+        configured_threads.store(ret);
+    }
+    return ret;
+}
+
+void set_thread_count(unsigned int count)
+{
+    if(count > max_thread_count)
+    {
+        throw std::invalid_argument("Invalid thread count " + std::to_string(count) + ".");
+    }
+
+    const unsigned int previous = configured_threads.exchange(
+        count == 0 ? default_thread_count() : count);
+    try
+    {
+        WorkerPool::instance().resize(thread_count() - 1);
+    }
+    catch(...)
+    {
+        configured_threads.store(previous);
+        throw;
+    }
+}
+
+void set_cpu_affinity(const std::vector<unsigned int>& cpus)
+{
+    WorkerPool::instance().setAffinity(cpus);
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("Thread configuration.", "[threads]")
+{
+    CHECK(parse_cpu_max("max 100000\n") == 0);
+    CHECK(parse_cpu_max("200000 100000\n") == 2);
+    CHECK(parse_cpu_max("150000 100000") == 2);
+    CHECK(parse_cpu_max("50000 100000") == 1);
+    CHECK(parse_cpu_max("") == 0);
+    CHECK(cgroup_cpu_limit() <= 65536);
+
+    CHECK(parse_cpu_list("0-2,5") == (std::vector<unsigned int>{0, 1, 2, 5}));
+    CHECK(parse_cpu_list("3") == std::vector<unsigned int>{3});
+    CHECK_THROWS_AS(parse_cpu_list(""), std::invalid_argument&);
+    CHECK_THROWS_AS(parse_cpu_list("2-1"), std::invalid_argument&);
+    CHECK_THROWS_AS(parse_cpu_list("a"), std::invalid_argument&);
+    CHECK_THROWS_AS(parse_cpu_list("1,"), std::invalid_argument&);
+
+    CHECK(available_cpus() >= 1);
+    CHECK(available_cpus() <= hardware_threads());
+
+    setenv("SQM_THREADS", "3", 1);
+    CHECK(default_thread_count() == 3);
+    setenv("SQM_THREADS", "zero", 1);
+    CHECK(default_thread_count() == available_cpus());
+    setenv("SQM_THREADS", "4097", 1);
+    CHECK(default_thread_count() == available_cpus());
+    unsetenv("SQM_THREADS");
+
+    set_thread_count(3);
+    CHECK_THROWS_AS(set_thread_count(max_thread_count + 1), std::invalid_argument&);
+    CHECK(thread_count() == 3);
+    CHECK(WorkerPool::instance().getConcurrency() == 3);
+
+    std::vector<int> v(1000, 0);
+    parallel_for(0, v.size(), 1, [&v](unsigned int b, unsigned int e)
+    {
+        for(unsigned int i = b; i < e; i++) v[i]++;
+    });
+    CHECK(std::count(v.cbegin(), v.cend(), 1) == 1000);
+
+    set_thread_count(0);
+    CHECK(thread_count() == default_thread_count());
+    CHECK(WorkerPool::instance().getConcurrency() == thread_count());
+}
+
+#endif // SQM_TESTS
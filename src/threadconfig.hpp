@@ -0,0 +1,77 @@
+/** \file threadconfig.hpp
+ *  \brief Number of threads the parallel operations use, and the CPUs
+ *         the WorkerPool is pinned to.
+ */
+
+#ifndef THREADCONFIG_H
+#define THREADCONFIG_H
+
+#include <string>
+#include <vector>
+
+/** \brief Largest thread count that can be set.
+ */
+const unsigned int max_thread_count = 4096;
+
+/** \brief Hardware threads of the host.
+ *  \return std::thread::hardware_concurrency(), at least 1.
+ */
+unsigned int hardware_threads();
+
+/** \brief CPUs the process may use: the hardware threads, limited by the
+ *         CPU affinity mask and the cgroup CPU quota of the process.
+ *  \return CPU count, at least 1.
+ */
+unsigned int available_cpus();
+
+/** \brief CPU limit of a cgroup v2 cpu.max file, "max 100000" or
+ *         "QUOTA PERIOD".
+ *  \param content Content of the file.
+ *  \return Quota / period rounded up, 0 if there is no limit.
+ */
+unsigned int parse_cpu_max(const std::string& content);
+
+/** \brief CPU limit of the cgroup of the process, from cgroup v2 cpu.max
+ *         or cgroup v1 cpu.cfs_quota_us and cpu.cfs_period_us.
+ *  \return Limit rounded up, 0 if there is none.
+ */
+unsigned int cgroup_cpu_limit();
+
+/** \brief Parses a CPU list like "0-3,8,10-11".
+ *  \param list CPU list.
+ *  \return CPU numbers in list order.
+ *  \throw std::invalid_argument if list is not a valid CPU list.
+ */
+std::vector<unsigned int> parse_cpu_list(const std::string& list);
+
+/** \brief Thread count used when none is set: the SQM_THREADS
+ *         environment variable if it holds a number from 1 to
+ *         max_thread_count, else available_cpus().
+ *  \return Thread count, at least 1.
+ */
+unsigned int default_thread_count();
+
+/** \brief Number of threads parallel operations use, the calling thread
+ *         included.
+ *  \return Thread count, at least 1.
+ */
+unsigned int thread_count();
+
+/** \brief Sets the number of threads parallel operations use and resizes
+ *         the WorkerPool. Must not be called from a parallel operation.
+ *  \param count Thread count, 0 for default_thread_count().
+ *  \throw std::invalid_argument if count is above max_thread_count.
+ *  \throw std::runtime_error if the workers cannot be started, the
+ *         thread count is left as it was then.
+ */
+void set_thread_count(unsigned int count);
+
+/** \brief Pins the WorkerPool threads to CPUs, one CPU per thread in
+ *         turn. Must not be called from a parallel operation.
+ *  \param cpus CPU numbers, empty to stop pinning.
+ *  \throw std::runtime_error if pinning is not supported or a CPU cannot
+ *         be used.
+ */
+void set_cpu_affinity(const std::vector<unsigned int>& cpus);
+
+#endif // THREADCONFIG_H
@@ -0,0 +1,870 @@
+/** \file tiledsquarematrix.cpp
+ *  \brief TiledSquareMatrix implementation file.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include "tiledsquarematrix.hpp"
+#include "compositesquarematrix.hpp"
+#include "matrixfile.hpp"
+#include "matrixformat.hpp"
+#include "workerpool.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SQM_HAVE_PREAD 1
+#endif
+
+/** \class TileFile
+ *  \brief File of a TiledSquareMatrix. Reads and writes at offsets may
+ *         come from several threads at once.
+ */
+class TileFile
+{
+    public:
+        /** \brief Opens or creates a file.
+         *  \param new_path Path of the file.
+         *  \param size Size of a new file, filled with zeros.
+         *  \param create true to create the file, false to open it.
+         *  \throw std::runtime_error on failure.
+         */
+        TileFile(const std::string& new_path, std::uint64_t size, bool create) :
+            path(new_path)
+        {
+#ifdef SQM_HAVE_PREAD
+            fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+            if(fd < 0)
+            {
+                throw std::runtime_error("Could not open tile file.");
+            }
+            if(create && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Could not create tile file.");
+            }
+#else
+            if(create)
+            {
+                std::ofstream os{path, std::ios::binary | std::ios::trunc};
+                const std::vector<char> zeros(64 * 1024, 0);
+                for(std::uint64_t left = size; left > 0 && os;)
+                {
+                    const std::size_t len = static_cast<std::size_t>(
+                        std::min<std::uint64_t>(left, zeros.size()));
+                    os.write(zeros.data(), len);
+                    left -= len;
+                }
+                if(!os)
+                {
+                    throw std::runtime_error("Could not create tile file.");
+                }
+            }
+
+            fs.open(path, std::ios::binary | std::ios::in | std::ios::out);
+            if(!fs)
+            {
+                throw std::runtime_error("Could not open tile file.");
+            }
+#endif
+        }
+
+        ~TileFile()
+        {
+#ifdef SQM_HAVE_PREAD
+            ::close(fd);
+#endif
+        }
+
+        TileFile(const TileFile&) = delete;
+        TileFile& operator=(const TileFile&) = delete;
+
+        /** \brief Get the size of the file.
+         *  \return Byte count.
+         */
+        std::uint64_t size()
+        {
+#ifdef SQM_HAVE_PREAD
+            struct stat st;
+            if(::fstat(fd, &st) != 0) return 0;
+            return static_cast<std::uint64_t>(st.st_size);
+#else
+            std::lock_guard<std::mutex> lock(mtx);
+            fs.seekg(0, std::ios::end);
+            return static_cast<std::uint64_t>(fs.tellg());
+#endif
+        }
+
+        void read(std::uint64_t offset, char* out, std::size_t len)
+        {
+#ifdef SQM_HAVE_PREAD
+            while(len > 0)
+            {
+                const ssize_t r = ::pread(fd, out, len, static_cast<off_t>(offset));
+                if(r < 0 && errno == EINTR) continue;
+                if(r <= 0) throw std::runtime_error("Could not read tile file.");
+                out += r;
+                offset += static_cast<std::uint64_t>(r);
+                len -= static_cast<std::size_t>(r);
+            }
+#else
+            std::lock_guard<std::mutex> lock(mtx);
+            fs.seekg(static_cast<std::streamoff>(offset));
+            if(!fs.read(out, len)) throw std::runtime_error("Could not read tile file.");
+#endif
+        }
+
+        void write(std::uint64_t offset, const char* in, std::size_t len)
+        {
+#ifdef SQM_HAVE_PREAD
+            while(len > 0)
+            {
+                const ssize_t w = ::pwrite(fd, in, len, static_cast<off_t>(offset));
+                if(w < 0 && errno == EINTR) continue;
+                if(w <= 0) throw std::runtime_error("Could not write tile file.");
+                in += w;
+                offset += static_cast<std::uint64_t>(w);
+                len -= static_cast<std::size_t>(w);
+            }
+#else
+            std::lock_guard<std::mutex> lock(mtx);
+            fs.seekp(static_cast<std::streamoff>(offset));
+            if(!fs.write(in, len)) throw std::runtime_error("Could not write tile file.");
+#endif
+        }
+
+        /** \brief Tells if other names this file.
+         *  \param other Path to compare to.
+         *  \return true if other is this file.
+         */
+        bool isFile(const std::string& other) const
+        {
+#ifdef SQM_HAVE_PREAD
+            struct stat mine;
+            struct stat theirs;
+            return ::fstat(fd, &mine) == 0 && ::stat(other.c_str(), &theirs) == 0 &&
+                   mine.st_dev == theirs.st_dev && mine.st_ino == theirs.st_ino;
+#else
+            return other == path;
+#endif
+        }
+
+        const std::string path;
+
+    private:
+#ifdef SQM_HAVE_PREAD
+        int fd;
+#else
+        std::fstream fs;
+        std::mutex mtx;
+#endif
+};
+
+/* Writes tiles on its own thread. write() returns at once unless
+ * tile_write_behind tiles are already waiting. */
+class TileWriter
+{
+    public:
+        explicit TileWriter(TiledSquareMatrix& new_target) :
+            target(new_target), done(false),
+            thread(&TileWriter::loop, this) {}
+
+        ~TileWriter()
+        {
+            stop();
+        }
+
+        void write(unsigned int ti, unsigned int tj, std::vector<int> t)
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this]{return queue.size() < tile_write_behind || error;});
+            if(error) std::rethrow_exception(error);
+            queue.push_back(Job{ti, tj, std::move(t)});
+            cv.notify_all();
+        }
+
+        /* Waits until everything is written. */
+        void finish()
+        {
+            stop();
+            if(error) std::rethrow_exception(error);
+        }
+
+    private:
+        struct Job
+        {
+            unsigned int ti;
+            unsigned int tj;
+            std::vector<int> t;
+        };
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                done = true;
+            }
+            cv.notify_all();
+            if(thread.joinable()) thread.join();
+        }
+
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while(true)
+            {
+                cv.wait(lock, [this]{return !queue.empty() || done;});
+                if(queue.empty()) return;
+
+                Job job = std::move(queue.front());
+                lock.unlock();
+
+                try
+                {
+                    target.writeTile(job.ti, job.tj, job.t);
+                }
+                catch(...)
+                {
+                    lock.lock();
+                    error = std::current_exception();
+                    queue.clear();
+                    cv.notify_all();
+                    return;
+                }
+
+                lock.lock();
+                queue.pop_front();
+                cv.notify_all();
+            }
+        }
+
+        TiledSquareMatrix& target;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<Job> queue;
+        std::exception_ptr error;
+        bool done;
+        std::thread thread;
+};
+
+/* Calls use(k, load(k)) for k in [0, count), running load(k + 1) on
+ * another thread while use(k) runs. */
+template <typename Load, typename Use>
+static void read_ahead(unsigned long long count, Load load, Use use)
+{
+    using Tiles = decltype(load(0ull));
+    if(count == 0) return;
+
+    std::future<Tiles> next = std::async(std::launch::async, load, 0ull);
+    for(unsigned long long k = 0; k < count; k++)
+    {
+        Tiles cur = next.get();
+        if(k + 1 < count) next = std::async(std::launch::async, load, k + 1);
+        use(k, cur);
+    }
+}
+
+using TilePair = std::pair<std::vector<int>, std::vector<int>>;
+
+TiledSquareMatrix::TiledSquareMatrix(unsigned int new_n, unsigned int new_tile) :
+    n(new_n), tile(new_tile), tiles(new_tile ? (new_n + new_tile - 1) / new_tile : 0)
+{
+    if(tile == 0)
+    {
+        throw std::invalid_argument("Tile size must be positive.");
+    }
+}
+
+TiledSquareMatrix TiledSquareMatrix::create(const std::string& path,
+    unsigned int new_n, unsigned int new_tile)
+{
+    TiledSquareMatrix ret{new_n, new_tile};
+    ret.file = std::make_shared<TileFile>(path, ret.tileOffset(ret.tiles, 0), true);
+    return ret;
+}
+
+TiledSquareMatrix TiledSquareMatrix::open(const std::string& path,
+    unsigned int new_n, unsigned int new_tile)
+{
+    TiledSquareMatrix ret{new_n, new_tile};
+    ret.file = std::make_shared<TileFile>(path, 0, false);
+    if(ret.file->size() != ret.tileOffset(ret.tiles, 0))
+    {
+        throw std::invalid_argument("Tile file size does not match.");
+    }
+    return ret;
+}
+
+std::uint64_t TiledSquareMatrix::tileOffset(unsigned int ti, unsigned int tj) const
+{
+    return (static_cast<std::uint64_t>(ti) * tiles + tj) *
+           tile * tile * sizeof(int);
+}
+
+void TiledSquareMatrix::checkOperand(const TiledSquareMatrix& m) const
+{
+    if(m.n != n || m.tile != tile)
+    {
+        throw std::invalid_argument("Matrix or tile sizes do not match.");
+    }
+}
+
+/* Creating the result truncates its file, which must not be an operand. */
+void TiledSquareMatrix::checkResultPath(const std::string& path) const
+{
+    if(file->isFile(path))
+    {
+        throw std::invalid_argument("Result file " + path + " is an operand.");
+    }
+}
+
+unsigned int TiledSquareMatrix::getRowSize() const
+{
+    return n;
+}
+
+unsigned int TiledSquareMatrix::getTileSize() const
+{
+    return tile;
+}
+
+unsigned int TiledSquareMatrix::getTileCount() const
+{
+    return tiles;
+}
+
+const std::string& TiledSquareMatrix::getPath() const
+{
+    return file->path;
+}
+
+SquareMatrix* TiledSquareMatrix::clone() const
+{
+    return new TiledSquareMatrix{*this};
+}
+
+void TiledSquareMatrix::readTile(unsigned int ti, unsigned int tj,
+                                 std::vector<int>& out) const
+{
+    if(ti >= tiles || tj >= tiles)
+    {
+        throw std::out_of_range("Tile index out of range.");
+    }
+
+    out.resize(static_cast<std::size_t>(tile) * tile);
+    file->read(tileOffset(ti, tj), reinterpret_cast<char*>(out.data()),
+               out.size() * sizeof(int));
+}
+
+void TiledSquareMatrix::writeTile(unsigned int ti, unsigned int tj,
+                                  const std::vector<int>& in)
+{
+    if(ti >= tiles || tj >= tiles)
+    {
+        throw std::out_of_range("Tile index out of range.");
+    }
+    if(in.size() != static_cast<std::size_t>(tile) * tile)
+    {
+        throw std::invalid_argument("Wrong tile size.");
+    }
+
+    file->write(tileOffset(ti, tj), reinterpret_cast<const char*>(in.data()),
+                in.size() * sizeof(int));
+}
+
+void TiledSquareMatrix::readRowBand(unsigned int ti, std::vector<int>& out) const
+{
+    if(ti >= tiles)
+    {
+        throw std::out_of_range("Tile index out of range.");
+    }
+
+    out.assign(static_cast<std::size_t>(tile) * n, 0);
+    std::vector<int> t;
+
+    for(unsigned int tj = 0; tj < tiles; tj++)
+    {
+        readTile(ti, tj, t);
+        const unsigned int cols = std::min(tile, n - tj * tile);
+        for(unsigned int r = 0; r < tile; r++)
+        {
+            std::copy(t.begin() + static_cast<std::size_t>(r) * tile,
+                      t.begin() + static_cast<std::size_t>(r) * tile + cols,
+                      out.begin() + static_cast<std::size_t>(r) * n + tj * tile);
+        }
+    }
+}
+
+void TiledSquareMatrix::print(std::ostream& os) const
+{
+    std::vector<int> band;
+    std::string buf;
+    buf.reserve(format_chunk_size + max_int_length + 2);
+    buf += '[';
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        if(i % tile == 0) readRowBand(i / tile, band);
+        const int* row = band.data() + static_cast<std::size_t>(i % tile) * n;
+
+        buf += '[';
+        for(unsigned int j = 0; j < n; j++)
+        {
+            if(j != 0) buf += ',';
+            char num[max_int_length];
+            buf.append(num, format_int(num, row[j]));
+
+            if(buf.size() >= format_chunk_size)
+            {
+                os.write(buf.data(), buf.size());
+                buf.clear();
+            }
+        }
+        buf += ']';
+    }
+
+    buf += ']';
+    os.write(buf.data(), buf.size());
+}
+
+std::string TiledSquareMatrix::toString() const
+{
+    std::ostringstream ss;
+    print(ss);
+    return ss.str();
+}
+
+ConcreteSquareMatrix TiledSquareMatrix::evaluate(const Valuation&) const
+{
+    std::vector<int> values;
+    values.reserve(static_cast<std::size_t>(n) * n);
+    std::vector<int> band;
+
+    for(unsigned int ti = 0; ti < tiles; ti++)
+    {
+        readRowBand(ti, band);
+        const unsigned int rows = std::min(tile, n - ti * tile);
+        values.insert(values.end(), band.begin(),
+                      band.begin() + static_cast<std::size_t>(rows) * n);
+    }
+
+    return ConcreteSquareMatrix{n, values};
+}
+
+int TiledSquareMatrix::at(unsigned int i, unsigned int j) const
+{
+    if(i >= n || j >= n)
+    {
+        throw std::out_of_range("Index out of range.");
+    }
+
+    int v = 0;
+    file->read(tileOffset(i / tile, j / tile) +
+               (static_cast<std::uint64_t>(i % tile) * tile + j % tile) * sizeof(int),
+               reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+}
+
+/* res = op(a, b) elementwise, one pair of tiles at a time. */
+template <typename Op>
+static void elementwise_tiles(const TiledSquareMatrix& a, const TiledSquareMatrix& b,
+                              TiledSquareMatrix& res, Op op)
+{
+    TileWriter writer{res};
+    const unsigned int t = a.getTileCount();
+
+    read_ahead(static_cast<unsigned long long>(t) * t,
+        [&a, &b, t](unsigned long long k)
+        {
+            TilePair p;
+            a.readTile(k / t, k % t, p.first);
+            b.readTile(k / t, k % t, p.second);
+            return p;
+        },
+        [&writer, t, op](unsigned long long k, TilePair& p)
+        {
+            for(std::size_t i = 0; i < p.first.size(); i++)
+            {
+                p.first[i] = op(p.first[i], p.second[i]);
+            }
+            writer.write(k / t, k % t, std::move(p.first));
+        });
+
+    writer.finish();
+}
+
+TiledSquareMatrix TiledSquareMatrix::add(const TiledSquareMatrix& m,
+                                         const std::string& path) const
+{
+    checkOperand(m);
+    checkResultPath(path);
+    m.checkResultPath(path);
+
+    TiledSquareMatrix res = create(path, n, tile);
+    elementwise_tiles(*this, m, res, [](int x, int y) {return x + y;});
+    return res;
+}
+
+TiledSquareMatrix TiledSquareMatrix::subtract(const TiledSquareMatrix& m,
+                                              const std::string& path) const
+{
+    checkOperand(m);
+    checkResultPath(path);
+    m.checkResultPath(path);
+
+    TiledSquareMatrix res = create(path, n, tile);
+    elementwise_tiles(*this, m, res, [](int x, int y) {return x - y;});
+    return res;
+}
+
+TiledSquareMatrix TiledSquareMatrix::multiply(const TiledSquareMatrix& m,
+                                              const std::string& path) const
+{
+    checkOperand(m);
+    checkResultPath(path);
+    m.checkResultPath(path);
+
+    TiledSquareMatrix res = create(path, n, tile);
+    TileWriter writer{res};
+    const unsigned int t = tiles;
+    const unsigned int sz = tile;
+    std::vector<int> acc(static_cast<std::size_t>(sz) * sz, 0);
+
+    /* Step k of result tile (i, j) multiplies A(i, k) with B(k, j). */
+    read_ahead(static_cast<unsigned long long>(t) * t * t,
+        [this, &m, t](unsigned long long q)
+        {
+            const unsigned int k = q % t;
+            const unsigned long long ij = q / t;
+            TilePair p;
+            readTile(ij / t, k, p.first);
+            m.readTile(k, ij % t, p.second);
+            return p;
+        },
+        [&writer, &acc, t, sz](unsigned long long q, TilePair& p)
+        {
+            const int* a = p.first.data();
+            const int* b = p.second.data();
+            int* c = acc.data();
+
+            /* i-k-j order, the inner loop runs along rows of b and c. */
+            parallel_for(0, sz, 16, [a, b, c, sz](unsigned int first, unsigned int last)
+            {
+                for(unsigned int i = first; i < last; i++)
+                {
+                    int* crow = c + static_cast<std::size_t>(i) * sz;
+                    for(unsigned int k = 0; k < sz; k++)
+                    {
+                        const int aik = a[static_cast<std::size_t>(i) * sz + k];
+                        const int* brow = b + static_cast<std::size_t>(k) * sz;
+                        for(unsigned int j = 0; j < sz; j++) crow[j] += aik * brow[j];
+                    }
+                }
+            });
+
+            if(q % t == t - 1)
+            {
+                const unsigned long long ij = q / t;
+                writer.write(ij / t, ij % t, acc);
+                std::fill(acc.begin(), acc.end(), 0);
+            }
+        });
+
+    writer.finish();
+    return res;
+}
+
+TiledSquareMatrix TiledSquareMatrix::transpose(const std::string& path) const
+{
+    checkResultPath(path);
+
+    TiledSquareMatrix res = create(path, n, tile);
+    TileWriter writer{res};
+    const unsigned int t = tiles;
+    const unsigned int sz = tile;
+
+    read_ahead(static_cast<unsigned long long>(t) * t,
+        [this, t](unsigned long long k)
+        {
+            std::vector<int> in;
+            readTile(k / t, k % t, in);
+            return in;
+        },
+        [&writer, t, sz](unsigned long long k, std::vector<int>& in)
+        {
+            std::vector<int> out(in.size());
+            for(unsigned int i = 0; i < sz; i++)
+            {
+                for(unsigned int j = 0; j < sz; j++)
+                {
+                    out[static_cast<std::size_t>(j) * sz + i] =
+                        in[static_cast<std::size_t>(i) * sz + j];
+                }
+            }
+            writer.write(k % t, k / t, std::move(out));
+        });
+
+    writer.finish();
+    return res;
+}
+
+TiledSquareMatrix TiledSquareMatrix::fromSquareMatrix(
+    const SquareMatrix& m, const std::string& path, unsigned int new_tile)
+{
+    std::vector<int> values;
+    const int* data = nullptr;
+
+    if(auto mapped = dynamic_cast<const MappedSquareMatrix*>(&m))
+    {
+        data = mapped->data();
+    }
+    else
+    {
+        const ConcreteSquareMatrix c = m.evaluate(Valuation{});
+        const unsigned int size = c.getRowSize() * c.getRowSize();
+        values.reserve(size);
+        for(const IntElement* e : c.block(0, size))
+        {
+            values.push_back(e->getVal());
+        }
+        data = values.data();
+    }
+
+    TiledSquareMatrix res = create(path, m.getRowSize(), new_tile);
+    TileWriter writer{res};
+    const unsigned int n = res.n;
+    const unsigned int sz = res.tile;
+
+    for(unsigned int ti = 0; ti < res.tiles; ti++)
+    {
+        for(unsigned int tj = 0; tj < res.tiles; tj++)
+        {
+            std::vector<int> t(static_cast<std::size_t>(sz) * sz, 0);
+            const unsigned int rows = std::min(sz, n - ti * sz);
+            const unsigned int cols = std::min(sz, n - tj * sz);
+
+            for(unsigned int r = 0; r < rows; r++)
+            {
+                const int* src = data +
+                    static_cast<std::size_t>(ti * sz + r) * n + tj * sz;
+                std::copy(src, src + cols, t.begin() + static_cast<std::size_t>(r) * sz);
+            }
+            writer.write(ti, tj, std::move(t));
+        }
+    }
+
+    writer.finish();
+    return res;
+}
+
+/* Removes an intermediate result file when it goes out of scope. */
+struct PartFile
+{
+    const std::string path;
+
+    ~PartFile()
+    {
+        std::remove(path.c_str());
+    }
+};
+
+/* m in tiles: tiled leaves as they are, anything else in path. */
+static TiledSquareMatrix tiled_operand(const SquareMatrix& m, const std::string& path,
+                                       const Valuation& val, unsigned int tile,
+                                       unsigned int& parts)
+{
+    if(auto tiled = dynamic_cast<const TiledSquareMatrix*>(&m))
+    {
+        if(tiled->getTileSize() != tile)
+        {
+            throw std::invalid_argument("Matrix or tile sizes do not match.");
+        }
+        return *tiled;
+    }
+
+    auto composite = dynamic_cast<const CompositeSquareMatrix*>(&m);
+    if(composite == nullptr)
+    {
+        if(dynamic_cast<const MappedSquareMatrix*>(&m) != nullptr)
+        {
+            return TiledSquareMatrix::fromSquareMatrix(m, path, tile);
+        }
+        return TiledSquareMatrix::fromSquareMatrix(m.evaluate(val), path, tile);
+    }
+
+    const PartFile left_part{path + ".part" + std::to_string(parts++)};
+    const PartFile right_part{path + ".part" + std::to_string(parts++)};
+    const TiledSquareMatrix left = tiled_operand(
+        composite->getLeftOperand(), left_part.path, val, tile, parts);
+    const TiledSquareMatrix right = tiled_operand(
+        composite->getRightOperand(), right_part.path, val, tile, parts);
+
+    switch(composite->getOperator())
+    {
+        case '+': return left.add(right, path);
+        case '-': return left.subtract(right, path);
+        case '*': return left.multiply(right, path);
+        case '/':
+        {
+            const PartFile transposed{path + ".part" + std::to_string(parts++)};
+            return left.multiply(right.transpose(transposed.path), path);
+        }
+        default:
+            throw std::invalid_argument(
+                std::string{"Unknown operator "} + composite->getOperator() + ".");
+    }
+}
+
+TiledSquareMatrix TiledSquareMatrix::evaluateTiled(
+    const SquareMatrix& m, const std::string& path, const Valuation& val,
+    unsigned int new_tile)
+{
+    unsigned int parts = 0;
+    const TiledSquareMatrix ret = tiled_operand(m, path, val, new_tile, parts);
+    if(ret.file->isFile(path)) return ret;
+
+    /* m is a tiled leaf, the result is a copy of it. */
+    TiledSquareMatrix copy = create(path, ret.n, ret.tile);
+    TileWriter writer{copy};
+    std::vector<int> t;
+    for(unsigned int ti = 0; ti < ret.tiles; ti++)
+    {
+        for(unsigned int tj = 0; tj < ret.tiles; tj++)
+        {
+            ret.readTile(ti, tj, t);
+            writer.write(ti, tj, t);
+        }
+    }
+    writer.finish();
+    return copy;
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("TiledSquareMatrix operations.", "[TiledSquareMatrix][file]")
+{
+    /* 7 rows in tiles of 3, edge tiles are padded. */
+    ConcreteSquareMatrix c1{7};
+    ConcreteSquareMatrix c2{7};
+
+    auto a = TiledSquareMatrix::fromSquareMatrix(c1, "sqm_test_a.tiles", 3);
+    auto b = TiledSquareMatrix::fromSquareMatrix(c2, "sqm_test_b.tiles", 3);
+    CHECK(a.getTileCount() == 3);
+    CHECK(a.toString() == c1.toString());
+    CHECK(a.evaluate(Valuation{}) == c1);
+    CHECK(a.at(6, 2) == (*c1.block(6 * 7 + 2, 1).front()).getVal());
+    CHECK_THROWS_AS(a.at(7, 0), std::out_of_range&);
+
+    auto sum = a.add(b, "sqm_test_sum.tiles");
+    CHECK(sum.evaluate(Valuation{}) == c1 + c2);
+
+    auto prod = a.multiply(b, "sqm_test_prod.tiles");
+    CHECK(prod.evaluate(Valuation{}) == c1 * c2);
+
+    auto tr = a.transpose("sqm_test_tr.tiles");
+    CHECK(tr.evaluate(Valuation{}) == c1.transpose());
+
+    /* Reopening the file. */
+    auto reopened = TiledSquareMatrix::open("sqm_test_prod.tiles", 7, 3);
+    CHECK(reopened.toString() == prod.toString());
+    CHECK_THROWS_AS(TiledSquareMatrix::open("sqm_test_prod.tiles", 10, 3),
+                    std::invalid_argument&);
+
+    /* Result files must not be operands, creating them truncates. */
+    CHECK_THROWS_AS(a.add(b, "sqm_test_a.tiles"), std::invalid_argument&);
+    CHECK_THROWS_AS(a.multiply(b, "./sqm_test_b.tiles"), std::invalid_argument&);
+    CHECK_THROWS_AS(a.transpose("sqm_test_a.tiles"), std::invalid_argument&);
+    CHECK(a.evaluate(Valuation{}) == c1);
+    CHECK(b.evaluate(Valuation{}) == c2);
+
+    /* Composite operands are evaluated like any other matrix. */
+    CompositeSquareMatrix csm{a, b,
+        [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+        {
+            return m1 * m2;
+        },
+        '*'};
+    CHECK(csm.evaluate(Valuation{}) == c1 * c2);
+
+    /* To and from binary matrix files. */
+    saveMatrixFile("sqm_test_prod.bin", prod);
+    MappedSquareMatrix mapped{"sqm_test_prod.bin"};
+    CHECK(mapped.toString() == prod.toString());
+    auto back = TiledSquareMatrix::fromSquareMatrix(mapped, "sqm_test_back.tiles", 4);
+    CHECK(back.toString() == prod.toString());
+
+    auto other = TiledSquareMatrix::create("sqm_test_other.tiles", 7, 4);
+    CHECK_THROWS_AS(a.add(other, "sqm_test_bad.tiles"), std::invalid_argument&);
+
+    auto diff = a.subtract(b, "sqm_test_diff.tiles");
+    CHECK(diff.evaluate(Valuation{}) == c1 - c2);
+
+    for(const char* f : {"sqm_test_a.tiles", "sqm_test_b.tiles", "sqm_test_sum.tiles",
+                         "sqm_test_diff.tiles",
+                         "sqm_test_prod.tiles", "sqm_test_tr.tiles", "sqm_test_prod.bin",
+                         "sqm_test_back.tiles", "sqm_test_other.tiles"})
+    {
+        std::remove(f);
+    }
+}
+
+TEST_CASE("Expressions are evaluated out-of-core.",
+          "[TiledSquareMatrix][CompositeSquareMatrix][file][exception]")
+{
+    ConcreteSquareMatrix c1{6};
+    ConcreteSquareMatrix c2{6};
+    auto a = TiledSquareMatrix::fromSquareMatrix(c1, "sqm_test_ea.tiles", 4);
+    SymbolicSquareMatrix s{"[[x,0,0,0,0,0][0,x,0,0,0,0][0,0,x,0,0,0]"
+                           "[0,0,0,x,0,0][0,0,0,0,x,0][0,0,0,0,0,x]]"};
+    const Valuation val{{'x', 3}};
+
+    CompositeSquareMatrix sum{a, c2, std::plus<ConcreteSquareMatrix>(), '+'};
+    CompositeSquareMatrix diff{sum, s, std::minus<ConcreteSquareMatrix>(), '-'};
+    CompositeSquareMatrix prod{diff, a, std::multiplies<ConcreteSquareMatrix>(), '*'};
+    CompositeSquareMatrix div{prod, c2,
+        [](const ConcreteSquareMatrix& m1, const ConcreteSquareMatrix& m2)
+        {
+            return m1 / m2;
+        },
+        '/'};
+
+    for(const CompositeSquareMatrix* e : {&sum, &diff, &prod, &div})
+    {
+        auto res = TiledSquareMatrix::evaluateTiled(*e, "sqm_test_eres.tiles", val, 4);
+        CHECK(res.evaluate(val) == e->evaluate(val));
+    }
+
+    /* Only the result is left behind. */
+    CHECK(std::ifstream{"sqm_test_eres.tiles"}.good());
+    CHECK_FALSE(std::ifstream{"sqm_test_eres.tiles.part0"}.good());
+    CHECK_FALSE(std::ifstream{"sqm_test_eres.tiles.part1"}.good());
+
+    auto copy = TiledSquareMatrix::evaluateTiled(a, "sqm_test_eres.tiles", val, 4);
+    CHECK(copy.evaluate(val) == c1);
+    CHECK(TiledSquareMatrix::evaluateTiled(a, "sqm_test_ea.tiles", val, 4).getPath() ==
+          a.getPath());
+
+    CHECK_THROWS_AS(TiledSquareMatrix::evaluateTiled(sum, "sqm_test_ea.tiles", val, 4),
+                    std::invalid_argument&);
+    CHECK(a.evaluate(val) == c1);
+    CHECK_THROWS_AS(TiledSquareMatrix::evaluateTiled(sum, "sqm_test_eres.tiles", val, 3),
+                    std::invalid_argument&);
+
+    std::remove("sqm_test_ea.tiles");
+    std::remove("sqm_test_eres.tiles");
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,223 @@
+/** \file tiledsquarematrix.hpp
+ *  \brief TiledSquareMatrix header file. Out-of-core matrices stored
+ *         as square tiles in a file.
+ */
+
+#ifndef TILEDSQUAREMATRIX_H
+#define TILEDSQUAREMATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "squarematrix.hpp"
+
+/** \brief Default row size of the tiles of a TiledSquareMatrix.
+ *         A 512 * 512 tile of ints is 1 MiB.
+ */
+const unsigned int default_tile_size = 512;
+
+/** \brief Number of finished tiles that may wait to be written before
+ *         an operation stops to wait for the disk.
+ */
+const std::size_t tile_write_behind = 2;
+
+class TileFile;
+
+/** \class TiledSquareMatrix
+ *  \brief Integer matrix that lives in a file as tile * tile blocks.
+ *
+ *  Tiles are stored one after another in row-major tile order, each in
+ *  row-major order. Tiles on the right and bottom edges are padded with
+ *  zeros to full size. The file has no header; saveMatrixFile() and
+ *  fromSquareMatrix() with a MappedSquareMatrix convert to and from
+ *  binary matrix files.
+ *
+ *  add(), subtract(), multiply() and transpose() stream tiles through
+ *  memory, and evaluateTiled() does whole expressions with them. The
+ *  tiles for the next step are read on another thread while the current
+ *  one is computed, and results are written behind by a writer thread, so
+ *  the working set is a few tiles regardless of n. Copies share the file.
+ */
+class TiledSquareMatrix : public SquareMatrix
+{
+    public:
+        /** \brief Creates a zero matrix in a new file.
+         *  \param path Path of the file, overwritten if it exists.
+         *  \param new_n Row size.
+         *  \param new_tile Row size of the tiles.
+         *  \return The matrix.
+         *  \throw std::invalid_argument if new_tile is 0.
+         *  \throw std::runtime_error if the file cannot be created.
+         */
+        static TiledSquareMatrix create(const std::string& path, unsigned int new_n,
+                                        unsigned int new_tile = default_tile_size);
+
+        /** \brief Opens the file of an existing tiled matrix.
+         *  \param path Path of the file.
+         *  \param new_n Row size the matrix was created with.
+         *  \param new_tile Tile size the matrix was created with.
+         *  \return The matrix.
+         *  \throw std::invalid_argument if new_tile is 0 or the file size
+         *         does not match.
+         *  \throw std::runtime_error if the file cannot be opened.
+         */
+        static TiledSquareMatrix open(const std::string& path, unsigned int new_n,
+                                      unsigned int new_tile = default_tile_size);
+
+        /** \brief Get row size of the matrix.
+         *  \return Value of member n.
+         */
+        unsigned int getRowSize() const override;
+
+        /** \brief Get row size of the tiles.
+         *  \return Value of member tile.
+         */
+        unsigned int getTileSize() const;
+
+        /** \brief Get the number of tiles in a row of tiles.
+         *  \return Tile count.
+         */
+        unsigned int getTileCount() const;
+
+        /** \brief Get the path of the file.
+         *  \return Path.
+         */
+        const std::string& getPath() const;
+
+        /** \brief Returns pointer to a copy of this sharing the file.
+         *  \return SquareMatrix pointer.
+         */
+        SquareMatrix* clone() const override;
+
+        /** \brief Prints string representation to output stream, reading
+         *         one row of tiles at a time.
+         *  \param os std::ostream reference.
+         */
+        void print(std::ostream& os) const override;
+
+        /** \brief Returns string representation of the matrix.
+         *  \return std::string.
+         */
+        std::string toString() const override;
+
+        /** \brief Reads the whole matrix to a ConcreteSquareMatrix, which
+         *         is what CompositeSquareMatrix::evaluate() needs. Use
+         *         evaluateTiled() to keep expressions out-of-core.
+         *  \return New instance of ConcreteSquareMatrix.
+         */
+        ConcreteSquareMatrix evaluate(const Valuation&) const override;
+
+        /** \brief Element getter. Reads one element from the file.
+         *  \param i Row index.
+         *  \param j Column index.
+         *  \return Value of the element.
+         *  \throw std::out_of_range if i or j is not below n.
+         */
+        int at(unsigned int i, unsigned int j) const;
+
+        /** \brief Reads the rows covered by a row of tiles.
+         *  \param ti Tile row index.
+         *  \param out Set to the rows in row-major order, tile * n
+         *         elements. Rows past n in the last band are zero.
+         *  \throw std::out_of_range if ti is not below getTileCount().
+         */
+        void readRowBand(unsigned int ti, std::vector<int>& out) const;
+
+        /** \brief Reads a tile.
+         *  \param ti Tile row index.
+         *  \param tj Tile column index.
+         *  \param out Set to the tile * tile elements of the tile.
+         *  \throw std::out_of_range if ti or tj is not below getTileCount().
+         */
+        void readTile(unsigned int ti, unsigned int tj, std::vector<int>& out) const;
+
+        /** \brief Writes a tile.
+         *  \param ti Tile row index.
+         *  \param tj Tile column index.
+         *  \param in tile * tile elements. Padding must be zero.
+         *  \throw std::out_of_range if ti or tj is not below getTileCount().
+         *  \throw std::invalid_argument if in has wrong size.
+         */
+        void writeTile(unsigned int ti, unsigned int tj, const std::vector<int>& in);
+
+        /** \brief Elementwise sum, written to a new file.
+         *  \param m Matrix with the same row and tile sizes.
+         *  \param path Path of the result file.
+         *  \return The result.
+         *  \throw std::invalid_argument if sizes do not match or path is
+         *         the file of an operand.
+         */
+        TiledSquareMatrix add(const TiledSquareMatrix& m, const std::string& path) const;
+
+        /** \brief Elementwise difference this - m, written to a new file.
+         *  \param m Matrix with the same row and tile sizes.
+         *  \param path Path of the result file.
+         *  \return The result.
+         *  \throw std::invalid_argument if sizes do not match or path is
+         *         the file of an operand.
+         */
+        TiledSquareMatrix subtract(const TiledSquareMatrix& m, const std::string& path) const;
+
+        /** \brief Matrix product this * m, written to a new file.
+         *  \param m Matrix with the same row and tile sizes.
+         *  \param path Path of the result file.
+         *  \return The result.
+         *  \throw std::invalid_argument if sizes do not match or path is
+         *         the file of an operand.
+         */
+        TiledSquareMatrix multiply(const TiledSquareMatrix& m, const std::string& path) const;
+
+        /** \brief Transpose, written to a new file.
+         *  \param path Path of the result file.
+         *  \return The result.
+         *  \throw std::invalid_argument if path is the file of this.
+         */
+        TiledSquareMatrix transpose(const std::string& path) const;
+
+        /** \brief Copies a matrix to a new tiled file. MappedSquareMatrix
+         *         is copied row by row, others are evaluated first.
+         *  \param m Matrix to copy.
+         *  \param path Path of the file.
+         *  \param new_tile Row size of the tiles.
+         *  \return The copy.
+         */
+        static TiledSquareMatrix fromSquareMatrix(
+            const SquareMatrix& m, const std::string& path,
+            unsigned int new_tile = default_tile_size);
+
+        /** \brief Evaluates an expression out-of-core. The operators of
+         *         CompositeSquareMatrix nodes are done with add(),
+         *         subtract(), multiply() and transpose() on tiled operands,
+         *         the intermediate results being kept in files next to
+         *         path that are removed when no longer needed. Tiled leaves
+         *         are used as they are, MappedSquareMatrix leaves are
+         *         copied row by row and other leaves are evaluated first.
+         *  \param m Expression to evaluate.
+         *  \param path Path of the result file.
+         *  \param val Valuation of the symbolic leaves.
+         *  \param new_tile Row size of the tiles, which tiled leaves must
+         *         have too.
+         *  \return The result.
+         *  \throw std::invalid_argument if sizes do not match, an operator
+         *         is unknown or path is the file of a leaf.
+         */
+        static TiledSquareMatrix evaluateTiled(
+            const SquareMatrix& m, const std::string& path, const Valuation& val,
+            unsigned int new_tile = default_tile_size);
+
+    private:
+        TiledSquareMatrix(unsigned int new_n, unsigned int new_tile);
+
+        std::uint64_t tileOffset(unsigned int ti, unsigned int tj) const;
+        void checkOperand(const TiledSquareMatrix& m) const;
+        void checkResultPath(const std::string& path) const;
+
+        std::shared_ptr<TileFile> file;
+        unsigned int n;
+        unsigned int tile;
+        unsigned int tiles;
+};
+
+#endif // TILEDSQUAREMATRIX_H
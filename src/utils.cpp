@@ -4,10 +4,29 @@
 
 #include "utils.hpp"
 
+std::istream& read_command(std::istream& is, std::string& buffer)
+{
+    /* Skip leading blanks without consuming the line. */
+    auto c = is.peek();
+    while(c == ' ' || c == '\t')
+    {
+        is.get();
+        c = is.peek();
+    }
+
+    if(c == '[')
+    {
+        buffer = "[";
+        return is;
+    }
+
+    return std::getline(is, buffer);
+}
+
 std::istream& get_user_input(
-    const std::ostream& os, std::istream& is,
+    std::ostream& os, std::istream& is,
     const std::string& prompt, std::string& buffer)
 {
-    std::cout << prompt << std::endl;
-    return std::getline(is, buffer);
+    os << prompt << std::endl;
+    return read_command(is, buffer);
 }
@@ -19,15 +19,26 @@ const std::string _BLU_ = "\033[34m";
 const std::string _END_ = "\033[0m";
 //@}
 
+/** \brief Reads the next command without a prompt.
+ *  \param is Reference to std::istream to read from.
+ *  \param buffer Target for input. If the input starts with a matrix, buffer
+ *         is set to "[" and the matrix is left in is to be read with
+ *         readSquareMatrix().
+ *  \return Input stream reference (parameter is).
+ */
+std::istream& read_command(std::istream& is, std::string& buffer);
+
 /** \brief Function for prompting user input and reading it to desired string.
  *  \param os Reference to std::ostream (where the prompt message is written to).
  *  \param is Reference to std::istream (where user input is read from).
  *  \param prompt String to write to os.
- *  \param buffer Target for input.
+ *  \param buffer Target for input. If the input starts with a matrix, buffer
+ *         is set to "[" and the matrix is left in is to be read with
+ *         readSquareMatrix().
  *  \return Input stream reference (parameter is).
  */
 std::istream& get_user_input(
-    const std::ostream& os, std::istream& is,
+    std::ostream& os, std::istream& is,
     const std::string& prompt, std::string& buffer);
 
 #endif // UTILS_HPP_INCLUDED
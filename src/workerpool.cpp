@@ -0,0 +1,375 @@
+/** \file workerpool.cpp
+ *  \brief WorkerPool implementation file.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "workerpool.hpp"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "evaluationstats.hpp"
+#include "executiontrace.hpp"
+#include "threadconfig.hpp"
+#ifdef SQM_TESTS
+#include "catch.hpp"
+#endif
+
+/* Set for pool threads, so nested work does not wait for itself. */
+static thread_local bool in_worker = false;
+
+WorkerPool::WorkerPool(unsigned int size) :
+    job(nullptr), job_count(0), next(0), pending(0),
+    active(0), generation(0), stopping(false)
+{
+    start(size);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+/* The workers that started are stopped if one cannot be started or
+ * pinned, so that no joinable thread is left behind. */
+void WorkerPool::start(unsigned int size)
+{
+    try
+    {
+        workers.reserve(size);
+        for(unsigned int i = 0; i < size; i++)
+        {
+            workers.push_back(std::thread{&WorkerPool::loop, this});
+            if(affinity.empty()) continue;
+
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(affinity[i % affinity.size()], &set);
+            if(pthread_setaffinity_np(workers.back().native_handle(), sizeof(set), &set) != 0)
+            {
+                throw std::runtime_error("Cannot pin a worker to CPU " +
+                    std::to_string(affinity[i % affinity.size()]) + ".");
+            }
+#endif
+        }
+    }
+    catch(...)
+    {
+        stop();
+        throw;
+    }
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    start_cv.notify_all();
+
+    for(auto&& t : workers)
+    {
+        t.join();
+    }
+    workers.clear();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = false;
+}
+
+/* If the new workers cannot start, the old size and affinity are restored,
+ * which worked before. */
+void WorkerPool::restart(unsigned int size, const std::vector<unsigned int>& cpus)
+{
+    const unsigned int old_size = workers.size();
+    std::vector<unsigned int> old_affinity = cpus;
+    old_affinity.swap(affinity);
+
+    stop();
+    try
+    {
+        start(size);
+    }
+    catch(...)
+    {
+        affinity.swap(old_affinity);
+        start(old_size);
+        throw;
+    }
+}
+
+void WorkerPool::resize(unsigned int size)
+{
+    std::lock_guard<std::mutex> run_lock(run_mtx);
+    if(size == workers.size()) return;
+
+    restart(size, affinity);
+}
+
+void WorkerPool::setAffinity(const std::vector<unsigned int>& cpus)
+{
+#ifndef __linux__
+    if(!cpus.empty()) throw std::runtime_error("Pinning threads needs Linux.");
+#else
+    /* Checked before the workers are stopped. */
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        throw std::runtime_error("Cannot get the CPUs of the process.");
+    }
+    for(unsigned int cpu : cpus)
+    {
+        if(cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+        {
+            throw std::runtime_error("No CPU " + std::to_string(cpu) + ".");
+        }
+    }
+#endif
+
+    std::lock_guard<std::mutex> run_lock(run_mtx);
+    restart(workers.size(), cpus);
+}
+
+unsigned int WorkerPool::getConcurrency() const
+{
+    return workers.size() + 1;
+}
+
+void WorkerPool::run(unsigned int count,
+                     const std::function<void(unsigned int)>& func)
+{
+    if(count == 0) return;
+
+    if(in_worker || workers.empty() || count == 1)
+    {
+        for(unsigned int i = 0; i < count; i++) func(i);
+        return;
+    }
+
+    EvaluationProfile::noteThreads(std::min(count, getConcurrency()));
+
+    std::lock_guard<std::mutex> run_lock(run_mtx);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        job = &func;
+        job_count = count;
+        pending = count;
+        error = nullptr;
+        next = 0;
+        generation++;
+    }
+    start_cv.notify_all();
+
+    /* Tasks run here may reach run() again, they must run inline
+     * instead of waiting for run_mtx. */
+    const bool was_worker = in_worker;
+    in_worker = true;
+    work(func, count);
+    in_worker = was_worker;
+
+    std::exception_ptr e;
+    {
+        /* Wait for stragglers too, so none of them can pick up
+         * tasks of the next run with this run's function. */
+        TraceSpan span{"barrier wait"};
+        std::unique_lock<std::mutex> lock(mtx);
+        done_cv.wait(lock, [this]{return pending == 0 && active == 0;});
+        job = nullptr;
+        job_count = 0;
+        e = error;
+    }
+
+    if(e) std::rethrow_exception(e);
+}
+
+void WorkerPool::loop()
+{
+    in_worker = true;
+    unsigned long seen = 0;
+
+    while(true)
+    {
+        const std::function<void(unsigned int)>* func = nullptr;
+        unsigned int count = 0;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            start_cv.wait(lock, [this, &seen]
+                {return stopping || generation != seen;});
+            if(stopping) return;
+            seen = generation;
+            if(job == nullptr) continue;
+            func = job;
+            count = job_count;
+            active++;
+        }
+
+        work(*func, count);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if(--active == 0) done_cv.notify_all();
+    }
+}
+
+void WorkerPool::work(const std::function<void(unsigned int)>& func,
+                      unsigned int count)
+{
+    while(true)
+    {
+        const unsigned int i = next++;
+        if(i >= count) break;
+
+        try
+        {
+            TraceSpan span{"task", i};
+            func(i);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(!error) error = std::current_exception();
+        }
+
+        if(--pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            done_cv.notify_all();
+        }
+    }
+}
+
+WorkerPool& WorkerPool::instance()
+{
+    static WorkerPool pool{thread_count() - 1};
+    return pool;
+}
+
+void parallel_for(unsigned int begin, unsigned int end, unsigned int grain,
+                  const std::function<void(unsigned int, unsigned int)>& func)
+{
+    if(begin >= end) return;
+
+    WorkerPool& pool = WorkerPool::instance();
+    const unsigned int size = end - begin;
+    const unsigned int chunks = std::max(1u, std::min(
+        pool.getConcurrency(), size / std::max(grain, 1u)));
+    const unsigned int chunksz = (size + chunks - 1) / chunks;
+
+    pool.run(chunks, [begin, end, chunksz, &func](unsigned int c)
+    {
+        const unsigned int first = begin + c * chunksz;
+        if(first < end) func(first, std::min(end, first + chunksz));
+    });
+}
+
+#ifdef SQM_TESTS
+
+TEST_CASE("WorkerPool runs every task once.", "[WorkerPool][thread]")
+{
+    WorkerPool pool{3};
+    std::vector<std::atomic<int>> visits(1000);
+    for(auto& v : visits) v = 0;
+
+    CHECK(pool.getConcurrency() == 4);
+
+    for(int round = 0; round < 10; round++)
+    {
+        pool.run(visits.size(), [&visits](unsigned int i){visits[i]++;});
+    }
+
+    bool all_ten = std::all_of(visits.cbegin(), visits.cend(),
+        [](const std::atomic<int>& v){return v == 10;});
+    CHECK(all_ten);
+
+    pool.run(0, [](unsigned int){throw std::logic_error("Not called.");});
+
+    /* Resized and pinned pools run everything too. */
+    pool.resize(1);
+    CHECK(pool.getConcurrency() == 2);
+#ifdef __linux__
+    CHECK_THROWS_AS(pool.setAffinity({CPU_SETSIZE}), std::runtime_error&);
+    cpu_set_t set;
+    REQUIRE(sched_getaffinity(0, sizeof(set), &set) == 0);
+    unsigned int cpu = 0;
+    while(!CPU_ISSET(cpu, &set)) cpu++;
+
+    /* A CPU the process may not use leaves the pool as it was. */
+    unsigned int unavailable = 0;
+    while(unavailable < CPU_SETSIZE - 1 && CPU_ISSET(unavailable, &set)) unavailable++;
+    CHECK_THROWS_AS(pool.setAffinity({cpu, unavailable}), std::runtime_error&);
+    CHECK(pool.getConcurrency() == 2);
+    pool.resize(3);
+    CHECK(pool.getConcurrency() == 4);
+    pool.resize(1);
+
+    pool.setAffinity({cpu});
+#endif
+    pool.resize(2);
+    std::atomic<int> count{0};
+    pool.run(100, [&count](unsigned int){count++;});
+    CHECK(count == 100);
+    CHECK(pool.getConcurrency() == 3);
+    pool.setAffinity({});
+}
+
+TEST_CASE("WorkerPool errors.", "[WorkerPool][thread][exception]")
+{
+    WorkerPool pool{2};
+    std::atomic<int> count{0};
+
+    CHECK_THROWS(pool.run(100, [&count](unsigned int i)
+    {
+        count++;
+        if(i == 50) throw std::runtime_error("Task failed.");
+    }));
+    CHECK(count == 100);
+
+    /* Pool is still usable after an exception. */
+    count = 0;
+    pool.run(10, [&count](unsigned int){count++;});
+    CHECK(count == 10);
+}
+
+TEST_CASE("parallel_for covers the range.", "[WorkerPool][parallel_for]")
+{
+    std::vector<int> v(12345, 0);
+
+    parallel_for(5, v.size(), 100, [&v](unsigned int b, unsigned int e)
+    {
+        for(unsigned int i = b; i < e; i++) v[i] = 1;
+    });
+
+    CHECK(std::count(v.cbegin(), v.cend(), 1) == 12340);
+    CHECK(v[4] == 0);
+
+    parallel_for(3, 3, 1, [](unsigned int, unsigned int)
+    {
+        throw std::logic_error("Not called.");
+    });
+
+    /* Nested calls run inline on the caller and on the workers alike. */
+    const unsigned int threads = thread_count();
+    set_thread_count(3);
+    std::vector<std::atomic<int>> cells(64 * 64);
+    for(auto& c : cells) c = 0;
+    parallel_for(0, 64, 1, [&cells](unsigned int b, unsigned int e)
+    {
+        for(unsigned int i = b; i < e; i++)
+        {
+            parallel_for(0, 64, 1, [&cells, i](unsigned int b2, unsigned int e2)
+            {
+                for(unsigned int j = b2; j < e2; j++) cells[i * 64 + j]++;
+            });
+        }
+    });
+    set_thread_count(threads);
+    const bool all_once = std::all_of(cells.cbegin(), cells.cend(),
+        [](const std::atomic<int>& c){return c == 1;});
+    CHECK(all_once);
+}
+
+#endif // SQM_TESTS
@@ -0,0 +1,112 @@
+/** \file workerpool.hpp
+ *  \brief WorkerPool header file.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** \class WorkerPool
+ *  \brief Persistent worker threads for data-parallel loops.
+ *
+ *  Threads are started once and reused, so parallel operations do not pay
+ *  for thread creation. Work submitted from inside a worker is run serially
+ *  on that worker.
+ */
+class WorkerPool
+{
+    public:
+        /** \brief Parametrized constructor.
+         *  \param size Number of worker threads to start. The thread calling
+         *         run() takes part in the work too.
+         */
+        explicit WorkerPool(unsigned int size);
+
+        /** \brief Stops and joins all workers.
+         */
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /** \brief Get the number of threads taking part in run().
+         *  \return Worker count + 1 (the calling thread).
+         */
+        unsigned int getConcurrency() const;
+
+        /** \brief Runs func(i) for every i in [0, count) and waits until
+         *         all calls have returned.
+         *  \param count Number of tasks.
+         *  \param func Task function.
+         *
+         *  If a task throws, the first exception is rethrown here after
+         *  all tasks have finished.
+         */
+        void run(unsigned int count, const std::function<void(unsigned int)>& func);
+
+        /** \brief Restarts the pool with another number of workers. Must
+         *         not be called from a task.
+         *  \param size Number of worker threads.
+         *  \throw std::runtime_error if a worker cannot be pinned, the
+         *         pool keeps its old size then.
+         */
+        void resize(unsigned int size);
+
+        /** \brief Pins worker i to cpus[i % cpus.size()] and restarts the
+         *         workers. Must not be called from a task.
+         *  \param cpus CPU numbers, empty to stop pinning.
+         *  \throw std::runtime_error if a CPU is not available to the
+         *         process or a worker cannot be pinned, the pool keeps its
+         *         old affinity then.
+         */
+        void setAffinity(const std::vector<unsigned int>& cpus);
+
+        /** \brief Returns the process-wide pool with thread_count() - 1
+         *         workers.
+         *  \return Reference to WorkerPool.
+         */
+        static WorkerPool& instance();
+
+    private:
+        void start(unsigned int size);
+        void stop();
+        void restart(unsigned int size, const std::vector<unsigned int>& cpus);
+        void loop();
+        void work(const std::function<void(unsigned int)>& func,
+                  unsigned int count);
+
+        std::vector<std::thread> workers;
+        std::vector<unsigned int> affinity;
+        std::mutex run_mtx;
+        std::mutex mtx;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+
+        const std::function<void(unsigned int)>* job;
+        unsigned int job_count;
+        std::atomic<unsigned int> next;
+        std::atomic<unsigned int> pending;
+        unsigned int active;
+        unsigned long generation;
+        bool stopping;
+        std::exception_ptr error;
+};
+
+/** \brief Splits [begin, end) into contiguous ranges and calls
+ *         func(range_begin, range_end) for each of them on the WorkerPool.
+ *  \param begin First index.
+ *  \param end One past the last index.
+ *  \param grain Smallest range worth giving to a thread.
+ *  \param func Function to call for each range.
+ */
+void parallel_for(unsigned int begin, unsigned int end, unsigned int grain,
+                  const std::function<void(unsigned int, unsigned int)>& func);
+
+#endif // WORKERPOOL_H